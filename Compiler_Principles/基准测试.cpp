@@ -0,0 +1,624 @@
+// 词法分析器与语法分析器性能测试
+// 编译: g++ -O2 -std=c++17 -pthread 基准测试.cpp -o bench
+// 用法: bench [--sizes 1K,64K,1M,16M] [--mix ident,literal,operator] [--seed N]
+//       bench --parser [--sizes 1K,64K,1M,16M] [--seed N] [--functions N] [--depth D] [--expr E] [--decls K]
+//       bench --edits [N] [--sizes 1M,4M] [--seed N]
+// 默认测词法分析：生成符合文法的源程序 (标识符密集 / 常量密集 / 运算符密集三种配比)，
+// 依次交给各个词法分析实现，按 JSON 输出 MB/s、单词/s、每个单词的堆分配次数和峰值内存
+// --parser 测语法分析：用 程序生成器.cpp 生成各个大小的随机程序 (其余参数的含义同生成器)，
+// 交给实验三的递归下降和表驱动分析器，按 JSON 输出单词/s、语法成分行/s、每个单词的纳秒数和峰值内存，
+// 各个大小之间每个单词的纳秒数明显增长就说明有超线性的开销
+// (开始前先用几个不合文法的输入检查两个分析器都能结束、表驱动分析器报错，
+// 再用几个形状极端的合法输入检查两个分析器的输出相同，不通过时返回 1)
+// --edits 测实验二的增量词法分析：在生成的程序里随机位置做 N 次 (默认 10000) 小编辑，
+// 输出每次 applyEdit 的平均、中位、p99 和最大耗时 (微秒)，并与全文重新分析的结果对照，不一致时返回 1
+
+// 实验文件里用到的标准头文件都要先在这里包含，它们被放进命名空间后 #include 就不再生效
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <set>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <chrono>
+#include <random>
+#include <new>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cerrno>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// 两个实验各自是完整的程序，放进不同的命名空间，避免同名的全局变量和函数冲突
+#define NO_MAIN
+namespace lab2 {
+#include "实验二.cpp"
+}
+namespace lab3 {
+#include "实验三.cpp"
+}
+namespace progen {
+#include "程序生成器.cpp"
+}
+#undef NO_MAIN
+
+// ==========================================
+// 1. 堆分配计数与内存统计
+// ==========================================
+
+static atomic<uint64_t> allocCount(0);
+
+// 只有 operator new / operator delete 直接调用 malloc / free，数组和带大小的版本都转给它们。
+// 这两个函数不内联：内联后 GCC 在调用处看到 new 出来的指针被 free，会误报 -Wmismatched-new-delete
+__attribute__((noinline)) void* operator new(size_t size) {
+    allocCount.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+// 重置峰值内存统计 (Linux 4.0 起写 5 到 clear_refs 会清零 VmHWM)，失败时峰值就是进程启动以来的最大值
+void resetPeakRss() {
+    ofstream f("/proc/self/clear_refs");
+    if (f.is_open()) f << "5";
+}
+
+// 峰值常驻内存 (KB)
+long peakRssKb() {
+    ifstream f("/proc/self/status");
+    string line;
+    while (getline(f, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return atol(line.c_str() + 6);
+    }
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+// ==========================================
+// 2. 测试程序生成
+// ==========================================
+
+// 三种配比：标识符密集 (长变量名的赋值)、常量密集 (整数/字符/字符串常量)、运算符密集 (短名字的复杂表达式和条件)
+enum Mix { MIX_IDENT, MIX_LITERAL, MIX_OPERATOR };
+const char* const mixNames[] = {"ident", "literal", "operator"};
+
+const int VAR_COUNT = 64;
+
+string varName(Mix mix, int i) {
+    if (mix == MIX_IDENT) return "variable_name_" + to_string(i) + "_value";
+    return string(1, (char)('a' + i % 26)) + to_string(i / 26);
+}
+
+// 生成一个至少 targetBytes 字节、语法合法的程序：全局变量说明 + 主函数里的大量语句
+string generateCorpus(Mix mix, size_t targetBytes, uint32_t seed) {
+    mt19937 rng(seed);
+    auto pick = [&](int n) { return (int)(rng() % n); };
+    auto var = [&]() { return varName(mix, pick(VAR_COUNT)); };
+
+    string src;
+    src.reserve(targetBytes + 256);
+    src += "const int LIMIT = 1000, STEP = 2;\nconst char FIRST = 'a';\n";
+    src += "int ";
+    for (int i = 0; i < VAR_COUNT; i++) src += (i ? ", " : "") + varName(mix, i);
+    src += ", table[100];\nchar letter;\n";
+    src += "void main() {\n";
+
+    while (src.size() < targetBytes) {
+        switch (mix) {
+        case MIX_IDENT:
+            src += "    " + var() + " = " + var() + " + " + var() + " * " + var() + ";\n";
+            if (pick(4) == 0) src += "    scanf(" + var() + ", " + var() + ");\n";
+            break;
+        case MIX_LITERAL:
+            if (pick(2)) {
+                src += "    printf(\"literal text number " + to_string(rng() % 100000) + " for the scanner\", "
+                     + to_string(rng() % 1000000) + ");\n";
+            } else {
+                src += "    " + var() + " = " + to_string(rng() % 1000000) + " + '" + (char)('a' + pick(26))
+                     + "' * " + to_string(rng() % 100000) + ";\n";
+            }
+            break;
+        case MIX_OPERATOR:
+            // 关系运算符只出现在条件里；正负号只写在表达式开头或整数常量前面 (<整数> ::= [+|-]<无符号整数>)
+            src += "    if ((" + var() + " + " + var() + ") * (" + var() + " - " + var() + ") <= " + var() + " / (" + var() + " + 1)) "
+                 + var() + " = -(" + var() + " - " + var() + ") * +" + to_string(pick(100)) + " + " + var() + ";\n";
+            src += "    while (" + var() + " != " + var() + ") { table[" + var() + " - " + var() + "] = " + var() + " * -"
+                 + to_string(pick(100)) + "; if (" + var() + " >= " + var() + ") " + var() + " = +" + var() + "; }\n";
+            break;
+        }
+    }
+    src += "}\n";
+    return src;
+}
+
+// ==========================================
+// 3. 各个词法分析实现
+// ==========================================
+
+// 每个实现对整个 src 做一遍词法分析，返回识别出的单词数
+struct Lexer {
+    const char* name;
+    size_t (*run)(string& src);
+};
+
+// 实验三的流式词法分析：逐个返回 Token (单词值指向输入缓冲区，不分配内存)
+size_t runLab3Stream(string& src) {
+    lab3::srcBuf.swap(src);
+    lab3::srcPos = 0;
+    size_t count = 0;
+    while (lab3::getNextTokenFromFile().kind != lab3::TK_EOF) count++;
+    lab3::srcBuf.swap(src);
+    return count;
+}
+
+// 实验二的按位置扫描：只记录位置和类别，不构造字符串
+size_t runLab2Scan(string& src) {
+    lab2::LexToken tk;
+    size_t pos = 0, count = 0;
+    while (lab2::scanToken(src, pos, tk)) {
+        pos = tk.offset + tk.length;
+        count++;
+    }
+    return count;
+}
+
+// 实验二的完整输出：扫描并生成 "类别码 单词值" 文本
+size_t runLab2Render(string& src) {
+    lab2::srcBuf.swap(src);
+    lab2::outFile.data.clear();
+    lab2::analyze();
+    lab2::srcBuf.swap(src);
+    return (size_t)count(lab2::outFile.data.begin(), lab2::outFile.data.end(), '\n');
+}
+
+// 实验二的二进制单词流输出 (--binary)
+size_t runLab2Binary(string& src) {
+    lab2::srcBuf.swap(src);
+    lab2::outFile.data.clear();
+    lab2::resetSymbols();
+    string err;
+    lab2::analyzeBinary(err);
+    lab2::srcBuf.swap(src);
+    return lab2::tokenRecords.size();
+}
+
+// 增量词法分析器的初始全量分析 (建立间隙缓冲区)
+size_t runLab2Incremental(string& src) {
+    lab2::IncrementalLexer lexer;
+    lexer.reset(src);
+    return lexer.tokenCount();
+}
+
+const Lexer lexers[] = {
+    {"lab3-stream", runLab3Stream},
+    {"lab2-scan", runLab2Scan},
+    {"lab2-render", runLab2Render},
+    {"lab2-binary", runLab2Binary},
+    {"lab2-incremental", runLab2Incremental},
+};
+
+// ==========================================
+// 4. 语法分析器
+// ==========================================
+
+struct Parser {
+    const char* name;
+    bool table; // 实验三的 --table
+};
+
+const Parser parsers[] = {
+    {"lab3-recursive", false},
+    {"lab3-table", true},
+};
+
+// 预热后再分析一遍同一输入时允许的堆分配次数 (与输入大小无关的常数)
+const uint64_t WARM_ALLOC_LIMIT = 16;
+
+// 分析的结果规模：单词数、语法成分数 (输出里的 <...> 行) 和输出总行数
+struct ParseCounts {
+    size_t tokens, tagLines, lines;
+};
+
+// 实验三的完整语法分析：像 loadSource 那样重置分析器状态，分析 src 并生成输出文本
+bool runLab3Parser(const Parser& parser, string& src, ParseCounts& counts, string& err) {
+    lab3::srcBuf.swap(src);
+    lab3::resetParser();
+    lab3::outFile.data.clear();
+    lab3::initParser();
+    if (parser.table) lab3::parseProgramByTable();
+    else lab3::parseProgram();
+    bool ok = lab3::checkEndOfInput(err);
+    lab3::emitAst(lab3::astStack.back(), lab3::outFile);
+    lab3::srcBuf.swap(src);
+    counts.tokens = lab3::astTokens.size();
+    counts.tagLines = lab3::astNodes.size();
+    counts.lines = (size_t)count(lab3::outFile.data.begin(), lab3::outFile.data.end(), '\n');
+    return ok;
+}
+
+// 生成的测试程序必须符合文法：交给实验三的表驱动分析器 (查不到候选式、<程序> 之后还有单词时报错)，
+// 再编译成字节码 (手写和表驱动的分析器都不核对终结符，选错候选式的地方在编译时才暴露出来，如把变量当成函数调用)
+bool checkCorpus(string& src, string& err) {
+    ParseCounts counts{};
+    if (!runLab3Parser(parsers[1], src, counts, err)) return false;
+    lab3::Bytecode bc;
+    lab3::srcBuf.swap(src);
+    bool ok = lab3::BytecodeCompiler().compile(lab3::astStack.back(), bc, err);
+    lab3::srcBuf.swap(src);
+    return ok;
+}
+
+// 释放分析器留下的缓冲区，下一个大小的峰值内存不含这一次的
+void releaseLab3Buffers() {
+    vector<lab3::AstNode>().swap(lab3::astNodes);
+    vector<uint32_t>().swap(lab3::astChildren);
+    vector<lab3::Token>().swap(lab3::astTokens);
+    vector<uint32_t>().swap(lab3::astStack);
+    string().swap(lab3::outFile.data);
+    string().swap(lab3::srcBuf);
+}
+
+// 不合文法的输入：两个分析器都必须正常结束，表驱动分析器还必须报错
+// (查不到候选式时它曾经在 {<语句>} 的辅助规则上对同一个单词无限展开，直到内存耗尽)
+const char* const malformedPrograms[] = {
+    "void main(){ a = b ! c; x = 1 @ 2; }\n",
+    "void main(){ a = b c; }\n",
+    "int f(int x){ x = x y; return (x); }\nvoid main(){ f(1); }\n",
+    "void main(){ if (a) ; else }\n",
+};
+
+bool checkMalformedPrograms() {
+    bool ok = true;
+    for (const char* text : malformedPrograms) {
+        string src = text, err;
+        ParseCounts counts{};
+        runLab3Parser(parsers[0], src, counts, err);
+        if (runLab3Parser(parsers[1], src, counts, err)) {
+            cerr << "lab3-table accepted malformed input: " << text;
+            ok = false;
+        }
+    }
+    releaseLab3Buffers();
+    return ok;
+}
+
+// 合法但形状极端的输入：两个分析器都必须接受，输出逐字节相同。
+// 深层嵌套的 if：最后的 } 上每一层都不读单词地展开一次 [ ELSETK <语句> ]，表驱动分析器不能当成循环展开
+vector<string> edgePrograms() {
+    string nestedIf = "void main(){ int a; ";
+    for (int i = 0; i < 10000; i++) nestedIf += "if(a) ";
+    nestedIf += "a=1; }\n";
+    return {nestedIf};
+}
+
+bool checkEdgePrograms() {
+    bool ok = true;
+    for (string& src : edgePrograms()) {
+        string err, expected;
+        ParseCounts counts{};
+        if (!runLab3Parser(parsers[0], src, counts, err)) {
+            cerr << parsers[0].name << " rejected valid input: " << err << endl;
+            ok = false;
+        }
+        expected.swap(lab3::outFile.data);
+        if (!runLab3Parser(parsers[1], src, counts, err)) {
+            cerr << parsers[1].name << " rejected valid input: " << err << endl;
+            ok = false;
+        } else if (lab3::outFile.data != expected) {
+            cerr << parsers[1].name << " output differs from " << parsers[0].name << " on valid input" << endl;
+            ok = false;
+        }
+    }
+    releaseLab3Buffers();
+    return ok;
+}
+
+int runParserBenchmark(const vector<string>& sizeArgs, progen::GenOptions opt) {
+    int status = checkMalformedPrograms() && checkEdgePrograms() ? 0 : 1;
+    cout << "{\n  \"benchmark\": \"parser\",\n  \"results\": [";
+    bool firstRow = true;
+    for (const string& sizeArg : sizeArgs) {
+        opt.size = progen::parseByteSize(sizeArg);
+        progen::ProgramGenerator gen(opt);
+        gen.generate();
+        string src = move(gen.text);
+        size_t expected = 0;
+        for (const Parser& parser : parsers) {
+            // 和词法分析一样：小输入重复多次直到累计 0.2 秒，取单次最短时间
+            double best = 1e300, total = 0;
+            ParseCounts counts{};
+            long peak = 0;
+            for (int rep = 0; rep == 0 || (total < 0.2 && rep < 1000); rep++) {
+                releaseLab3Buffers();
+                resetPeakRss();
+                string err;
+                auto start = chrono::steady_clock::now();
+                bool ok = runLab3Parser(parser, src, counts, err);
+                double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                peak = max(peak, peakRssKb());
+                best = min(best, seconds);
+                total += seconds;
+                if (!ok) {
+                    cerr << parser.name << " " << sizeArg << ": " << err << endl;
+                    status = 1;
+                    break;
+                }
+            }
+            // 预热：缓冲区保留着上一次的容量时再分析一遍，数这一遍的堆分配次数。
+            // 单词不持有字符串，这一遍只剩与输入大小无关的几次分配，超过上限说明热路径上又有了逐单词的分配
+            uint64_t allocBefore = allocCount.load();
+            string err;
+            runLab3Parser(parser, src, counts, err);
+            uint64_t warmAllocs = allocCount.load() - allocBefore;
+            if (warmAllocs > WARM_ALLOC_LIMIT) {
+                cerr << parser.name << " " << sizeArg << ": " << warmAllocs << " allocations after warm-up (limit "
+                     << WARM_ALLOC_LIMIT << ")" << endl;
+                status = 1;
+            }
+            // 两个分析器的输出规模必须一致
+            if (expected == 0) expected = counts.lines;
+            if (counts.lines != expected) {
+                cerr << "Output line mismatch: " << parser.name << " " << counts.lines << " vs " << expected << endl;
+                status = 1;
+            }
+            char row[512];
+            snprintf(row, sizeof(row),
+                     "%s\n    {\"parser\": \"%s\", \"bytes\": %zu, \"tokens\": %zu, \"tag_lines\": %zu, "
+                     "\"output_lines\": %zu, \"seconds\": %.6f, \"tokens_per_s\": %.0f, \"tag_lines_per_s\": %.0f, "
+                     "\"ns_per_token\": %.2f, \"warm_allocs\": %llu, \"warm_allocs_per_token\": %.6f, "
+                     "\"peak_rss_kb\": %ld}",
+                     firstRow ? "" : ",", parser.name, src.size(), counts.tokens, counts.tagLines,
+                     counts.lines, best, counts.tokens / best, counts.tagLines / best,
+                     counts.tokens ? best * 1e9 / counts.tokens : 0.0, (unsigned long long)warmAllocs,
+                     counts.tokens ? (double)warmAllocs / counts.tokens : 0.0, peak);
+            cout << row << flush;
+            firstRow = false;
+        }
+    }
+    releaseLab3Buffers();
+    cout << "\n  ]\n}" << endl;
+    return status;
+}
+
+// ==========================================
+// 5. 增量词法分析的编辑
+// ==========================================
+
+// 编辑时插入的片段。打字类的片段不含引号：插入一个引号会让它之后到下一个引号为止的内容
+// 全部变成字符串，必须重新分析到那里，这部分代价与文件内容有关，另外单独校验
+const char* const typingSnippets[] = {"", "a", "x1", " ", "\n", "+", "42", "int k;", ";", "(", ")", "while", "<="};
+const char* const quoteSnippets[] = {"\"", "'", "\"s\"", "'c'"};
+
+// 对照：增量结果必须与对当前全文重新分析一遍的结果完全相同
+bool sameAsFreshLex(const lab2::IncrementalLexer& lexer, const string& text, string& err) {
+    if (lexer.content() != text) {
+        err = "text differs";
+        return false;
+    }
+    lab2::LexToken tk;
+    size_t pos = 0, i = 0;
+    while (lab2::scanToken(text, pos, tk)) {
+        if (i >= lexer.tokenCount()) {
+            err = "missing token " + to_string(i);
+            return false;
+        }
+        lab2::LexToken got = lexer.token(i);
+        if (got.offset != tk.offset || got.length != tk.length || got.kind != tk.kind || got.sym != tk.sym) {
+            err = "token " + to_string(i) + " differs";
+            return false;
+        }
+        pos = tk.offset + tk.length;
+        i++;
+    }
+    if (i != lexer.tokenCount()) {
+        err = "extra tokens after " + to_string(i);
+        return false;
+    }
+    return true;
+}
+
+// 在随机位置 (与上一次编辑的距离也随机) 反复做小编辑，给出每次 applyEdit 的耗时分布；
+// 每隔一段和最后都与全文重新分析的结果对照。之后再做一轮含引号的编辑，只校验结果
+int runEditBenchmark(const vector<string>& sizeArgs, progen::GenOptions opt, size_t editCount) {
+    cout << "{\n  \"benchmark\": \"edits\",\n  \"results\": [";
+    bool firstRow = true;
+    int status = 0;
+    for (const string& sizeArg : sizeArgs) {
+        opt.size = progen::parseByteSize(sizeArg);
+        progen::ProgramGenerator gen(opt);
+        gen.generate();
+        string text = move(gen.text);
+        size_t lines = (size_t)count(text.begin(), text.end(), '\n');
+        lab2::IncrementalLexer lexer;
+        lexer.reset(text);
+        mt19937 rng(opt.seed);
+        string err;
+        bool ok = true;
+
+        // quotes 为 false 时删除的范围也不含引号 (删掉一个引号与插入一个引号的效果一样)
+        auto edit = [&](const char* snippet, bool quotes) {
+            size_t offset = rng() % (text.size() + 1);
+            size_t deleteLen = min<size_t>(rng() % 4, text.size() - offset);
+            while (!quotes && deleteLen > 0 && text.find_first_of("\"'", offset) < offset + deleteLen) deleteLen--;
+            string insert = snippet;
+            auto start = chrono::steady_clock::now();
+            lexer.applyEdit(offset, deleteLen, insert);
+            double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+            text.replace(offset, deleteLen, insert);
+            return us;
+        };
+
+        vector<double> times;
+        for (size_t e = 0; e < editCount && ok; e++) {
+            times.push_back(edit(typingSnippets[rng() % size(typingSnippets)], false));
+            if ((e + 1) % 1000 == 0 || e + 1 == editCount) ok = sameAsFreshLex(lexer, text, err);
+        }
+        for (size_t e = 0; e < 200 && ok; e++) {
+            edit(rng() % 4 == 0 ? quoteSnippets[rng() % size(quoteSnippets)] : typingSnippets[rng() % size(typingSnippets)], true);
+            if ((e + 1) % 20 == 0) ok = sameAsFreshLex(lexer, text, err);
+        }
+        if (!ok) {
+            cerr << "Incremental result mismatch at " << sizeArg << ": " << err << endl;
+            status = 1;
+        }
+
+        sort(times.begin(), times.end());
+        double total = 0;
+        for (double t : times) total += t;
+        auto pct = [&](double p) { return times.empty() ? 0.0 : times[min(times.size() - 1, (size_t)(p * times.size()))]; };
+        char row[512];
+        snprintf(row, sizeof(row),
+                 "%s\n    {\"lexer\": \"lab2-incremental\", \"bytes\": %zu, \"lines\": %zu, \"tokens\": %zu, "
+                 "\"edits\": %zu, \"mean_us\": %.2f, \"p50_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f, \"matches_fresh_lex\": %s}",
+                 firstRow ? "" : ",", text.size(), lines, lexer.tokenCount(), times.size(),
+                 times.empty() ? 0.0 : total / times.size(), pct(0.5), pct(0.99), times.empty() ? 0.0 : times.back(),
+                 ok ? "true" : "false");
+        cout << row << flush;
+        firstRow = false;
+    }
+    cout << "\n  ]\n}" << endl;
+    return status;
+}
+
+// ==========================================
+// 6. 主程序
+// ==========================================
+
+vector<string> splitList(const string& s) {
+    vector<string> items;
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+int main(int argc, char* argv[]) {
+    vector<string> sizeArgs = {"1K", "64K", "1M", "16M"};
+    vector<string> mixArgs = {"ident", "literal", "operator"};
+    uint32_t seed = 1;
+    bool parserMode = false, editMode = false;
+    size_t editCount = 10000;
+    progen::GenOptions genOpt;
+    auto usage = [&]() {
+        cerr << "Usage: " << argv[0] << " [--sizes 1K,64K,1M,16M,...,1G] [--mix ident,literal,operator] [--seed N]\n"
+             << "       " << argv[0] << " --parser [--sizes 1K,64K,1M,16M,...,1G] [--seed N]"
+             << " [--functions N] [--depth D] [--expr E] [--decls K]\n"
+             << "       " << argv[0] << " --edits [N] [--sizes 1M,4M] [--seed N]" << endl;
+        return 1;
+    };
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--sizes" && i + 1 < argc) sizeArgs = splitList(argv[++i]);
+        else if (arg == "--mix" && i + 1 < argc) mixArgs = splitList(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc) seed = (uint32_t)stoul(argv[++i]);
+        else if (arg == "--parser") parserMode = true;
+        else if (arg == "--edits") {
+            editMode = true;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) editCount = (size_t)stoull(argv[++i]);
+        }
+        else if (arg != "--size" && progen::parseGenOption(argc, argv, i, genOpt)) continue;
+        else return usage();
+    }
+    // 单词位置是 32 位的，两个实验都不接受 4 GiB 及以上的输入 (见 批处理与服务.h 的 MAX_INPUT_BYTES)
+    for (const string& sizeArg : sizeArgs) {
+        uint64_t size = progen::parseByteSize(sizeArg);
+        if (size == 0) return usage();
+        if (size >= lab2::MAX_INPUT_BYTES) {
+            cerr << "Size " << sizeArg << " is not below the 4 GiB input limit" << endl;
+            return 1;
+        }
+    }
+    if (parserMode) {
+        genOpt.seed = seed;
+        return runParserBenchmark(sizeArgs, genOpt);
+    }
+    if (editMode) {
+        genOpt.seed = seed;
+        return runEditBenchmark(sizeArgs, genOpt, editCount);
+    }
+
+    cout << "{\n  \"benchmark\": \"lexer\",\n  \"results\": [";
+    bool firstRow = true;
+    int status = 0;
+    for (const string& mixArg : mixArgs) {
+        int mix = (int)(find(begin(mixNames), end(mixNames), mixArg) - begin(mixNames));
+        if (mix == 3) {
+            cerr << "Unknown mix: " << mixArg << endl;
+            return 1;
+        }
+        for (const string& sizeArg : sizeArgs) {
+            string src = generateCorpus((Mix)mix, progen::parseByteSize(sizeArg), seed);
+            string err;
+            if (!checkCorpus(src, err)) {
+                cerr << "Corpus " << mixArg << " " << sizeArg << " is not a valid program: " << err << endl;
+                status = 1;
+            }
+            releaseLab3Buffers();
+            size_t expected = 0;
+            for (const Lexer& lexer : lexers) {
+                // 小输入重复多次直到累计 0.2 秒，取单次最短时间
+                double best = 1e300, total = 0;
+                size_t tokens = 0;
+                uint64_t allocs = 0;
+                long peak = 0;
+                for (int rep = 0; rep == 0 || (total < 0.2 && rep < 1000); rep++) {
+                    resetPeakRss();
+                    uint64_t allocBefore = allocCount.load();
+                    auto start = chrono::steady_clock::now();
+                    tokens = lexer.run(src);
+                    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                    allocs = allocCount.load() - allocBefore;
+                    peak = max(peak, peakRssKb());
+                    best = min(best, seconds);
+                    total += seconds;
+                }
+                // 所有实现识别出的单词数必须一致
+                if (expected == 0) expected = tokens;
+                if (tokens != expected) {
+                    cerr << "Token count mismatch: " << lexer.name << " " << tokens << " vs " << expected << endl;
+                    status = 1;
+                }
+                char row[512];
+                snprintf(row, sizeof(row),
+                         "%s\n    {\"lexer\": \"%s\", \"mix\": \"%s\", \"bytes\": %zu, \"tokens\": %zu, "
+                         "\"seconds\": %.6f, \"mb_per_s\": %.1f, \"tokens_per_s\": %.0f, "
+                         "\"allocs_per_token\": %.3f, \"peak_rss_kb\": %ld}",
+                         firstRow ? "" : ",", lexer.name, mixNames[mix], src.size(), tokens,
+                         best, src.size() / best / 1e6, tokens / best,
+                         tokens ? (double)allocs / tokens : 0.0, peak);
+                cout << row << flush;
+                firstRow = false;
+            }
+        }
+    }
+    cout << "\n  ]\n}" << endl;
+    return status;
+}
@@ -160,10 +160,387 @@ void add_terminal(char c) {
 }
 
 // ==========================================
-// 主函数
+// 多模式 DFA (-m 规则文件)
 // ==========================================
 
-int main() {
+// 规则文件里每个规则是一个 NFA，格式与标准输入相同 (X 为开始状态，Y 为接受状态)，规则之间用空行分隔。
+// 第 k 个规则 (从 0 数起) 的接受状态带标签 k。新建一个开始状态，经空串连到各个规则的 X，
+// 把所有规则并成一个 NFA 再确定化；每个 DFA 状态带一个接受标签集合 (它包含的各个 NFA 接受状态的标签)。
+// 扫描输入时按最左最长匹配，同样长的匹配里标签小 (规则文件中靠前) 的优先，一遍就能知道哪些规则匹配。
+// 规则可能有成千上万个，这里不用上面的定长数组和按名字比较，状态一律用整数编号，数组按需扩大
+
+void *xrealloc(void *p, size_t size) {
+    p = realloc(p, size ? size : 1);
+    if (!p) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+void *xcalloc(size_t count, size_t size) {
+    void *p = calloc(count ? count : 1, size);
+    if (!p) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+// 可变长的整数数组
+typedef struct {
+    int *items;
+    int count;
+    int cap;
+} IntList;
+
+void push_int(IntList *list, int value) {
+    if (list->count == list->cap) {
+        list->cap = list->cap ? list->cap * 2 : 16;
+        list->items = xrealloc(list->items, (size_t)list->cap * sizeof(int));
+    }
+    list->items[list->count++] = value;
+}
+
+int cmp_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// FNV-1a
+unsigned hash_bytes(const void *data, size_t len, unsigned h) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+// --- 并起来的 NFA ---
+
+// 状态名 -> 编号 (同一个名字在不同规则里是不同的状态)，开放定址哈希表
+typedef struct {
+    int rule;
+    char *name;
+    int id;
+} NameSlot;
+
+NameSlot *name_slots = NULL;
+int name_slot_cap = 0;
+int m_state_count = 1; // 0 号是新建的开始状态
+
+IntList accept_tag;                  // 每个 NFA 状态的标签，不是接受状态时为 -1
+IntList edge_src, edge_char, edge_dst; // 所有转换规则，edge_char 为 -1 表示空串
+int *edge_first = NULL;              // 按起点排好后，状态 s 的转换是 [edge_first[s], edge_first[s + 1])
+int *edge_order = NULL;              // 排好序的转换下标
+int class_of[256];                   // 字符 -> 字符类 (DFA 表的列)，-1 表示没有在规则中出现
+int class_count = 0;
+int rule_count = 0;
+
+int state_id(int rule, const char *name) {
+    if ((m_state_count + 1) * 2 > name_slot_cap) {
+        // 扩大哈希表并重新插入
+        int old_cap = name_slot_cap;
+        NameSlot *old = name_slots;
+        name_slot_cap = old_cap ? old_cap * 2 : 1024;
+        name_slots = xcalloc((size_t)name_slot_cap, sizeof(NameSlot));
+        for (int i = 0; i < old_cap; i++) {
+            if (!old[i].name) continue;
+            unsigned h = hash_bytes(old[i].name, strlen(old[i].name), hash_bytes(&old[i].rule, sizeof(int), 2166136261u));
+            int j = (int)(h & (unsigned)(name_slot_cap - 1));
+            while (name_slots[j].name) j = (j + 1) & (name_slot_cap - 1);
+            name_slots[j] = old[i];
+        }
+        free(old);
+    }
+    unsigned h = hash_bytes(name, strlen(name), hash_bytes(&rule, sizeof(int), 2166136261u));
+    int j = (int)(h & (unsigned)(name_slot_cap - 1));
+    for (; name_slots[j].name; j = (j + 1) & (name_slot_cap - 1)) {
+        if (name_slots[j].rule == rule && strcmp(name_slots[j].name, name) == 0) return name_slots[j].id;
+    }
+    size_t len = strlen(name);
+    name_slots[j].rule = rule;
+    name_slots[j].name = xrealloc(NULL, len + 1);
+    memcpy(name_slots[j].name, name, len + 1);
+    name_slots[j].id = m_state_count++;
+    // 新状态：Y 是这个规则的接受状态，X 从总的开始状态经空串可达
+    push_int(&accept_tag, strcmp(name, "Y") == 0 ? rule : -1);
+    if (strcmp(name, "X") == 0) {
+        push_int(&edge_src, 0);
+        push_int(&edge_char, -1);
+        push_int(&edge_dst, name_slots[j].id);
+    }
+    return name_slots[j].id;
+}
+
+// 读一整行 (不限长度)，去掉行尾的换行符；读到文件末尾返回 NULL
+char *read_line(FILE *f, char **buf, size_t *cap) {
+    size_t len = 0;
+    if (*cap == 0) {
+        *cap = 256;
+        *buf = xrealloc(NULL, *cap);
+    }
+    while (fgets(*buf + len, (int)(*cap - len), f)) {
+        len += strlen(*buf + len);
+        if (len > 0 && (*buf)[len - 1] == '\n') {
+            (*buf)[--len] = 0;
+            return *buf;
+        }
+        *cap *= 2;
+        *buf = xrealloc(*buf, *cap);
+    }
+    return len > 0 ? *buf : NULL;
+}
+
+// 读入规则文件，解析方法与单个 NFA 时相同
+int load_rules(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Error: Cannot open %s\n", path);
+        return 0;
+    }
+    push_int(&accept_tag, -1); // 0 号开始状态
+    for (int c = 0; c < 256; c++) class_of[c] = -1;
+    int seen[256] = {0};
+    char *line = NULL;
+    size_t cap = 0;
+    int in_rule = 0;
+    while (read_line(f, &line, &cap)) {
+        line[strcspn(line, "\r")] = 0;
+        char *token = strtok(line, " ");
+        if (!token) {
+            // 空行结束当前规则
+            if (in_rule) rule_count++;
+            in_rule = 0;
+            continue;
+        }
+        in_rule = 1;
+        int src = state_id(rule_count, token);
+        while ((token = strtok(NULL, " ")) != NULL) {
+            char *arrow = strstr(token, "->");
+            if (!arrow) continue;
+            *arrow = '\0';
+            char *dash = strrchr(token, '-');
+            if (!dash) continue;
+            unsigned char c = (unsigned char)dash[1];
+            int dst = state_id(rule_count, arrow + 2);
+            push_int(&edge_src, src);
+            push_int(&edge_char, c == '~' ? -1 : c);
+            push_int(&edge_dst, dst);
+            if (c != '~') seen[c] = 1;
+        }
+    }
+    if (in_rule) rule_count++;
+    free(line);
+    fclose(f);
+
+    // 字符类按字符从小到大编号 (与单个 NFA 时终结符排序一致)
+    for (int c = 0; c < 256; c++) {
+        if (seen[c]) class_of[c] = class_count++;
+    }
+    // 转换按起点排序 (计数排序)
+    edge_first = xcalloc((size_t)m_state_count + 1, sizeof(int));
+    edge_order = xrealloc(NULL, (size_t)edge_src.count * sizeof(int));
+    for (int e = 0; e < edge_src.count; e++) edge_first[edge_src.items[e] + 1]++;
+    for (int s = 0; s < m_state_count; s++) edge_first[s + 1] += edge_first[s];
+    int *fill = xrealloc(NULL, (size_t)m_state_count * sizeof(int));
+    memcpy(fill, edge_first, (size_t)m_state_count * sizeof(int));
+    for (int e = 0; e < edge_src.count; e++) edge_order[fill[edge_src.items[e]]++] = e;
+    free(fill);
+    return 1;
+}
+
+// --- 确定化 ---
+
+IntList set_items;             // 所有 DFA 状态的 NFA 状态集合，首尾相接存放
+IntList set_start;             // DFA 状态 d 的集合是 set_items[set_start[d] .. set_start[d + 1])
+IntList tag_items, tag_start;  // 同样方式存放各 DFA 状态的接受标签集合 (从小到大)
+int *dfa_trans = NULL;         // dfa_trans[d * class_count + c]，-1 表示死状态
+int dfa_count = 0;
+int dfa_cap = 0;
+int *set_slots = NULL;         // 集合 -> DFA 状态的哈希表，槽里存 编号 + 1
+int set_slot_cap = 0;
+
+int *closure_mark = NULL;      // 求闭包时的访问标记 (用递增的 stamp 代替每次清零)
+int closure_stamp = 0;
+
+unsigned hash_set(const int *items, int count) {
+    return hash_bytes(items, (size_t)count * sizeof(int), 2166136261u);
+}
+
+// 把 states 原地扩充为它的空串闭包并排序
+void closure_of(IntList *states) {
+    closure_stamp++;
+    for (int i = 0; i < states->count; i++) closure_mark[states->items[i]] = closure_stamp;
+    for (int i = 0; i < states->count; i++) {
+        int s = states->items[i];
+        for (int k = edge_first[s]; k < edge_first[s + 1]; k++) {
+            int e = edge_order[k];
+            int d = edge_dst.items[e];
+            if (edge_char.items[e] == -1 && closure_mark[d] != closure_stamp) {
+                closure_mark[d] = closure_stamp;
+                push_int(states, d);
+            }
+        }
+    }
+    qsort(states->items, (size_t)states->count, sizeof(int), cmp_int);
+}
+
+// 找到集合对应的 DFA 状态，没有时新建一个 (同时求出它的接受标签集合)
+int dfa_state_of(const IntList *states) {
+    if ((dfa_count + 1) * 2 > set_slot_cap) {
+        set_slot_cap = set_slot_cap ? set_slot_cap * 2 : 1024;
+        free(set_slots);
+        set_slots = xcalloc((size_t)set_slot_cap, sizeof(int));
+        for (int d = 0; d < dfa_count; d++) {
+            int start = set_start.items[d], count = set_start.items[d + 1] - start;
+            int j = (int)(hash_set(set_items.items + start, count) & (unsigned)(set_slot_cap - 1));
+            while (set_slots[j]) j = (j + 1) & (set_slot_cap - 1);
+            set_slots[j] = d + 1;
+        }
+    }
+    int j = (int)(hash_set(states->items, states->count) & (unsigned)(set_slot_cap - 1));
+    for (; set_slots[j]; j = (j + 1) & (set_slot_cap - 1)) {
+        int d = set_slots[j] - 1;
+        int start = set_start.items[d], count = set_start.items[d + 1] - start;
+        if (count == states->count && memcmp(set_items.items + start, states->items, (size_t)count * sizeof(int)) == 0) return d;
+    }
+    int d = dfa_count++;
+    set_slots[j] = d + 1;
+    for (int i = 0; i < states->count; i++) {
+        push_int(&set_items, states->items[i]);
+        int tag = accept_tag.items[states->items[i]];
+        if (tag >= 0) push_int(&tag_items, tag);
+    }
+    push_int(&set_start, set_items.count);
+    // 每个规则只有一个接受状态，标签不会重复，排序即可
+    int tag_begin = tag_start.items[d];
+    qsort(tag_items.items + tag_begin, (size_t)(tag_items.count - tag_begin), sizeof(int), cmp_int);
+    push_int(&tag_start, tag_items.count);
+    if (dfa_count > dfa_cap) {
+        dfa_cap = dfa_cap ? dfa_cap * 2 : 64;
+        dfa_trans = xrealloc(dfa_trans, (size_t)dfa_cap * (size_t)class_count * sizeof(int));
+    }
+    for (int c = 0; c < class_count; c++) dfa_trans[(size_t)d * class_count + c] = -1;
+    return d;
+}
+
+// 子集构造：与单个 NFA 时相同，逐个处理新出现的状态集合；一个状态的各个字符类一次求出
+void build_union_dfa(void) {
+    closure_mark = xcalloc((size_t)m_state_count, sizeof(int));
+    push_int(&set_start, 0);
+    push_int(&tag_start, 0);
+    IntList start = {0};
+    push_int(&start, 0);
+    closure_of(&start);
+    dfa_state_of(&start);
+    free(start.items);
+
+    IntList *moved = xcalloc((size_t)class_count, sizeof(IntList));
+    IntList touched = {0};
+    for (int d = 0; d < dfa_count; d++) {
+        touched.count = 0;
+        for (int i = set_start.items[d]; i < set_start.items[d + 1]; i++) {
+            int s = set_items.items[i];
+            for (int k = edge_first[s]; k < edge_first[s + 1]; k++) {
+                int e = edge_order[k];
+                if (edge_char.items[e] == -1) continue;
+                int c = class_of[edge_char.items[e]];
+                if (moved[c].count == 0) push_int(&touched, c);
+                push_int(&moved[c], edge_dst.items[e]);
+            }
+        }
+        for (int t = 0; t < touched.count; t++) {
+            int c = touched.items[t];
+            // 去掉重复的目标状态再求闭包
+            closure_stamp++;
+            int n = 0;
+            for (int i = 0; i < moved[c].count; i++) {
+                int s = moved[c].items[i];
+                if (closure_mark[s] != closure_stamp) {
+                    closure_mark[s] = closure_stamp;
+                    moved[c].items[n++] = s;
+                }
+            }
+            moved[c].count = n;
+            closure_of(&moved[c]);
+            int next = dfa_state_of(&moved[c]);
+            dfa_trans[(size_t)d * class_count + c] = next;
+            moved[c].count = 0;
+        }
+    }
+    for (int c = 0; c < class_count; c++) free(moved[c].items);
+    free(moved);
+    free(touched.items);
+}
+
+// --- 输出 ---
+
+void print_tags(int d) {
+    for (int i = tag_start.items[d]; i < tag_start.items[d + 1]; i++) {
+        printf("%s%d", i > tag_start.items[d] ? "," : "", tag_items.items[i]);
+    }
+}
+
+// -t：列出并起来的 DFA，格式与单个 NFA 时相近：状态名 [接受标签] 状态名-字符->状态名 ...
+void print_union_dfa(void) {
+    for (int d = 0; d < dfa_count; d++) {
+        printf("D%d", d);
+        if (tag_start.items[d] < tag_start.items[d + 1]) {
+            printf(" [");
+            print_tags(d);
+            printf("]");
+        }
+        for (int c = 0; c < 256; c++) {
+            if (class_of[c] < 0) continue;
+            int next = dfa_trans[(size_t)d * class_count + class_of[c]];
+            if (next >= 0) printf(" D%d-%c->D%d", d, c, next);
+        }
+        printf("\n");
+    }
+}
+
+// 扫描标准输入的每一行：从当前位置开始沿 DFA 走到不能再走，取最后经过的接受状态 (最长匹配)；
+// 匹配到时输出 "行:列 匹配文本 标签,..." (第一个标签是优先的规则)，从匹配的末尾继续，否则右移一个字符。
+// 空串匹配不输出
+void scan_input(void) {
+    char *line = NULL;
+    size_t cap = 0;
+    long line_no = 0;
+    while (read_line(stdin, &line, &cap)) {
+        line_no++;
+        size_t len = strlen(line);
+        size_t pos = 0;
+        while (pos < len) {
+            int state = 0, last_state = -1;
+            size_t last_end = pos;
+            for (size_t i = pos; i < len; i++) {
+                int c = class_of[(unsigned char)line[i]];
+                if (c < 0) break;
+                state = dfa_trans[(size_t)state * class_count + c];
+                if (state < 0) break;
+                if (tag_start.items[state] < tag_start.items[state + 1]) {
+                    last_state = state;
+                    last_end = i + 1;
+                }
+            }
+            if (last_state < 0) {
+                pos++;
+                continue;
+            }
+            printf("%ld:%zu %.*s ", line_no, pos + 1, (int)(last_end - pos), line + pos);
+            print_tags(last_state);
+            printf("\n");
+            pos = last_end;
+        }
+    }
+    free(line);
+}
+
+// ==========================================
+// 单个 NFA 的确定化
+// ==========================================
+
+// 从标准输入读入以 X 为开始、Y 为接受状态的 NFA，输出确定化后的 DFA
+int convert_single_nfa(void) {
 
     char line[MAX_LINE_LEN];
     char start_node[] = "X";
@@ -354,4 +731,24 @@ int main() {
     for(int i=0; i<num_cnt; i++) printf("%s\n", num_lines[i]);
 
     return 0;
-}
\ No newline at end of file
+}
+
+// ==========================================
+// 主函数
+// ==========================================
+
+// 用法: 实验一                      从标准输入读入一个 NFA，输出确定化后的 DFA
+//       实验一 -m <规则文件> [-t]   把规则文件中的各个 NFA 并成一个 DFA，扫描标准输入报告各规则的匹配；
+//                                   加 -t 只列出并起来的 DFA
+int main(int argc, char *argv[]) {
+    if (argc == 1) return convert_single_nfa();
+    if (argc >= 3 && strcmp(argv[1], "-m") == 0 && (argc == 3 || (argc == 4 && strcmp(argv[3], "-t") == 0))) {
+        if (!load_rules(argv[2])) return 1;
+        build_union_dfa();
+        if (argc == 4) print_union_dfa();
+        else scan_input();
+        return 0;
+    }
+    fprintf(stderr, "Usage: %s [-m rules [-t]]\n", argv[0]);
+    return 1;
+}
@@ -3,8 +3,29 @@
 #include <string>
 #include <vector>
 #include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <map>
 #include <set>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <chrono>
 
 using namespace std;
 
@@ -12,138 +33,711 @@ using namespace std;
 // 1. 词法分析与公共定义
 // ==========================================
 
+// 单词类别码 (顺序与 tokenNames 对应)
+enum TokenKind : uint8_t {
+    IDENFR, INTCON, CHARCON, STRCON,
+    CONSTTK, INTTK, CHARTK, VOIDTK, MAINTK, IFTK, ELSETK, DOTK, WHILETK,
+    FORTK, SCANFTK, PRINTFTK, RETURNTK,
+    PLUS, MINU, MULT, DIV, LSS, LEQ, GRE, GEQ, EQL, NEQ, ASSIGN,
+    SEMICN, COMMA, LPARENT, RPARENT, LBRACK, RBRACK, LBRACE, RBRACE,
+    TK_EOF, TK_NONE
+};
+
+const char* const tokenNames[] = {
+    "IDENFR", "INTCON", "CHARCON", "STRCON",
+    "CONSTTK", "INTTK", "CHARTK", "VOIDTK", "MAINTK", "IFTK", "ELSETK", "DOTK", "WHILETK",
+    "FORTK", "SCANFTK", "PRINTFTK", "RETURNTK",
+    "PLUS", "MINU", "MULT", "DIV", "LSS", "LEQ", "GRE", "GEQ", "EQL", "NEQ", "ASSIGN",
+    "SEMICN", "COMMA", "LPARENT", "RPARENT", "LBRACK", "RBRACK", "LBRACE", "RBRACE",
+    "EOF", ""
+};
+
 // 单词类别码映射
-map<string, string> keywords = {
-    {"const", "CONSTTK"}, {"int", "INTTK"}, {"char", "CHARTK"},
-    {"void", "VOIDTK"}, {"main", "MAINTK"}, {"if", "IFTK"},
-    {"else", "ELSETK"}, {"do", "DOTK"}, {"while", "WHILETK"},
-    {"for", "FORTK"}, {"scanf", "SCANFTK"}, {"printf", "PRINTFTK"},
-    {"return", "RETURNTK"}
+map<string, TokenKind> keywords = {
+    {"const", CONSTTK}, {"int", INTTK}, {"char", CHARTK},
+    {"void", VOIDTK}, {"main", MAINTK}, {"if", IFTK},
+    {"else", ELSETK}, {"do", DOTK}, {"while", WHILETK},
+    {"for", FORTK}, {"scanf", SCANFTK}, {"printf", PRINTFTK},
+    {"return", RETURNTK}
 };
 
+// 单词类别的集合：每个类别占一位。
+// "当前单词能否开始某个语法成分" 这类判断 (FIRST 集合) 都在编译期算成掩码，运行时只需一次按位与
+typedef uint64_t TokenSet;
+static_assert(TK_NONE < 64, "TokenSet 放不下所有单词类别");
+
+constexpr TokenSet tokenSet(initializer_list<TokenKind> kinds) {
+    TokenSet set = 0;
+    for (TokenKind k : kinds) set |= TokenSet(1) << k;
+    return set;
+}
+
+constexpr bool inSet(TokenSet set, TokenKind k) {
+    return (set >> k) & 1;
+}
+
+// 单词本身不持有字符串：单词值就是输入缓冲区里的一段 (见 tokenText)，
+// 整个结构只有 16 字节、可以按位复制，读单词、预读、移入语法树都不会分配内存
 struct Token {
-    string type;
-    string value;
-    int line; // 仅用于调试，本题不强求报错行号
+    TokenKind kind;
+    uint32_t offset; // 单词首字符在输入中的下标；行列号只在报错/调试时由 resolvePos 换算
+    uint32_t sym;    // 标识符/关键字的驻留编号
+    uint32_t len;    // 单词值的长度 (字符串、字符常量不含两边的引号)
+};
+
+// 标识符驻留表和输出缓冲 (与实验二共用)
+#include "驻留表与输出缓冲.h"
+
+// 全局变量 (thread_local：批处理模式下每个线程各有一份分析器状态，缓冲区在文件间复用)
+// 整个输入文件一次读进 srcBuf，词法分析按下标 srcPos 读取
+thread_local string srcBuf;
+thread_local size_t srcPos = 0;
+
+// 按函数并行分析时，工作线程不做词法分析，单词值从主线程的输入缓冲区里读 (只读)
+thread_local const string* sharedSource = nullptr;
+
+// 单词值：输入缓冲区里从 offset 开始的 len 个字符，字符串、字符常量跳过开头的引号
+string_view tokenText(const Token& tk) {
+    const string& src = sharedSource ? *sharedSource : srcBuf;
+    size_t quote = tk.kind == STRCON || tk.kind == CHARCON;
+    return string_view(src).substr(tk.offset + quote, tk.len);
+}
+
+// 字符常量的值：引号里的第一个字符，空的字符常量 ('') 取 '\0'
+int32_t charValue(const Token& tk) {
+    string_view text = tokenText(tk);
+    return text.empty() ? 0 : (unsigned char)text[0];
+}
+
+thread_local OutBuffer outFile;
+thread_local Token currentToken;
+// 用于预读的缓冲区：固定 4 个槽位的环形窗口 (语法分析最多预读 2 个单词)，
+// 单词被消费后槽位立即复用，内存占用与输入长度无关
+const size_t LOOKAHEAD_SLOTS = 4;
+thread_local Token lookahead[LOOKAHEAD_SLOTS];
+thread_local size_t lookaheadHead = 0;  // 最早读入的那个单词所在的槽位
+thread_local size_t lookaheadCount = 0; // 窗口里尚未消费的单词数
+
+// 语法分析剖析 (编译时加 -DPARSER_PROFILE 才有，运行时用 --profile <前缀> 输出)：
+// 每个语法成分在 beginNode/finishNode 处计时，统计调用次数、含子成分和不含子成分的时间、读入的单词数，
+// 以及各个预读深度的命中次数 (单词已在窗口里) 和预读窗口的最大占用。
+// 不定义 PARSER_PROFILE 时下面的几个宏都是空的，分析器里不留下任何代码
+#ifdef PARSER_PROFILE
+// 一个语法成分的一次分析；成分的类别要到 finishNode 才知道，所以先记下父成分，输出时再拼出调用路径
+struct ProfileEvent {
+    int32_t parent;         // 父成分的事件编号，-1 表示最外层
+    uint8_t kind;           // 语法成分 (NodeKind)，还没结束时是 PROFILE_OPEN
+    uint64_t inclusiveNs;
+    uint64_t exclusiveNs;
+    uint64_t tokens;        // 含子成分读入的单词数
+    uint64_t ownTokens;     // 不含子成分
+};
+const uint8_t PROFILE_OPEN = 0xff;
+const size_t PROFILE_MAX_KINDS = 64;
+// 调用路径最多保留这么多层，更深的成分算到这一层上 (机器生成的深层嵌套不会让折叠栈无限变长)
+const size_t PROFILE_MAX_DEPTH = 128;
+
+// 所有线程的汇总结果，各线程的数据在线程结束 (主线程在程序退出) 时合并进来
+struct ProfileTotals {
+    mutex lock;
+    uint64_t calls[PROFILE_MAX_KINDS] = {};
+    uint64_t inclusiveNs[PROFILE_MAX_KINDS] = {}; // 只算最外层的一次，递归的成分不重复计时
+    uint64_t exclusiveNs[PROFILE_MAX_KINDS] = {};
+    uint64_t tokens[PROFILE_MAX_KINDS] = {};
+    uint64_t ownTokens[PROFILE_MAX_KINDS] = {};
+    uint64_t totalTokens = 0;
+    uint64_t peekHits[LOOKAHEAD_SLOTS + 1] = {};
+    uint64_t peekMisses[LOOKAHEAD_SLOTS + 1] = {};
+    size_t windowHighWater = 0;
+    map<vector<uint8_t>, uint64_t> folded; // 调用路径 -> 不含子成分的时间
+};
+ProfileTotals profileTotals;
+
+struct ParserProfile {
+    struct Open {
+        uint32_t event;
+        uint64_t start;
+        uint64_t childNs;
+        uint64_t startTokens;
+        uint64_t childTokens;
+    };
+    vector<ProfileEvent> events;
+    vector<Open> open;
+    uint64_t tokens = 0;
+    uint64_t peekHits[LOOKAHEAD_SLOTS + 1] = {};
+    uint64_t peekMisses[LOOKAHEAD_SLOTS + 1] = {};
+    size_t windowHighWater = 0;
+
+    ~ParserProfile() { merge(); }
+
+    // 把本线程的事件折算成按成分、按调用路径的统计，加到 profileTotals 里
+    void merge() {
+        uint64_t calls[PROFILE_MAX_KINDS] = {}, inclusiveNs[PROFILE_MAX_KINDS] = {}, exclusiveNs[PROFILE_MAX_KINDS] = {};
+        uint64_t kindTokens[PROFILE_MAX_KINDS] = {}, ownTokens[PROFILE_MAX_KINDS] = {};
+        // 父事件的编号总比子事件小，按顺序处理时父事件的路径已经算好
+        vector<uint64_t> kindsAbove(events.size()); // 祖先 (含自己) 里出现过的成分
+        vector<int32_t> pathOf(events.size());
+        vector<uint32_t> depthOf(events.size());
+        vector<pair<int32_t, uint8_t>> paths; // 路径编号 -> (父路径, 成分)
+        vector<uint64_t> pathNs;
+        map<pair<int32_t, uint8_t>, int32_t> pathIds;
+        for (size_t i = 0; i < events.size(); i++) {
+            const ProfileEvent& e = events[i];
+            uint64_t above = e.parent >= 0 ? kindsAbove[e.parent] : 0;
+            int32_t parentPath = e.parent >= 0 ? pathOf[e.parent] : -1;
+            depthOf[i] = e.parent >= 0 ? depthOf[e.parent] + 1 : 1;
+            if (depthOf[i] > PROFILE_MAX_DEPTH) {
+                pathOf[i] = parentPath;
+            } else {
+                auto it = pathIds.emplace(make_pair(parentPath, e.kind), (int32_t)paths.size()).first;
+                if (it->second == (int32_t)paths.size()) {
+                    paths.push_back({parentPath, e.kind});
+                    pathNs.push_back(0);
+                }
+                pathOf[i] = it->second;
+            }
+            if (e.kind == PROFILE_OPEN) {
+                kindsAbove[i] = above;
+                continue;
+            }
+            uint64_t bit = (uint64_t)1 << e.kind;
+            kindsAbove[i] = above | bit;
+            calls[e.kind]++;
+            exclusiveNs[e.kind] += e.exclusiveNs;
+            ownTokens[e.kind] += e.ownTokens;
+            if (!(above & bit)) {
+                inclusiveNs[e.kind] += e.inclusiveNs;
+                kindTokens[e.kind] += e.tokens;
+            }
+            pathNs[pathOf[i]] += e.exclusiveNs;
+        }
+
+        lock_guard<mutex> guard(profileTotals.lock);
+        for (size_t k = 0; k < PROFILE_MAX_KINDS; k++) {
+            profileTotals.calls[k] += calls[k];
+            profileTotals.inclusiveNs[k] += inclusiveNs[k];
+            profileTotals.exclusiveNs[k] += exclusiveNs[k];
+            profileTotals.tokens[k] += kindTokens[k];
+            profileTotals.ownTokens[k] += ownTokens[k];
+        }
+        profileTotals.totalTokens += tokens;
+        for (size_t k = 0; k <= LOOKAHEAD_SLOTS; k++) {
+            profileTotals.peekHits[k] += peekHits[k];
+            profileTotals.peekMisses[k] += peekMisses[k];
+        }
+        profileTotals.windowHighWater = max(profileTotals.windowHighWater, windowHighWater);
+        vector<uint8_t> stack;
+        for (size_t p = 0; p < paths.size(); p++) {
+            if (pathNs[p] == 0) continue;
+            stack.clear();
+            for (int32_t q = (int32_t)p; q >= 0; q = paths[q].first) stack.push_back(paths[q].second);
+            reverse(stack.begin(), stack.end());
+            profileTotals.folded[stack] += pathNs[p];
+        }
+        events.clear();
+        open.clear();
+        tokens = 0;
+        fill(begin(peekHits), end(peekHits), 0);
+        fill(begin(peekMisses), end(peekMisses), 0);
+        windowHighWater = 0;
+    }
+};
+thread_local ParserProfile parserProfile;
+
+inline uint64_t profileNow() {
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void profileBegin() {
+    ParserProfile& p = parserProfile;
+    int32_t parent = p.open.empty() ? -1 : (int32_t)p.open.back().event;
+    p.events.push_back({parent, PROFILE_OPEN, 0, 0, 0, 0});
+    p.open.push_back({(uint32_t)p.events.size() - 1, profileNow(), 0, p.tokens, 0});
+}
+
+inline void profileEnd(uint8_t kind) {
+    ParserProfile& p = parserProfile;
+    if (p.open.empty()) return;
+    ParserProfile::Open f = p.open.back();
+    p.open.pop_back();
+    uint64_t ns = profileNow() - f.start;
+    uint64_t tokens = p.tokens - f.startTokens;
+    ProfileEvent& e = p.events[f.event];
+    e.kind = kind;
+    e.inclusiveNs = ns;
+    e.exclusiveNs = ns - f.childNs;
+    e.tokens = tokens;
+    e.ownTokens = tokens - f.childTokens;
+    if (!p.open.empty()) {
+        p.open.back().childNs += ns;
+        p.open.back().childTokens += tokens;
+    }
+}
+
+inline void profilePeek(size_t k) {
+    ParserProfile& p = parserProfile;
+    if (lookaheadCount >= k) p.peekHits[k]++;
+    else p.peekMisses[k]++;
+    p.windowHighWater = max(p.windowHighWater, max(k, lookaheadCount));
+}
+
+#define PROFILE_BEGIN() profileBegin()
+#define PROFILE_END(kind) profileEnd(kind)
+#define PROFILE_TOKEN() (parserProfile.tokens++)
+#define PROFILE_PEEK(k) profilePeek(k)
+#else
+#define PROFILE_BEGIN() ((void)0)
+#define PROFILE_END(kind) ((void)0)
+#define PROFILE_TOKEN() ((void)0)
+#define PROFILE_PEEK(k) ((void)0)
+#endif
+
+// 行首下标表：第 i 行 (从 0 数) 的第一个字符位于 lineStarts[i]。
+// 词法分析时不跟踪行列号，第一次需要时才扫描整个输入建立
+thread_local vector<uint32_t> lineStarts;
+thread_local bool lineStartsReady = false;
+
+struct SourcePos {
+    uint32_t line;   // 从 1 开始
+    uint32_t column; // 从 1 开始，按字节计
 };
 
-// 全局变量
-ifstream inFile;
-ofstream outFile;
-Token currentToken;
-// 用于预读的缓冲区
-vector<Token> tokenBuffer;
-size_t bufferIndex = 0;
+// 用 memchr 找换行符建立行首表 (glibc 的 memchr 一次比较一整个向量寄存器宽度的字节)
+void buildLineStarts() {
+    lineStarts.clear();
+    lineStarts.push_back(0);
+    const char* base = srcBuf.data();
+    const char* end = base + srcBuf.size();
+    for (const char* p = base; (p = (const char*)memchr(p, '\n', end - p)) != nullptr; ) {
+        p++;
+        lineStarts.push_back((uint32_t)(p - base));
+    }
+    lineStartsReady = true;
+}
+
+// 把下标换算成行列号：在行首表里二分查找
+SourcePos resolvePos(uint32_t offset) {
+    if (!lineStartsReady) buildLineStarts();
+    size_t line = upper_bound(lineStarts.begin(), lineStarts.end(), offset) - lineStarts.begin();
+    return {(uint32_t)line, offset - lineStarts[line - 1] + 1};
+}
+
+// 读取一个字符 (相当于 inFile.get(ch))
+bool readChar(char& ch) {
+    if (srcPos < srcBuf.size()) {
+        ch = srcBuf[srcPos++];
+        return true;
+    }
+    return false;
+}
+
+// 查看下一个字符但不读走 (相当于 inFile.peek())
+int peekChar() {
+    return srcPos < srcBuf.size() ? (unsigned char)srcBuf[srcPos] : EOF;
+}
 
 // 辅助：判断单字符符号
-string getSingleCharToken(char c) {
+TokenKind getSingleCharToken(char c) {
     switch (c) {
-        case '+': return "PLUS"; case '-': return "MINU";
-        case '*': return "MULT"; case '/': return "DIV";
-        case ';': return "SEMICN"; case ',': return "COMMA";
-        case '(': return "LPARENT"; case ')': return "RPARENT";
-        case '[': return "LBRACK"; case ']': return "RBRACK";
-        case '{': return "LBRACE"; case '}': return "RBRACE";
-        default: return "";
+        case '+': return PLUS; case '-': return MINU;
+        case '*': return MULT; case '/': return DIV;
+        case ';': return SEMICN; case ',': return COMMA;
+        case '(': return LPARENT; case ')': return RPARENT;
+        case '[': return LBRACK; case ']': return RBRACK;
+        case '{': return LBRACE; case '}': return RBRACE;
+        default: return TK_NONE;
     }
 }
 
 // 核心词法分析函数：从文件读取下一个Token
+// 单词值不再逐字符拼成 string，只记下它在输入中的位置和长度
 Token getNextTokenFromFile() {
     char ch;
-    while (inFile.get(ch)) {
+    while (readChar(ch)) {
         if (isspace(ch)) continue;
 
         Token tk;
+        tk.kind = TK_NONE;
+        tk.offset = (uint32_t)(srcPos - 1);
+        tk.sym = 0;
         // 1. 标识符或关键字
         if (isalpha(ch) || ch == '_') {
-            string s = ""; s += ch;
-            while (inFile.peek() != EOF && (isalnum(inFile.peek()) || inFile.peek() == '_')) {
-                inFile.get(ch); s += ch;
+            while (peekChar() != EOF && (isalnum(peekChar()) || peekChar() == '_')) {
+                readChar(ch);
             }
-            tk.value = s;
-            if (keywords.count(s)) tk.type = keywords[s];
-            else tk.type = "IDENFR";
+            // 名字直接从输入缓冲区驻留，不再为每个标识符构造一个 string；
+            // 编号落在关键字范围内的就是关键字
+            if (!symbolsSeeded) resetSymbols();
+            tk.len = (uint32_t)(srcPos - tk.offset);
+            tk.sym = symbols.intern(srcBuf.data() + tk.offset, tk.len);
+            tk.kind = tk.sym < keywordKinds.size() ? keywordKinds[tk.sym] : IDENFR;
             return tk;
         }
         // 2. 数字 (INTCON)
         else if (isdigit(ch)) {
-            string s = ""; s += ch;
-            while (inFile.peek() != EOF && isdigit(inFile.peek())) {
-                inFile.get(ch); s += ch;
-            }
-            tk.type = "INTCON"; tk.value = s;
-            return tk;
-        }
-        // 3. 字符串常量 (STRCON)
-        else if (ch == '"') {
-            string s = "";
-            while (inFile.get(ch) && ch != '"') {
-                s += ch;
+            while (peekChar() != EOF && isdigit(peekChar())) {
+                readChar(ch);
             }
-            tk.type = "STRCON"; tk.value = s;
+            tk.kind = INTCON;
+            tk.len = (uint32_t)(srcPos - tk.offset);
             return tk;
         }
-        // 4. 字符常量 (CHARCON)
-        else if (ch == '\'') {
-            string s = "";
-            while (inFile.get(ch) && ch != '\'') {
-                s += ch;
-            }
-            tk.type = "CHARCON"; tk.value = s;
+        // 3. 字符串常量 (STRCON) / 4. 字符常量 (CHARCON)
+        // 值从开头引号的下一个字符算起，到结尾引号为止 (没有结尾引号就到输入末尾)
+        else if (ch == '"' || ch == '\'') {
+            char quote = ch;
+            size_t end = srcPos;
+            while (readChar(ch) && ch != quote) end = srcPos;
+            tk.kind = quote == '"' ? STRCON : CHARCON;
+            tk.len = (uint32_t)(end - tk.offset - 1);
             return tk;
         }
         // 5. 操作符
         else {
-            string s = ""; s += ch;
-            char next = inFile.peek();
+            char next = peekChar();
             if (ch == '<') {
-                if (next == '=') { inFile.get(ch); tk.type = "LEQ"; tk.value = "<="; }
-                else { tk.type = "LSS"; tk.value = "<"; }
+                if (next == '=') { readChar(ch); tk.kind = LEQ; }
+                else { tk.kind = LSS; }
             } else if (ch == '>') {
-                if (next == '=') { inFile.get(ch); tk.type = "GEQ"; tk.value = ">="; }
-                else { tk.type = "GRE"; tk.value = ">"; }
+                if (next == '=') { readChar(ch); tk.kind = GEQ; }
+                else { tk.kind = GRE; }
             } else if (ch == '=') {
-                if (next == '=') { inFile.get(ch); tk.type = "EQL"; tk.value = "=="; }
-                else { tk.type = "ASSIGN"; tk.value = "="; }
+                if (next == '=') { readChar(ch); tk.kind = EQL; }
+                else { tk.kind = ASSIGN; }
             } else if (ch == '!') {
-                if (next == '=') { inFile.get(ch); tk.type = "NEQ"; tk.value = "!="; }
+                if (next == '=') { readChar(ch); tk.kind = NEQ; }
                 else { /* Error usually */ } 
             } else {
-                string type = getSingleCharToken(ch);
-                if (type != "") { tk.type = type; tk.value = s; }
+                tk.kind = getSingleCharToken(ch);
             }
-            if (tk.type != "") return tk;
+            tk.len = (uint32_t)(srcPos - tk.offset);
+            if (tk.kind != TK_NONE) return tk;
+        }
+    }
+    return {TK_EOF, (uint32_t)srcBuf.size(), 0, 0};
+}
+
+// --- 流水线模式：词法分析放到单独的线程 ---
+// 词法线程把单词按批写进一个单生产者单消费者的环形队列，语法分析线程按批取用，
+// 两边只靠两个原子计数同步，不加锁。词法分析器的状态都是 thread_local 的，
+// 所以开始时把输入缓冲区和驻留表整个交给词法线程，分析结束后再换回来
+
+struct TokenPipe {
+    static const size_t SLOTS = 16;  // 环里的批数
+    static const size_t BATCH = 256; // 每批的单词数
+    vector<Token> batches[SLOTS];
+    alignas(64) atomic<size_t> produced{0}; // 已写好的批数，只有词法线程写
+    alignas(64) atomic<size_t> consumed{0}; // 已取完的批数，只有分析线程写
+    atomic<bool> stop{false};               // 分析线程已经结束，词法线程不必再等空位
+    // 在两个线程之间转交的输入缓冲区和驻留表
+    string src;
+    SymbolInterner names;
+    // 分析线程一侧：当前批里读到的位置，以及是否已经读到 EOF (之后一直返回它)
+    size_t readIndex = 0;
+    bool finished = false;
+    Token eofToken;
+
+    void reset() {
+        produced.store(0);
+        consumed.store(0);
+        stop.store(false);
+        readIndex = 0;
+        finished = false;
+    }
+};
+
+thread_local TokenPipe tokenPipe;
+thread_local bool pipeActive = false; // 分析线程是否从 tokenPipe 取单词
+
+// 词法线程：读完整个输入 (最后一批以 EOF 结尾)，或者分析线程喊停为止
+void runLexerThread(TokenPipe& pipe) {
+    srcBuf.swap(pipe.src);
+    swap(symbols, pipe.names);
+    srcPos = 0;
+    symbolsSeeded = true;
+    bool done = false;
+    for (size_t n = 0; !done; n++) {
+        // 等一个空位
+        while (n - pipe.consumed.load(memory_order_acquire) == TokenPipe::SLOTS) {
+            if (pipe.stop.load(memory_order_acquire)) break;
+            this_thread::yield();
+        }
+        if (pipe.stop.load(memory_order_acquire)) break;
+        vector<Token>& batch = pipe.batches[n % TokenPipe::SLOTS];
+        batch.clear();
+        while (batch.size() < TokenPipe::BATCH && !done) {
+            batch.push_back(getNextTokenFromFile());
+            done = batch.back().kind == TK_EOF;
         }
+        pipe.produced.store(n + 1, memory_order_release);
     }
-    return {"EOF", "", 0};
+    srcBuf.swap(pipe.src);
+    swap(symbols, pipe.names);
+}
+
+// 分析线程：取下一个单词 (移出，不复制)，当前批取完就把位置还给词法线程
+Token pullToken(TokenPipe& pipe) {
+    if (pipe.finished) return pipe.eofToken;
+    size_t n = pipe.consumed.load(memory_order_relaxed);
+    while (pipe.produced.load(memory_order_acquire) == n) this_thread::yield();
+    vector<Token>& batch = pipe.batches[n % TokenPipe::SLOTS];
+    Token tk = move(batch[pipe.readIndex++]);
+    if (pipe.readIndex == batch.size()) {
+        pipe.readIndex = 0;
+        pipe.consumed.store(n + 1, memory_order_release);
+    }
+    if (tk.kind == TK_EOF) {
+        pipe.finished = true;
+        pipe.eofToken = tk;
+    }
+    return tk;
+}
+
+// 按函数并行分析时，从已经分析好的单词数组里读一段 [sliceNext, sliceEnd)，读完后一直返回 sliceEof
+thread_local const Token* sliceNext = nullptr;
+thread_local const Token* sliceEnd = nullptr;
+thread_local Token sliceEof;
+
+void setTokenSlice(const Token* begin, const Token* end, uint32_t eofOffset) {
+    sliceNext = begin;
+    sliceEnd = end;
+    sliceEof = {TK_EOF, eofOffset, 0, 0};
+}
+
+// 语法分析器读单词的唯一入口：有单词数组时从数组取 (复制，数组由几个线程共用)，
+// 流水线模式下从队列取，否则当场做词法分析
+Token readToken() {
+    if (sliceNext) return sliceNext < sliceEnd ? *sliceNext++ : sliceEof;
+    return pipeActive ? pullToken(tokenPipe) : getNextTokenFromFile();
 }
 
 // 包装层：支持预读 (Peek) 的词法获取
-// 逻辑：优先从 buffer 取，buffer 空了再读文件
+// 逻辑：优先从预读窗口取 (移出，不复制)，窗口空了再读文件
 Token getToken() {
-    if (bufferIndex < tokenBuffer.size()) {
-        return tokenBuffer[bufferIndex++];
+    if (lookaheadCount > 0) {
+        Token tk = move(lookahead[lookaheadHead]);
+        lookaheadHead = (lookaheadHead + 1) % LOOKAHEAD_SLOTS;
+        lookaheadCount--;
+        return tk;
     }
-    Token tk = getNextTokenFromFile();
-    // 不存入buffer，直接返回，只有peek的时候才存buffer
-    return tk;
+    // 不存入窗口，直接返回，只有peek的时候才存窗口
+    return readToken();
 }
 
-// 预读函数：查看接下来的第 k 个 token (k=1 表示下一个)
+// 预读函数：查看接下来的第 k 个 token (k=1 表示下一个，k 不超过 LOOKAHEAD_SLOTS)
 // 预读的 Token 会被缓存，不会丢失，且此时**不输出**
-Token peekToken(size_t k = 1) {
-    // 确保 buffer 里有足够的 token
-    while (tokenBuffer.size() <= bufferIndex + k - 1) {
-        Token t = getNextTokenFromFile();
-        if (t.type == "EOF") return t;
-        tokenBuffer.push_back(t);
+// 返回的引用在下一次 getToken 之前有效 (继续 peek 不会挪动已缓存的单词)
+const Token& peekToken(size_t k = 1) {
+    PROFILE_PEEK(k);
+    // 确保窗口里有足够的 token (读到文件末尾时 EOF 也会被缓存)
+    while (lookaheadCount < k) {
+        lookahead[(lookaheadHead + lookaheadCount) % LOOKAHEAD_SLOTS] = readToken();
+        lookaheadCount++;
+    }
+    return lookahead[(lookaheadHead + k - 1) % LOOKAHEAD_SLOTS];
+}
+
+// ==========================================
+// 2. 语法树
+// ==========================================
+
+// 语法成分编号，顺序与 tagNames 对应
+enum NodeKind : uint8_t {
+    NT_PROGRAM, NT_CONST_DECL, NT_CONST_DEF, NT_UNSIGNED_INT, NT_INTEGER, NT_VAR_DECL,
+    NT_VAR_DEF, NT_DECL_HEAD, NT_FUNC_RET, NT_FUNC_VOID, NT_MAIN_FUNC, NT_PARAM_TABLE,
+    NT_COMPOUND_STMT, NT_STMT_LIST, NT_STMT, NT_ASSIGN_STMT, NT_COND_STMT, NT_CONDITION,
+    NT_LOOP_STMT, NT_STEP, NT_SCANF, NT_STRING, NT_PRINTF, NT_RETURN_STMT, NT_EXPRESSION,
+    NT_TERM, NT_FACTOR, NT_CALL_RET, NT_CALL_VOID, NT_VALUE_PARAMS, NT_COUNT
+};
+
+const char* const tagNames[] = {
+    "<程序>", "<常量说明>", "<常量定义>", "<无符号整数>", "<整数>", "<变量说明>", "<变量定义>", "<声明头部>",
+    "<有返回值函数定义>", "<无返回值函数定义>", "<主函数>", "<参数表>", "<复合语句>", "<语句列>", "<语句>",
+    "<赋值语句>", "<条件语句>", "<条件>", "<循环语句>", "<步长>", "<读语句>", "<字符串>", "<写语句>",
+    "<返回语句>", "<表达式>", "<项>", "<因子>", "<有返回值函数调用语句>", "<无返回值函数调用语句>", "<值参数表>"
+};
+#ifdef PARSER_PROFILE
+static_assert(NT_COUNT <= PROFILE_MAX_KINDS, "profile counters are indexed by NodeKind");
+#endif
+
+// 语法树结点：子结点 (单词或语法成分) 按源程序顺序连续存放在 astChildren[first, first + count)
+struct AstNode {
+    NodeKind kind;
+    uint32_t first;
+    uint32_t count;
+};
+
+// 子结点引用：最高位为 1 表示单词 (低位是 astTokens 下标)，否则是结点编号 (astNodes 下标)
+const uint32_t AST_TOKEN_BIT = 0x80000000u;
+inline bool isTokenRef(uint32_t ref) { return (ref & AST_TOKEN_BIT) != 0; }
+inline uint32_t refIndex(uint32_t ref) { return ref & ~AST_TOKEN_BIT; }
+
+// 整棵树放在三个只增不减的数组里 (相当于按类型分开的 bump 分配区)，结点之间用 32 位编号互相引用，
+// 没有指针，也没有逐个结点的堆分配；换下一个文件时清空但保留容量
+thread_local vector<AstNode> astNodes;
+thread_local vector<uint32_t> astChildren;
+thread_local vector<Token> astTokens;
+// 正在分析的各个语法成分还没收齐的子结点，按出现顺序压栈；
+// 一个成分分析完时，把属于它的那一段整体搬进 astChildren，保证每个结点的子结点连续存放
+thread_local vector<uint32_t> astStack;
+thread_local uint32_t astRoot = 0;
+
+void resetAst() {
+    astNodes.clear();
+    astChildren.clear();
+    astTokens.clear();
+    astStack.clear();
+}
+
+// 开始一个语法成分：记下它的子结点在 astStack 中从哪里开始
+inline size_t beginNode() {
+    PROFILE_BEGIN();
+    return astStack.size();
+}
+
+// 结束一个语法成分：astStack[mark, end) 就是它的全部子结点
+inline void finishNode(NodeKind kind, size_t mark) {
+    PROFILE_END(kind);
+    uint32_t id = (uint32_t)astNodes.size();
+    astNodes.push_back({kind, (uint32_t)astChildren.size(), (uint32_t)(astStack.size() - mark)});
+    astChildren.insert(astChildren.end(), astStack.begin() + mark, astStack.end());
+    astStack.resize(mark);
+    astStack.push_back(id);
+}
+
+// 按原来的输出格式遍历语法树：先依次输出子结点 (单词输出 "类别码 单词值")，再输出本结点的标签。
+// 用显式栈代替递归，嵌套再深也不会耗尽调用栈
+void emitAst(uint32_t root, OutBuffer& out) {
+    vector<pair<uint32_t, uint32_t>> stack; // (结点编号, 下一个要输出的子结点序号)
+    stack.push_back({root, 0});
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        const AstNode& node = astNodes[top.first];
+        if (top.second == node.count) {
+            out << tagNames[node.kind] << endl;
+            stack.pop_back();
+            continue;
+        }
+        uint32_t ref = astChildren[node.first + top.second++];
+        if (isTokenRef(ref)) {
+            const Token& tk = astTokens[refIndex(ref)];
+            out << tokenNames[tk.kind] << " " << tokenText(tk) << endl;
+        } else {
+            stack.push_back({ref, 0});
+        }
+    }
+}
+
+// ==========================================
+// 3. 符号表
+// ==========================================
+
+// 名字的种类
+enum SymbolKind : uint8_t { SK_CONST, SK_VAR, SK_ARRAY, SK_FUNC };
+
+struct SymbolInfo {
+    SymbolKind kind;
+    TokenKind type; // INTTK / CHARTK；函数记返回类型，无返回值函数为 VOIDTK
+};
+
+// 分作用域的符号表：每层作用域一张开放定址 (线性探测) 的哈希表，键是标识符的驻留编号。
+// 槽里记着写入时那一层的代号，代号对不上的槽当作空槽；退出作用域只是层数减一，
+// 下次进入同一层时换一个新代号，旧内容自然作废，所以 push/pop 都是 O(1)，不用逐个清槽
+class ScopedSymbolTable {
+public:
+    // 清空所有作用域，只留下全局作用域 (每个文件开始前调用)
+    void reset() {
+        depth = 0;
+        push();
+    }
+
+    void push() {
+        if (depth == scopes.size()) scopes.emplace_back();
+        Scope& s = scopes[depth++];
+        s.count = 0;
+        if (++s.generation == 0) { // 代号转完一圈，才真正清一次槽
+            for (Slot& slot : s.slots) slot.generation = 0;
+            s.generation = 1;
+        }
+    }
+
+    void pop() { depth--; }
+
+    // 在当前作用域登记名字；同一作用域里重名时保留先登记的，返回 false
+    bool declare(uint32_t sym, SymbolInfo info) {
+        Scope& s = scopes[depth - 1];
+        if ((s.count + 1) * 2 > s.slots.size()) grow(s);
+        Slot& slot = s.slots[findSlot(s, sym)];
+        if (slot.generation == s.generation) return false;
+        slot = {s.generation, sym, info};
+        s.count++;
+        return true;
+    }
+
+    // 由内层向外层查找，找不到返回 nullptr
+    const SymbolInfo* lookup(uint32_t sym) const {
+        for (size_t d = depth; d-- > 0;) {
+            const Scope& s = scopes[d];
+            if (s.count == 0) continue;
+            const Slot& slot = s.slots[findSlot(s, sym)];
+            if (slot.generation == s.generation) return &slot.info;
+        }
+        return nullptr;
+    }
+
+private:
+    struct Slot {
+        uint32_t generation; // 0 表示从未用过
+        uint32_t sym;
+        SymbolInfo info;
+    };
+    struct Scope {
+        vector<Slot> slots = vector<Slot>(16);
+        size_t count = 0;
+        uint32_t generation = 0;
+    };
+
+    vector<Scope> scopes; // 按层复用，退出的层连同它的哈希表留给下次进入
+    size_t depth = 0;
+
+    // sym 所在的槽，或者应当插入它的空槽。驻留编号是连续的小整数，乘一个奇数打散即可
+    static size_t findSlot(const Scope& s, uint32_t sym) {
+        size_t mask = s.slots.size() - 1;
+        size_t i = (sym * 2654435761u) & mask;
+        while (s.slots[i].generation == s.generation && s.slots[i].sym != sym) i = (i + 1) & mask;
+        return i;
     }
-    return tokenBuffer[bufferIndex + k - 1];
+
+    void grow(Scope& s) {
+        vector<Slot> old(s.slots.size() * 2);
+        old.swap(s.slots);
+        for (const Slot& slot : old) {
+            if (slot.generation == s.generation) s.slots[findSlot(s, slot.sym)] = slot;
+        }
+    }
+};
+
+thread_local ScopedSymbolTable scopes;
+
+// 把当前单词 (标识符) 登记到当前作用域
+void declareCurrent(SymbolKind kind, TokenKind type) {
+    scopes.declare(currentToken.sym, {kind, type});
+}
+
+// 变量说明和参数里的标识符：后面跟 '[' 的是数组
+void declareVariable(TokenKind type) {
+    declareCurrent(peekToken(1).kind == LBRACK ? SK_ARRAY : SK_VAR, type);
+}
+
+// 函数调用语句的标签：<有返回值函数调用语句> 和 <无返回值函数调用语句> 写法完全一样，只能查表看被调函数的返回类型。
+// 没有登记过的名字 (输入有误) 按无返回值处理
+NodeKind callKind(const Token& name) {
+    const SymbolInfo* info = scopes.lookup(name.sym);
+    return info && info->kind == SK_FUNC && info->type != VOIDTK ? NT_CALL_RET : NT_CALL_VOID;
 }
 
 // ==========================================
-// 2. 语法分析器定义
+// 4. 语法分析器定义
 // ==========================================
 
 // 前置声明所有函数
@@ -161,28 +755,28 @@ void parseParamTable();
 void parseCompoundStmt();
 void parseStmtList();
 void parseStatement();
-void parseAssignStmt();
-void parseCondStmt();
-void parseLoopStmt();
-void parseReturnStmt();
 void parseScanf();
-void parsePrintf();
 void parseExpression();
-void parseTerm();
-void parseFactor();
-void parseFuncCallWithRet();
-void parseFuncCallVoid();
-void parseValueParamTable();
 void parseStep();
 void parseCondition();
 
-// 核心工具：匹配并输出当前单词，然后读入下一个
-void match(string expectedType = "") {
-    // 如果指定了类型但匹配失败（简易错误处理）
-    // 本题假设输入合法，不处理 expectedType 不匹配的情况
-    
-    // 1. 输出当前单词到文件
-    outFile << currentToken.type << " " << currentToken.value << endl;
+// 各语法成分的 First 集合 (以及几组运算符)，在编译期由单词类别拼成掩码
+constexpr TokenSet TYPE_SPECIFIERS = tokenSet({INTTK, CHARTK});
+constexpr TokenSet FIRST_FUNC_DEF = TYPE_SPECIFIERS | tokenSet({VOIDTK});
+constexpr TokenSet ADD_OPS = tokenSet({PLUS, MINU});
+constexpr TokenSet MUL_OPS = tokenSet({MULT, DIV});
+constexpr TokenSet REL_OPS = tokenSet({LSS, LEQ, GRE, GEQ, EQL, NEQ});
+constexpr TokenSet FIRST_LOOP_STMT = tokenSet({WHILETK, DOTK, FORTK});
+// 语句的 First 集合：if, while, do, for, {, scanf, printf, return, ;, 标识符(赋值/函数调用)
+constexpr TokenSet FIRST_STMT = tokenSet({IFTK, LBRACE, SCANFTK, PRINTFTK, RETURNTK, SEMICN, IDENFR}) | FIRST_LOOP_STMT;
+
+// 核心工具：把当前单词挂到语法树上，然后读入下一个
+// 本题假设输入合法，不核对当前单词是否是文法要求的那一种
+void match() {
+    // 1. 当前单词作为正在分析的语法成分的子结点 (移入，不复制)
+    astStack.push_back((uint32_t)astTokens.size() | AST_TOKEN_BIT);
+    astTokens.push_back(move(currentToken));
+    PROFILE_TOKEN();
     
     // 2. 移动到下一个单词
     currentToken = getToken();
@@ -197,8 +791,9 @@ void initParser() {
 
 // <程序> ::= [ <常量说明> ] [ <变量说明> ] { <有返回值函数定义> | <无返回值函数定义> } <主函数>
 void parseProgram() {
+    size_t mark = beginNode();
     // 1. 常量说明
-    if (currentToken.type == "CONSTTK") {
+    if (currentToken.kind == CONSTTK) {
         parseConstDecl();
     }
     
@@ -213,11 +808,11 @@ void parseProgram() {
     // 这里文法是 [ <变量说明> ]，意味着只有一块变量说明区域。
     // 但是，变量说明内部是 { <变量定义>; }
     
-    while (currentToken.type == "INTTK" || currentToken.type == "CHARTK") {
-        Token next1 = peekToken(1); // 标识符
-        Token next2 = peekToken(2); // 符号
+    while (inSet(TYPE_SPECIFIERS, currentToken.kind)) {
+        // peekToken(1) 是标识符，peekToken(2) 是其后的符号
+        const Token& next2 = peekToken(2);
         
-        if (next2.type != "LPARENT") {
+        if (next2.kind != LPARENT) {
             // 不是左括号，说明是变量
             parseVarDecl();
         } else {
@@ -229,14 +824,14 @@ void parseProgram() {
     // 3. 函数定义 (有返回值 | 无返回值)
     // 此时如果是 int/char 开头，是有返回值函数
     // 如果是 void 开头，可能是无返回值函数，也可能是 main
-    while (currentToken.type == "INTTK" || currentToken.type == "CHARTK" || currentToken.type == "VOIDTK") {
-        if (currentToken.type == "INTTK" || currentToken.type == "CHARTK") {
+    while (inSet(FIRST_FUNC_DEF, currentToken.kind)) {
+        if (inSet(TYPE_SPECIFIERS, currentToken.kind)) {
             parseFuncDefWithRet();
         } else {
             // VOIDTK
             // 区分 void main 和 void func
-            Token next = peekToken(1);
-            if (next.type == "MAINTK") {
+            const Token& next = peekToken(1);
+            if (next.kind == MAINTK) {
                 break; // 遇到 main 了，跳出循环
             } else {
                 parseFuncDefVoid();
@@ -247,471 +842,4966 @@ void parseProgram() {
     // 4. 主函数
     parseMainFunc();
 
-    outFile << "<程序>" << endl;
+    finishNode(NT_PROGRAM, mark);
 }
 
 // <常量说明> ::= const <常量定义> ; { const <常量定义> ; }
 void parseConstDecl() {
-    while (currentToken.type == "CONSTTK") {
+    size_t mark = beginNode();
+    while (currentToken.kind == CONSTTK) {
         match(); // const
         parseConstDef();
         match(); // ;
     }
-    outFile << "<常量说明>" << endl;
+    finishNode(NT_CONST_DECL, mark);
 }
 
 // <常量定义> ::= int <标识符> = <整数> { , <标识符> = <整数> } 
 //              | char <标识符> = <字符> { , <标识符> = <字符> }
 void parseConstDef() {
-    if (currentToken.type == "INTTK") {
+    size_t mark = beginNode();
+    if (currentToken.kind == INTTK) {
         match(); // int
+        declareCurrent(SK_CONST, INTTK);
         match(); // id
         match(); // =
         parseInteger();
-        while (currentToken.type == "COMMA") {
+        while (currentToken.kind == COMMA) {
             match(); // ,
+            declareCurrent(SK_CONST, INTTK);
             match(); // id
             match(); // =
             parseInteger();
         }
-    } else if (currentToken.type == "CHARTK") {
+    } else if (currentToken.kind == CHARTK) {
         match(); // char
+        declareCurrent(SK_CONST, CHARTK);
         match(); // id
         match(); // =
         match(); // char literal
-        while (currentToken.type == "COMMA") {
+        while (currentToken.kind == COMMA) {
             match(); // ,
+            declareCurrent(SK_CONST, CHARTK);
             match(); // id
             match(); // =
             match(); // char literal
         }
     }
-    outFile << "<常量定义>" << endl;
+    finishNode(NT_CONST_DEF, mark);
 }
 
 // <无符号整数> ::= <非零数字> { <数字> } | 0
 // 词法分析器已经将数字识别为 INTCON
 void parseUnsignedInteger() {
+    size_t mark = beginNode();
     match(); // INTCON
-    outFile << "<无符号整数>" << endl;
+    finishNode(NT_UNSIGNED_INT, mark);
 }
 
 // <整数> ::= [+|-] <无符号整数>
 void parseInteger() {
-    if (currentToken.type == "PLUS" || currentToken.type == "MINU") {
+    size_t mark = beginNode();
+    if (inSet(ADD_OPS, currentToken.kind)) {
         match();
     }
     parseUnsignedInteger();
-    outFile << "<整数>" << endl;
+    finishNode(NT_INTEGER, mark);
 }
 
 // <变量说明> ::= <变量定义>; { <变量定义>; }
 // 注意：我们在 parseProgram 里通过 peek 决定了什么时候进这里
 // 这里一旦进入，就尽可能多地解析变量定义，直到遇到函数（(）或 main
 void parseVarDecl() {
-    while (currentToken.type == "INTTK" || currentToken.type == "CHARTK") {
+    size_t mark = beginNode();
+    while (inSet(TYPE_SPECIFIERS, currentToken.kind)) {
         // 需要再次 peek 确保不是函数 (因为变量说明和函数定义在 int a... 这里的区别)
         // 文法是 [<变量说明>]，即一整块。
-        Token next2 = peekToken(2); 
-        if (next2.type == "LPARENT") break; // 是函数，停止解析变量说明
+        const Token& next2 = peekToken(2);
+        if (next2.kind == LPARENT) break; // 是函数，停止解析变量说明
 
         parseVarDef();
         match(); // ;
     }
-    outFile << "<变量说明>" << endl;
+    finishNode(NT_VAR_DECL, mark);
 }
 
 // <变量定义> ::= <类型标识符> ( <标识符> | <标识符> '[' <无符号整数> ']' ) { , ( ... ) }
 void parseVarDef() {
+    size_t mark = beginNode();
+    TokenKind type = currentToken.kind;
     match(); // 类型标识符 (int/char)
     
     // 第一个变量
+    declareVariable(type);
     match(); // id
-    if (currentToken.type == "LBRACK") {
+    if (currentToken.kind == LBRACK) {
         match(); // [
         parseUnsignedInteger();
         match(); // ]
     }
     
     // 后续变量
-    while (currentToken.type == "COMMA") {
+    while (currentToken.kind == COMMA) {
         match(); // ,
+        declareVariable(type);
         match(); // id
-        if (currentToken.type == "LBRACK") {
+        if (currentToken.kind == LBRACK) {
             match(); // [
             parseUnsignedInteger();
             match(); // ]
         }
     }
-    outFile << "<变量定义>" << endl;
+    finishNode(NT_VAR_DEF, mark);
 }
 
 // <声明头部> ::= int <标识符> | char <标识符>
 void parseDeclHead() {
+    size_t mark = beginNode();
+    TokenKind type = currentToken.kind;
     match(); // int/char
+    declareCurrent(SK_FUNC, type); // 先登记再分析函数体，函数体里可以递归调用自己
     match(); // id
-    outFile << "<声明头部>" << endl;
+    finishNode(NT_DECL_HEAD, mark);
 }
 
 // <有返回值函数定义> ::= <声明头部> '(' <参数表> ')' '{' <复合语句> '}'
 void parseFuncDefWithRet() {
+    size_t mark = beginNode();
     parseDeclHead();
+    scopes.push(); // 参数和局部量
     match(); // (
     parseParamTable();
     match(); // )
     match(); // {
     parseCompoundStmt();
     match(); // }
-    outFile << "<有返回值函数定义>" << endl;
+    scopes.pop();
+    finishNode(NT_FUNC_RET, mark);
 }
 
 // <无返回值函数定义> ::= void <标识符> '(' <参数表> ')' '{' <复合语句> '}'
 void parseFuncDefVoid() {
+    size_t mark = beginNode();
     match(); // void
+    declareCurrent(SK_FUNC, VOIDTK);
     match(); // id
+    scopes.push();
     match(); // (
     parseParamTable();
     match(); // )
     match(); // {
     parseCompoundStmt();
     match(); // }
-    outFile << "<无返回值函数定义>" << endl;
+    scopes.pop();
+    finishNode(NT_FUNC_VOID, mark);
 }
 
 // <主函数> ::= void main '(' ')' '{' <复合语句> '}'
 void parseMainFunc() {
+    size_t mark = beginNode();
     match(); // void
     match(); // main
+    scopes.push();
     match(); // (
     match(); // )
     match(); // {
     parseCompoundStmt();
     match(); // }
-    outFile << "<主函数>" << endl;
+    scopes.pop();
+    finishNode(NT_MAIN_FUNC, mark);
 }
 
 // <参数表> ::= <类型标识符> <标识符> { , <类型标识符> <标识符> } | <空>
 void parseParamTable() {
-    if (currentToken.type == "INTTK" || currentToken.type == "CHARTK") {
+    size_t mark = beginNode();
+    if (inSet(TYPE_SPECIFIERS, currentToken.kind)) {
+        TokenKind type = currentToken.kind;
         match(); // type
+        declareCurrent(SK_VAR, type);
         match(); // id
-        while (currentToken.type == "COMMA") {
+        while (currentToken.kind == COMMA) {
             match(); // ,
+            type = currentToken.kind;
             match(); // type
+            declareCurrent(SK_VAR, type);
             match(); // id
         }
     }
-    outFile << "<参数表>" << endl;
+    finishNode(NT_PARAM_TABLE, mark);
 }
 
 // <复合语句> ::= [ <常量说明> ] [ <变量说明> ] <语句列>
 void parseCompoundStmt() {
-    if (currentToken.type == "CONSTTK") {
+    size_t mark = beginNode();
+    if (currentToken.kind == CONSTTK) {
         parseConstDecl();
     }
-    if (currentToken.type == "INTTK" || currentToken.type == "CHARTK") {
+    if (inSet(TYPE_SPECIFIERS, currentToken.kind)) {
         parseVarDecl();
     }
     parseStmtList();
-    outFile << "<复合语句>" << endl;
-}
-
-// <语句列> ::= { <语句> }
-void parseStmtList() {
-    // 语句的 First 集合：
-    // if, while, do, for, {, scanf, printf, return, ;, 标识符(赋值/函数调用)
-    while (currentToken.type == "IFTK" || currentToken.type == "WHILETK" ||
-           currentToken.type == "DOTK" || currentToken.type == "FORTK" ||
-           currentToken.type == "LBRACE" || currentToken.type == "SCANFTK" ||
-           currentToken.type == "PRINTFTK" || currentToken.type == "RETURNTK" ||
-           currentToken.type == "SEMICN" || currentToken.type == "IDENFR") {
-        parseStatement();
-    }
-    outFile << "<语句列>" << endl;
-}
-
-// <语句>
-void parseStatement() {
-    if (currentToken.type == "IFTK") parseCondStmt();
-    else if (currentToken.type == "WHILETK" || currentToken.type == "DOTK" || currentToken.type == "FORTK") parseLoopStmt();
-    else if (currentToken.type == "LBRACE") { // '{' <语句列> '}'
-        match();
-        parseStmtList();
-        match();
-    }
-    else if (currentToken.type == "SCANFTK") { parseScanf(); match(); } // 读语句;
-    else if (currentToken.type == "PRINTFTK") { parsePrintf(); match(); } // 写语句;
-    else if (currentToken.type == "RETURNTK") { parseReturnStmt(); match(); } // 返回语句;
-    else if (currentToken.type == "SEMICN") { match(); } // 空语句;
-    else if (currentToken.type == "IDENFR") {
-        // 赋值语句 vs 函数调用
-        // 赋值: id = ... 或 id[exp] = ...
-        // 调用: id(...)
-        Token next = peekToken(1);
-        if (next.type == "LPARENT") {
-            // 函数调用
-            // 区分有返回值和无返回值调用无法仅通过语法判断(需要查符号表)
-            // 但根据题目要求输出Tag，我们可以统一处理或假设
-            // 题目文法里 <语句> 包含 <有返回值函数调用语句>; 和 <无返回值函数调用语句>;
-            // 实际上语法结构完全一样。
-            // 这里我们根据上下文简单处理：直接调用函数调用解析，具体的tag在里面输出
-            // 稍等，题目要求明确区分 <有返回值...> 和 <无返回值...> Tag
-            // 但语法分析阶段不进行语义分析（查表看函数类型），通常无法区分。
-            // **折中方案**：本题可能不要求严格区分这两种Tag的上下文（或者测试用例里函数名会有区分），
-            // 或者我们可以统一调用一个 parseFuncCall，在里面输出。
-            // 重新看文法：<因子> -> <有返回值函数调用语句>。 <语句> -> <无返回值函数调用语句>;
-            // 这意味着出现在表达式里的是有返回值，出现在语句级的是无返回值（或者有返回值但被忽略）。
-            // 在这里（语句级），我们统一按函数调用处理。
-            // 为了符合Tag输出要求，这里我们通过查已有的实现逻辑，
-            // 假设语句级的调用输出 <无返回值函数调用语句> (或者有返回值被丢弃)
-            // 严格来说应该查表。但在纯语法分析作业中，通常只要结构对了就行。
-            // 让我们看 <有返回值函数调用语句> 和 <无返回值...> 的定义是一模一样的。
-            // 我们可以写一个 parseFuncCall(bool isReturn)
-            
-            // 为了应对评测，这里由于是 <语句> 分支，我们姑且认为是 <无返回值函数调用语句>
-            // 除非题目隐含逻辑（例如 main 调用的都是 void）。
-            // *修正*：如果必须区分，需要符号表。没有符号表只能瞎猜。
-            // 通常做法：解析完后，统一输出一个Tag，或者根据题目样例调整。
-            // 鉴于这是 <语句> 下的分支，输出 <无返回值函数调用语句> 是最合理的推断。
-            parseFuncCallVoid(); 
-            match(); // ;
-        } else {
-            // 赋值语句
-            parseAssignStmt();
-            match(); // ;
-        }
-    }
-    outFile << "<语句>" << endl;
-}
-
-// <赋值语句> ::= <标识符> = <表达式> | <标识符> '[' <表达式> ']' = <表达式>
-void parseAssignStmt() {
-    match(); // id
-    if (currentToken.type == "LBRACK") {
-        match(); // [
-        parseExpression();
-        match(); // ]
-    }
-    match(); // =
-    parseExpression();
-    outFile << "<赋值语句>" << endl;
-}
-
-// <条件语句> ::= if '(' <条件> ')' <语句> [ else <语句> ]
-void parseCondStmt() {
-    match(); // if
-    match(); // (
-    parseCondition();
-    match(); // )
-    parseStatement();
-    if (currentToken.type == "ELSETK") {
-        match(); // else
-        parseStatement();
-    }
-    outFile << "<条件语句>" << endl;
-}
-
-// <条件> ::= <表达式> <关系运算符> <表达式> | <表达式>
-// <关系运算符> ::= < | <= | > | >= | != | ==
-void parseCondition() {
-    parseExpression();
-    // 检查是否接关系运算符
-    if (currentToken.type == "LSS" || currentToken.type == "LEQ" ||
-        currentToken.type == "GRE" || currentToken.type == "GEQ" ||
-        currentToken.type == "EQL" || currentToken.type == "NEQ") {
-        match(); // 关系运算符
-        // outFile << "<关系运算符>" << endl; // 高亮要求
-        parseExpression();
-    }
-    outFile << "<条件>" << endl;
-}
-
-// <循环语句>
-void parseLoopStmt() {
-    if (currentToken.type == "WHILETK") {
-        match(); // while
-        match(); // (
-        parseCondition();
-        match(); // )
-        parseStatement();
-    } else if (currentToken.type == "DOTK") {
-        match(); // do
-        parseStatement();
-        match(); // while
-        match(); // (
-        parseCondition();
-        match(); // )
-    } else if (currentToken.type == "FORTK") {
-        match(); // for
-        match(); // (
-        match(); // id
-        match(); // =
-        parseExpression();
-        match(); // ;
-        parseCondition();
-        match(); // ;
-        match(); // id
-        match(); // =
-        match(); // id
-        if (currentToken.type == "PLUS") match(); else match(); // +|-
-        parseStep();
-        match(); // )
-        parseStatement();
-    }
-    outFile << "<循环语句>" << endl;
+    finishNode(NT_COMPOUND_STMT, mark);
 }
 
 // <步长> ::= <无符号整数>
 void parseStep() {
+    size_t mark = beginNode();
     parseUnsignedInteger();
-    outFile << "<步长>" << endl;
+    finishNode(NT_STEP, mark);
 }
 
 // <读语句> ::= scanf '(' <标识符> { , <标识符> } ')'
 void parseScanf() {
+    size_t mark = beginNode();
     match(); // scanf
     match(); // (
     match(); // id
-    while (currentToken.type == "COMMA") {
+    while (currentToken.kind == COMMA) {
         match(); // ,
         match(); // id
     }
     match(); // )
-    outFile << "<读语句>" << endl;
+    finishNode(NT_SCANF, mark);
 }
 
-// <写语句> ::= printf '(' <字符串> , <表达式> ')' | printf '(' <字符串> ')' | printf '(' <表达式> ')'
-void parsePrintf() {
-    match(); // printf
-    match(); // (
-    if (currentToken.type == "STRCON") {
-        match(); // string
-        outFile << "<字符串>" << endl; 
-        if (currentToken.type == "COMMA") {
-            match(); // ,
-            parseExpression();
-        }
-    } else {
-        parseExpression();
-    }
-    match(); // )
-    outFile << "<写语句>" << endl;
-}
+// --- 语句与表达式：显式栈实现 ---
+// 语句、表达式可以任意嵌套 (括号套括号、花括号套花括号、if 套 while ...)，
+// 如果每层嵌套都递归调用一次函数，机器生成的十万层嵌套输入会耗尽调用栈。
+// 这里把 <语句>、<表达式> 等成分写成同一个循环里的状态机：
+// 每个正在分析的成分在 parseStack 上占一帧，记录"子成分分析完之后从哪一步继续"；
+// 进入子成分就压一帧，子成分结束就弹出，嵌套深度只受堆内存限制。
+// 输出的语法树 (以及标签顺序) 与原来的递归写法完全一致。
 
-// <返回语句> ::= return [ '(' <表达式> ')' ]
-void parseReturnStmt() {
-    match(); // return
-    if (currentToken.type == "LPARENT") {
-        match(); // (
-        parseExpression();
-        match(); // )
-    }
-    outFile << "<返回语句>" << endl;
-}
+enum ParseState : uint8_t {
+    // <语句列>
+    PS_STMT_LIST,
+    // <语句>
+    PS_STMT, PS_STMT_CLOSE, PS_STMT_END,
+    // <条件语句>
+    PS_IF, PS_IF_THEN, PS_IF_ELSE, PS_IF_END,
+    // <循环语句>
+    PS_LOOP, PS_WHILE_BODY, PS_DO_COND, PS_DO_END, PS_FOR_COND, PS_FOR_STEP, PS_LOOP_END,
+    // <条件>
+    PS_COND, PS_COND_RHS, PS_COND_END,
+    // <赋值语句>
+    PS_ASSIGN, PS_ASSIGN_INDEX, PS_ASSIGN_END,
+    // <写语句>、<返回语句>
+    PS_PRINTF, PS_PRINTF_END, PS_RETURN, PS_RETURN_END,
+    // <表达式>、<项>、<因子>
+    PS_EXPR, PS_EXPR_NEXT, PS_TERM, PS_TERM_NEXT, PS_FACTOR, PS_FACTOR_CLOSE, PS_FACTOR_END,
+    // <有返回值函数调用语句>、<无返回值函数调用语句>、<值参数表>
+    PS_CALL, PS_CALL_END, PS_ARGS, PS_ARGS_NEXT
+};
 
-// <表达式> ::= [+|-] <项> { <加法运算符> <项> }
-void parseExpression() {
-    if (currentToken.type == "PLUS" || currentToken.type == "MINU") {
-        match(); // [+|-]
-    }
-    parseTerm();
-    
-    while (currentToken.type == "PLUS" || currentToken.type == "MINU") {
-        match(); // +|-
-        // outFile << "<加法运算符>" << endl;
-        parseTerm();
-    }
-    outFile << "<表达式>" << endl;
-}
+struct ParseFrame {
+    ParseState state; // 下一步要做什么
+    NodeKind kind;    // 函数调用帧：结束时输出哪种调用标签
+    uint32_t mark;    // 本成分的子结点在 astStack 中的起点
+};
 
-// <项> ::= <因子> { <乘法运算符> <因子> }
-void parseTerm() {
-    parseFactor();
-    while (currentToken.type == "MULT" || currentToken.type == "DIV") {
-        match(); // *|/
-        // outFile << "<乘法运算符>" << endl;
-        parseFactor();
-    }
-    outFile << "<项>" << endl;
-}
+thread_local vector<ParseFrame> parseStack;
 
-// <因子> ::= <标识符> | <标识符> '[' <表达式> ']' | '(' <表达式> ')' | <整数> | <字符> | <有返回值函数调用语句>
-void parseFactor() {
-    if (currentToken.type == "IDENFR") {
-        // id, id[exp], id(args)
-        Token next = peekToken(1);
-        if (next.type == "LPARENT") {
-            parseFuncCallWithRet();
-        } else if (next.type == "LBRACK") {
-            match(); // id
-            match(); // [
-            parseExpression();
-            match(); // ]
-        } else {
-            match(); // id
-        }
-    } else if (currentToken.type == "LPARENT") {
-        match(); // (
-        parseExpression();
-        match(); // )
-    } else if (currentToken.type == "INTCON" || currentToken.type == "PLUS" || currentToken.type == "MINU") {
-        // 整数可能带符号，或者不带
-        parseInteger();
-    } else if (currentToken.type == "CHARCON") {
-        match();
-    }
-    outFile << "<因子>" << endl;
+// 当前帧改为在子成分结束后从 resume 继续，然后进入子成分 callee
+inline void callSub(ParseState resume, ParseState callee, NodeKind kind = NT_COUNT) {
+    parseStack.back().state = resume;
+    parseStack.push_back({callee, kind, (uint32_t)beginNode()});
 }
 
-// <有返回值函数调用语句> ::= <标识符> '(' <值参数表> ')'
-void parseFuncCallWithRet() {
-    match(); // id
-    match(); // (
-    parseValueParamTable();
-    match(); // )
-    outFile << "<有返回值函数调用语句>" << endl;
+// 当前帧的成分分析完毕：建立结点并返回上一层
+inline void finishSub(NodeKind kind) {
+    finishNode(kind, parseStack.back().mark);
+    parseStack.pop_back();
 }
 
-// <无返回值函数调用语句>
-void parseFuncCallVoid() {
-    match(); // id
-    match(); // (
-    parseValueParamTable();
-    match(); // )
-    outFile << "<无返回值函数调用语句>" << endl;
+inline void nextState(ParseState state) {
+    parseStack.back().state = state;
 }
 
-// <值参数表> ::= <表达式> { , <表达式> } | <空>
-void parseValueParamTable() {
-    // 检查是否是表达式的开始
-    // 表达式开始集合：+, -, (, id, int, char
-    // 简单判断：如果不是右括号，就是参数
-    if (currentToken.type != "RPARENT") {
-        parseExpression();
-        while (currentToken.type == "COMMA") {
-            match();
-            parseExpression();
-        }
-    }
-    outFile << "<值参数表>" << endl;
-}
+// 从 entry 对应的成分开始分析，直到它 (连同其中嵌套的所有成分) 结束
+void runParser(ParseState entry) {
+    size_t base = parseStack.size();
+    parseStack.push_back({entry, NT_COUNT, (uint32_t)beginNode()});
+    while (parseStack.size() > base) {
+        TokenKind kind = currentToken.kind;
+        switch (parseStack.back().state) {
 
-int main() {
-    inFile.open("testfile.txt");
-    if (!inFile.is_open()) {
-        cerr << "Error opening testfile.txt" << endl;
-        return 1;
-    }
-    outFile.open("output.txt");
-    if (!outFile.is_open()) {
-        cerr << "Error opening output.txt" << endl;
-        return 1;
-    }
+        // <语句列> ::= { <语句> }
+        case PS_STMT_LIST:
+            if (inSet(FIRST_STMT, kind)) {
+                callSub(PS_STMT_LIST, PS_STMT);
+            } else {
+                finishSub(NT_STMT_LIST);
+            }
+            break;
 
-    initParser();
-    parseProgram();
+        // <语句>
+        case PS_STMT:
+            // 按当前单词的类别直接跳到对应分支 (switch 编译成跳转表)
+            switch (kind) {
+            case IFTK:
+                callSub(PS_STMT_END, PS_IF);
+                break;
+            case WHILETK: case DOTK: case FORTK:
+                callSub(PS_STMT_END, PS_LOOP);
+                break;
+            case LBRACE: // '{' <语句列> '}'
+                match();
+                callSub(PS_STMT_CLOSE, PS_STMT_LIST);
+                break;
+            case SCANFTK: // 读语句;
+                parseScanf();
+                match();
+                nextState(PS_STMT_END);
+                break;
+            case PRINTFTK: // 写语句;
+                callSub(PS_STMT_CLOSE, PS_PRINTF);
+                break;
+            case RETURNTK: // 返回语句;
+                callSub(PS_STMT_CLOSE, PS_RETURN);
+                break;
+            case SEMICN: // 空语句;
+                match();
+                nextState(PS_STMT_END);
+                break;
+            case IDENFR: {
+                // 赋值语句 vs 函数调用
+                // 赋值: id = ... 或 id[exp] = ...
+                // 调用: id(...)
+                const Token& next = peekToken(1);
+                if (next.kind == LPARENT) {
+                    // 函数调用：查符号表决定是 <有返回值函数调用语句> 还是 <无返回值函数调用语句>
+                    callSub(PS_STMT_CLOSE, PS_CALL, callKind(currentToken));
+                } else {
+                    // 赋值语句
+                    callSub(PS_STMT_CLOSE, PS_ASSIGN);
+                }
+                break;
+            }
+            default:
+                nextState(PS_STMT_END);
+            }
+            break;
+        case PS_STMT_CLOSE:
+            match(); // } 或 ;
+            nextState(PS_STMT_END);
+            break;
+        case PS_STMT_END:
+            finishSub(NT_STMT);
+            break;
 
-    inFile.close();
-    outFile.close();
-    return 0;
-}
\ No newline at end of file
+        // <条件语句> ::= if '(' <条件> ')' <语句> [ else <语句> ]
+        case PS_IF:
+            match(); // if
+            match(); // (
+            callSub(PS_IF_THEN, PS_COND);
+            break;
+        case PS_IF_THEN:
+            match(); // )
+            callSub(PS_IF_ELSE, PS_STMT);
+            break;
+        case PS_IF_ELSE:
+            if (kind == ELSETK) {
+                match(); // else
+                callSub(PS_IF_END, PS_STMT);
+            } else {
+                finishSub(NT_COND_STMT);
+            }
+            break;
+        case PS_IF_END:
+            finishSub(NT_COND_STMT);
+            break;
+
+        // <循环语句>
+        case PS_LOOP:
+            if (kind == WHILETK) {
+                match(); // while
+                match(); // (
+                callSub(PS_WHILE_BODY, PS_COND);
+            } else if (kind == DOTK) {
+                match(); // do
+                callSub(PS_DO_COND, PS_STMT);
+            } else if (kind == FORTK) {
+                match(); // for
+                match(); // (
+                match(); // id
+                match(); // =
+                callSub(PS_FOR_COND, PS_EXPR);
+            } else {
+                finishSub(NT_LOOP_STMT);
+            }
+            break;
+        case PS_WHILE_BODY:
+            match(); // )
+            callSub(PS_LOOP_END, PS_STMT);
+            break;
+        case PS_DO_COND:
+            match(); // while
+            match(); // (
+            callSub(PS_DO_END, PS_COND);
+            break;
+        case PS_DO_END:
+            match(); // )
+            finishSub(NT_LOOP_STMT);
+            break;
+        case PS_FOR_COND:
+            match(); // ;
+            callSub(PS_FOR_STEP, PS_COND);
+            break;
+        case PS_FOR_STEP:
+            match(); // ;
+            match(); // id
+            match(); // =
+            match(); // id
+            if (currentToken.kind == PLUS) match(); else match(); // +|-
+            parseStep();
+            match(); // )
+            callSub(PS_LOOP_END, PS_STMT);
+            break;
+        case PS_LOOP_END:
+            finishSub(NT_LOOP_STMT);
+            break;
+
+        // <条件> ::= <表达式> <关系运算符> <表达式> | <表达式>
+        // <关系运算符> ::= < | <= | > | >= | != | ==
+        case PS_COND:
+            callSub(PS_COND_RHS, PS_EXPR);
+            break;
+        case PS_COND_RHS:
+            // 检查是否接关系运算符
+            if (inSet(REL_OPS, kind)) {
+                match(); // 关系运算符
+                callSub(PS_COND_END, PS_EXPR);
+            } else {
+                finishSub(NT_CONDITION);
+            }
+            break;
+        case PS_COND_END:
+            finishSub(NT_CONDITION);
+            break;
+
+        // <赋值语句> ::= <标识符> = <表达式> | <标识符> '[' <表达式> ']' = <表达式>
+        case PS_ASSIGN:
+            match(); // id
+            if (currentToken.kind == LBRACK) {
+                match(); // [
+                callSub(PS_ASSIGN_INDEX, PS_EXPR);
+            } else {
+                match(); // =
+                callSub(PS_ASSIGN_END, PS_EXPR);
+            }
+            break;
+        case PS_ASSIGN_INDEX:
+            match(); // ]
+            match(); // =
+            callSub(PS_ASSIGN_END, PS_EXPR);
+            break;
+        case PS_ASSIGN_END:
+            finishSub(NT_ASSIGN_STMT);
+            break;
+
+        // <写语句> ::= printf '(' <字符串> , <表达式> ')' | printf '(' <字符串> ')' | printf '(' <表达式> ')'
+        case PS_PRINTF:
+            match(); // printf
+            match(); // (
+            if (currentToken.kind == STRCON) {
+                size_t strMark = beginNode();
+                match(); // string
+                finishNode(NT_STRING, strMark);
+                if (currentToken.kind == COMMA) {
+                    match(); // ,
+                    callSub(PS_PRINTF_END, PS_EXPR);
+                } else {
+                    nextState(PS_PRINTF_END);
+                }
+            } else {
+                callSub(PS_PRINTF_END, PS_EXPR);
+            }
+            break;
+        case PS_PRINTF_END:
+            match(); // )
+            finishSub(NT_PRINTF);
+            break;
+
+        // <返回语句> ::= return [ '(' <表达式> ')' ]
+        case PS_RETURN:
+            match(); // return
+            if (currentToken.kind == LPARENT) {
+                match(); // (
+                callSub(PS_RETURN_END, PS_EXPR);
+            } else {
+                finishSub(NT_RETURN_STMT);
+            }
+            break;
+        case PS_RETURN_END:
+            match(); // )
+            finishSub(NT_RETURN_STMT);
+            break;
+
+        // <表达式> ::= [+|-] <项> { <加法运算符> <项> }
+        case PS_EXPR:
+            if (inSet(ADD_OPS, kind)) {
+                match(); // [+|-]
+            }
+            callSub(PS_EXPR_NEXT, PS_TERM);
+            break;
+        case PS_EXPR_NEXT:
+            if (inSet(ADD_OPS, kind)) {
+                match(); // +|-
+                // outFile << "<加法运算符>" << endl;
+                callSub(PS_EXPR_NEXT, PS_TERM);
+            } else {
+                finishSub(NT_EXPRESSION);
+            }
+            break;
+
+        // <项> ::= <因子> { <乘法运算符> <因子> }
+        case PS_TERM:
+            callSub(PS_TERM_NEXT, PS_FACTOR);
+            break;
+        case PS_TERM_NEXT:
+            if (inSet(MUL_OPS, kind)) {
+                match(); // *|/
+                // outFile << "<乘法运算符>" << endl;
+                callSub(PS_TERM_NEXT, PS_FACTOR);
+            } else {
+                finishSub(NT_TERM);
+            }
+            break;
+
+        // <因子> ::= <标识符> | <标识符> '[' <表达式> ']' | '(' <表达式> ')' | <整数> | <字符> | <有返回值函数调用语句>
+        case PS_FACTOR:
+            switch (kind) {
+            case IDENFR: {
+                // id, id[exp], id(args)
+                const Token& next = peekToken(1);
+                if (next.kind == LPARENT) {
+                    callSub(PS_FACTOR_END, PS_CALL, NT_CALL_RET);
+                } else if (next.kind == LBRACK) {
+                    match(); // id
+                    match(); // [
+                    callSub(PS_FACTOR_CLOSE, PS_EXPR);
+                } else {
+                    match(); // id
+                    finishSub(NT_FACTOR);
+                }
+                break;
+            }
+            case LPARENT:
+                match(); // (
+                callSub(PS_FACTOR_CLOSE, PS_EXPR);
+                break;
+            case INTCON: case PLUS: case MINU:
+                // 整数可能带符号，或者不带
+                parseInteger();
+                finishSub(NT_FACTOR);
+                break;
+            case CHARCON:
+                match();
+                finishSub(NT_FACTOR);
+                break;
+            default:
+                finishSub(NT_FACTOR);
+            }
+            break;
+        case PS_FACTOR_CLOSE:
+            match(); // ] 或 )
+            finishSub(NT_FACTOR);
+            break;
+        case PS_FACTOR_END:
+            finishSub(NT_FACTOR);
+            break;
+
+        // <有返回值函数调用语句> ::= <标识符> '(' <值参数表> ')'
+        // <无返回值函数调用语句> 结构相同，只是标签不同 (由帧里的 kind 决定)
+        case PS_CALL:
+            match(); // id
+            match(); // (
+            callSub(PS_CALL_END, PS_ARGS);
+            break;
+        case PS_CALL_END:
+            match(); // )
+            finishSub(parseStack.back().kind);
+            break;
+
+        // <值参数表> ::= <表达式> { , <表达式> } | <空>
+        case PS_ARGS:
+            // 检查是否是表达式的开始
+            // 表达式开始集合：+, -, (, id, int, char
+            // 简单判断：如果不是右括号，就是参数
+            if (kind != RPARENT) {
+                callSub(PS_ARGS_NEXT, PS_EXPR);
+            } else {
+                finishSub(NT_VALUE_PARAMS);
+            }
+            break;
+        case PS_ARGS_NEXT:
+            if (kind == COMMA) {
+                match();
+                callSub(PS_ARGS_NEXT, PS_EXPR);
+            } else {
+                finishSub(NT_VALUE_PARAMS);
+            }
+            break;
+        }
+    }
+}
+
+// 对外的入口：各个成分都从这里进入状态机
+void parseStmtList() { runParser(PS_STMT_LIST); }
+void parseStatement() { runParser(PS_STMT); }
+void parseCondition() { runParser(PS_COND); }
+void parseExpression() { runParser(PS_EXPR); }
+
+// ==========================================
+// 5. 表驱动语法分析器
+// ==========================================
+
+// 上面的分析器是把文法逐条手工翻译成代码；这里换一种做法：文法按 BNF 写成一段文本，
+// 第一次用到时由生成器算出 FIRST/FOLLOW 集合并构造 LL(k) 分析表，
+// 之后由一个循环加一个符号栈查表分析，没有函数调用，改文法只需改这段文本。
+// 写法：
+//   <名字>    非终结符。名字出现在 tagNames 里的会建立语法树结点 (输出标签)，
+//             其余的 (如 <类型标识符>、<加法运算符>) 只是辅助规则，不输出
+//   大写单词  终结符，即单词类别码
+//   { }  重复零次或多次    [ ]  可选    ( )  分组    |  或    <空>  空串
+//   @名字     语义动作 (见 actionNames)，分析到这个位置时执行，此时 currentToken 是紧跟其后的单词
+//   ?名字     语义谓词 (见 predicateNames)，只能写在候选式开头：
+//             预读分不开的几个候选式，先试带谓词的那个，谓词不成立再换下一个
+// 符号表在这里和手写分析器里同样维护，语句里的函数调用按被调函数的返回类型区分两种标签。
+// 两个分析器只对合法的输入等价 (输出逐字节相同)：和手写分析器一样，这里也不做语法错误恢复，
+// 遇到不合法的输入时两者在不同的地方选错候选式，输出各不相同 (例如只有一个 int 时，
+// 手写分析器按 <变量说明> 输出，这里按 <声明头部> 输出)，都不能当作出错信息使用。
+// 只有查不到候选式、又没有 <空> 候选式可退时 (或在同一个单词上不停展开时) 表驱动分析器才停下报错，见 runTableParser
+const char* const grammarText = R"(
+<程序> ::= [ <常量说明> ] [ <变量说明> ] { <有返回值函数定义> | <无返回值函数定义> } <主函数>
+<常量说明> ::= CONSTTK <常量定义> SEMICN { CONSTTK <常量定义> SEMICN }
+<常量定义> ::= @类型 INTTK @常量 IDENFR ASSIGN <整数> { COMMA @常量 IDENFR ASSIGN <整数> }
+    | @类型 CHARTK @常量 IDENFR ASSIGN CHARCON { COMMA @常量 IDENFR ASSIGN CHARCON }
+<无符号整数> ::= INTCON
+<整数> ::= [ <加法运算符> ] <无符号整数>
+<声明头部> ::= <类型标识符> @函数 IDENFR
+<变量说明> ::= <变量定义> SEMICN { <变量定义> SEMICN }
+<变量定义> ::= <类型标识符> <变量名> { COMMA <变量名> }
+<变量名> ::= @变量 IDENFR [ LBRACK <无符号整数> RBRACK ]
+<类型标识符> ::= @类型 INTTK | @类型 CHARTK
+<有返回值函数定义> ::= <声明头部> @进入 LPARENT <参数表> RPARENT LBRACE <复合语句> RBRACE @退出
+<无返回值函数定义> ::= @类型 VOIDTK @函数 IDENFR @进入 LPARENT <参数表> RPARENT LBRACE <复合语句> RBRACE @退出
+<主函数> ::= VOIDTK MAINTK @进入 LPARENT RPARENT LBRACE <复合语句> RBRACE @退出
+<参数表> ::= <类型标识符> @变量 IDENFR { COMMA <类型标识符> @变量 IDENFR } | <空>
+<复合语句> ::= [ <常量说明> ] [ <变量说明> ] <语句列>
+<语句列> ::= { <语句> }
+<语句> ::= <条件语句> | <循环语句> | LBRACE <语句列> RBRACE
+    | ?有返回值函数 <有返回值函数调用语句> SEMICN | <无返回值函数调用语句> SEMICN
+    | <赋值语句> SEMICN | <读语句> SEMICN
+    | <写语句> SEMICN | SEMICN | <返回语句> SEMICN
+<赋值语句> ::= IDENFR ASSIGN <表达式> | IDENFR LBRACK <表达式> RBRACK ASSIGN <表达式>
+<条件语句> ::= IFTK LPARENT <条件> RPARENT <语句> [ ELSETK <语句> ]
+<条件> ::= <表达式> [ <关系运算符> <表达式> ]
+<关系运算符> ::= LSS | LEQ | GRE | GEQ | NEQ | EQL
+<循环语句> ::= WHILETK LPARENT <条件> RPARENT <语句>
+    | DOTK <语句> WHILETK LPARENT <条件> RPARENT
+    | FORTK LPARENT IDENFR ASSIGN <表达式> SEMICN <条件> SEMICN
+      IDENFR ASSIGN IDENFR <加法运算符> <步长> RPARENT <语句>
+<步长> ::= <无符号整数>
+<读语句> ::= SCANFTK LPARENT IDENFR { COMMA IDENFR } RPARENT
+<写语句> ::= PRINTFTK LPARENT ( <字符串> [ COMMA <表达式> ] | <表达式> ) RPARENT
+<字符串> ::= STRCON
+<返回语句> ::= RETURNTK [ LPARENT <表达式> RPARENT ]
+<表达式> ::= [ <加法运算符> ] <项> { <加法运算符> <项> }
+<加法运算符> ::= PLUS | MINU
+<项> ::= <因子> { <乘法运算符> <因子> }
+<乘法运算符> ::= MULT | DIV
+<因子> ::= IDENFR | IDENFR LBRACK <表达式> RBRACK | LPARENT <表达式> RPARENT
+    | <整数> | CHARCON | <有返回值函数调用语句>
+<有返回值函数调用语句> ::= IDENFR LPARENT <值参数表> RPARENT
+<无返回值函数调用语句> ::= IDENFR LPARENT <值参数表> RPARENT
+<值参数表> ::= <表达式> { COMMA <表达式> } | <空>
+)";
+
+// 语义动作
+enum GrammarAction : uint8_t { GA_TYPE, GA_CONST, GA_VAR, GA_FUNC, GA_ENTER, GA_LEAVE, GA_COUNT };
+const char* const actionNames[] = {
+    "@类型",  // 记下当前的类型标识符 (int/char/void)
+    "@常量",  // 把当前标识符登记为常量
+    "@变量",  // 登记为变量或数组
+    "@函数",  // 登记为函数，返回类型是最近记下的类型
+    "@进入",  // 进入新的作用域
+    "@退出"   // 退出作用域
+};
+
+// 语义谓词
+enum GrammarPredicate : uint8_t { GP_RETURNS_VALUE, GP_COUNT };
+const char* const predicateNames[] = {
+    "?有返回值函数"  // 当前标识符是有返回值的函数
+};
+
+// 预读的单词数上限。<程序> 要看到 int/char 之后的第二个单词才能区分变量说明和函数定义，需要 3 个
+const size_t LL_K = 3;
+
+// 生成的分析表
+// 符号编号：[0, terminalCount) 是终结符 (编号就是 TokenKind)，之后依次是非终结符、语义动作 (从 actionBase 起)；
+// 非终结符 A 的候选式是 [altBegin[A], altBegin[A + 1])，候选式 p 的右部是 rhs[rhsBegin[p], rhsBegin[p + 1])
+struct ParseTable {
+    vector<string> names;
+    size_t terminalCount = 0;
+    size_t actionBase = 0;
+    int16_t start = 0;
+    vector<int16_t> nodeKind;     // 非终结符对应的 NodeKind，辅助规则为 -1
+    vector<uint32_t> altBegin;
+    vector<uint32_t> rhsBegin;
+    vector<int16_t> rhs;
+    vector<int8_t> predicate;     // 候选式开头的谓词 (GrammarPredicate)，没有为 -1
+    vector<int16_t> predicateElse; // 谓词不成立时改选的候选式 (同一非终结符内的序号)
+    // 选择候选式的判定表：每行 terminalCount 格，按当前 (第 depth 个) 预读单词取一格。
+    // 格子里 >= 0 是选中的候选式序号，-1 表示查不到，<= -2 表示再看下一个单词、转到第 (-2 - 值) 行
+    vector<int32_t> decisionRow;  // 非终结符的第一行，只有一个候选式时为 -1
+    vector<int16_t> rows;
+    vector<int16_t> fallback;     // 查不到时的候选式：有 <空> 候选式就取它，否则 -1 (分析器停下报错)
+    vector<string> conflicts;     // 预读 LL_K 个单词仍无法区分、按先写的候选式优先解决的地方
+};
+
+// --- 生成器 ---
+
+// 读入 BNF 文本，展开 { } [ ] ( ) 为匿名辅助规则，得到 (非终结符名, 候选式列表) 的规则表
+struct GrammarReader {
+    vector<string> words;
+    size_t pos = 0;
+    vector<pair<string, vector<vector<string>>>> rules;
+    map<string, int> anonCount;
+
+    explicit GrammarReader(const char* text) {
+        for (const char* p = text; *p;) {
+            if (isspace((unsigned char)*p)) { p++; continue; }
+            const char* begin = p;
+            if (*p == '<') {
+                while (*p && *p != '>') p++;
+                if (*p) p++;
+            } else if (strncmp(p, "::=", 3) == 0) {
+                p += 3;
+            } else if (isupper((unsigned char)*p)) {
+                while (isupper((unsigned char)*p)) p++;
+            } else if (*p == '@' || *p == '?') {
+                while (*p && !isspace((unsigned char)*p)) p++;
+            } else {
+                p++;
+            }
+            words.emplace_back(begin, p);
+        }
+    }
+
+    bool atRuleStart() const { return pos + 1 < words.size() && words[pos + 1] == "::="; }
+
+    // 读一组以 | 分隔的候选式，遇到右括号或下一条规则时停止
+    vector<vector<string>> readAlternatives(const string& owner) {
+        vector<vector<string>> alts(1);
+        while (pos < words.size() && !atRuleStart()) {
+            const string& w = words[pos];
+            if (w == ")" || w == "]" || w == "}") break;
+            pos++;
+            if (w == "|") {
+                alts.emplace_back();
+            } else if (w == "{" || w == "[" || w == "(") {
+                // 匿名规则：{ X } => R ::= X R | <空>；[ X ] => R ::= X | <空>；( X ) => R ::= X
+                vector<vector<string>> inner = readAlternatives(owner);
+                pos++; // 右括号
+                string name = owner + "#" + to_string(++anonCount[owner]);
+                if (w == "{") {
+                    for (auto& alt : inner) alt.push_back(name);
+                }
+                if (w != "(") inner.emplace_back();
+                rules.push_back({name, inner});
+                alts.back().push_back(name);
+            } else if (w != "<空>") {
+                alts.back().push_back(w);
+            }
+        }
+        return alts;
+    }
+
+    void read() {
+        while (pos < words.size()) {
+            string name = words[pos];
+            pos += 2; // 名字和 ::=
+            vector<vector<string>> alts = readAlternatives(name);
+            rules.push_back({name, alts});
+        }
+    }
+};
+
+// 长度不超过 LL_K 的单词序列，压缩进一个整数：每个单词占 8 位，最高 8 位是长度
+inline uint32_t seqLen(uint32_t s) { return s >> 24; }
+inline uint32_t seqAt(uint32_t s, uint32_t i) { return (s >> (8 * i)) & 0xFF; }
+inline uint32_t seqPush(uint32_t s, uint32_t t) { return (s | (t << (8 * seqLen(s)))) + (1u << 24); }
+
+// 序列已经够长，或者已经到达文件末尾 (EOF 之后不会再有单词)
+inline bool seqComplete(uint32_t s, uint32_t eof) {
+    uint32_t len = seqLen(s);
+    return len == LL_K || (len > 0 && seqAt(s, len - 1) == eof);
+}
+
+typedef set<uint32_t> SeqSet;
+
+// 连接后截取前 LL_K 个单词：{ (ab)[0, k) | a ∈ left, b ∈ right }
+void seqConcat(const SeqSet& left, const SeqSet& right, uint32_t eof, SeqSet& out) {
+    for (uint32_t a : left) {
+        if (seqComplete(a, eof)) {
+            out.insert(a);
+            continue;
+        }
+        for (uint32_t b : right) {
+            uint32_t s = a;
+            for (uint32_t i = 0; i < seqLen(b) && !seqComplete(s, eof); i++) s = seqPush(s, seqAt(b, i));
+            out.insert(s);
+        }
+    }
+}
+
+string seqText(const ParseTable& t, uint32_t s) {
+    string text;
+    for (uint32_t i = 0; i < seqLen(s); i++) text += (i ? " " : "") + t.names[seqAt(s, i)];
+    return text;
+}
+
+ParseTable buildParseTable(const char* text) {
+    GrammarReader reader(text);
+    reader.read();
+    ParseTable t;
+
+    // 1. 符号编号：终结符就是全部单词类别 (含 EOF)，非终结符按规则顺序，最后是语义动作
+    map<string, int16_t> terminalIds, ntIds, actionIds, predicateIds;
+    for (int k = 0; k < TK_NONE; k++) {
+        terminalIds[tokenNames[k]] = (int16_t)k;
+        t.names.push_back(tokenNames[k]);
+    }
+    for (const auto& rule : reader.rules) ntIds.insert({rule.first, (int16_t)ntIds.size()});
+    t.terminalCount = t.names.size();
+    uint32_t eof = TK_EOF;
+    size_t ntCount = reader.rules.size();
+    for (const auto& rule : reader.rules) t.names.push_back(rule.first);
+    t.actionBase = t.names.size();
+    for (int k = 0; k < GA_COUNT; k++) {
+        actionIds[actionNames[k]] = (int16_t)(t.actionBase + k);
+        t.names.push_back(actionNames[k]);
+    }
+    for (int k = 0; k < GP_COUNT; k++) predicateIds[predicateNames[k]] = (int16_t)k;
+    t.start = (int16_t)(t.terminalCount + ntIds[reader.words[0]]);
+    auto isSymbol = [&](int16_t sym) { return (size_t)sym < t.actionBase; }; // 终结符或非终结符 (不是动作)
+
+    // 2. 产生式
+    for (size_t a = 0; a < ntCount; a++) {
+        const string& name = reader.rules[a].first;
+        int16_t kind = -1;
+        for (int k = 0; k < NT_COUNT; k++) {
+            if (name == tagNames[k]) kind = (int16_t)k;
+        }
+        t.nodeKind.push_back(kind);
+        t.altBegin.push_back((uint32_t)(t.rhsBegin.size()));
+        t.fallback.push_back(-1);
+        for (const auto& alt : reader.rules[a].second) {
+            if (alt.empty()) t.fallback[a] = (int16_t)(t.rhsBegin.size() - t.altBegin[a]);
+            t.rhsBegin.push_back((uint32_t)t.rhs.size());
+            t.predicate.push_back(-1);
+            t.predicateElse.push_back(-1);
+            for (size_t i = 0; i < alt.size(); i++) {
+                const string& sym = alt[i];
+                if (terminalIds.count(sym)) {
+                    t.rhs.push_back(terminalIds[sym]);
+                } else if (ntIds.count(sym)) {
+                    t.rhs.push_back((int16_t)(t.terminalCount + ntIds[sym]));
+                } else if (actionIds.count(sym)) {
+                    t.rhs.push_back(actionIds[sym]);
+                } else if (i == 0 && predicateIds.count(sym)) {
+                    t.predicate.back() = (int8_t)predicateIds[sym];
+                } else {
+                    cerr << "Grammar error: unknown " << sym << " in " << name << endl;
+                    exit(1);
+                }
+            }
+        }
+    }
+    t.altBegin.push_back((uint32_t)t.rhsBegin.size());
+    t.rhsBegin.push_back((uint32_t)t.rhs.size());
+
+    // 3. FIRST_k：反复用候选式更新，直到不再变化
+    vector<SeqSet> first(ntCount);
+    auto firstOf = [&](size_t from, size_t to, SeqSet& out) {
+        out = {0}; // 空串
+        for (size_t i = from; i < to && !out.empty(); i++) {
+            int16_t sym = t.rhs[i];
+            if (!isSymbol(sym)) continue; // 语义动作不占单词
+            SeqSet next;
+            if ((size_t)sym < t.terminalCount) seqConcat(out, {seqPush(0, sym)}, eof, next);
+            else seqConcat(out, first[sym - t.terminalCount], eof, next);
+            out.swap(next);
+        }
+    };
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t a = 0; a < ntCount; a++) {
+            for (uint32_t p = t.altBegin[a]; p < t.altBegin[a + 1]; p++) {
+                SeqSet s;
+                firstOf(t.rhsBegin[p], t.rhsBegin[p + 1], s);
+                size_t before = first[a].size();
+                first[a].insert(s.begin(), s.end());
+                changed |= first[a].size() != before;
+            }
+        }
+    }
+
+    // 4. FOLLOW_k：A ::= α B β 时 FOLLOW(B) ⊇ FIRST(β) · FOLLOW(A)
+    vector<SeqSet> follow(ntCount);
+    follow[t.start - t.terminalCount].insert(seqPush(0, eof));
+    vector<SeqSet> suffixFirst(t.rhs.size()); // suffixFirst[i] = FIRST(rhs 中 i 之后到候选式末尾的部分)
+    for (size_t p = 0; p + 1 < t.rhsBegin.size(); p++) {
+        for (uint32_t i = t.rhsBegin[p]; i < t.rhsBegin[p + 1]; i++) firstOf(i + 1, t.rhsBegin[p + 1], suffixFirst[i]);
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t a = 0; a < ntCount; a++) {
+            for (uint32_t i = t.rhsBegin[t.altBegin[a]]; i < t.rhsBegin[t.altBegin[a + 1]]; i++) {
+                if ((size_t)t.rhs[i] < t.terminalCount || !isSymbol(t.rhs[i])) continue;
+                SeqSet& target = follow[t.rhs[i] - t.terminalCount];
+                size_t before = target.size();
+                seqConcat(suffixFirst[i], follow[a], eof, target);
+                changed |= target.size() != before;
+            }
+        }
+    }
+
+    // 5. 判定表：每个候选式的预读集合 FIRST(候选式) · FOLLOW(A) 按单词逐层分组成一棵树，
+    //    某个前缀只属于一个候选式时就停在这一层；再往后看也分不开的，取先写的候选式
+    //    (悬空 else 归最近的 if、表达式开头的 +/- 归 <表达式> 而不是 <整数>，都靠这条规则)，
+    //    先写的候选式带谓词时，运行时谓词不成立就改选下一个
+    // 前缀之后的每一种延续是否都同样属于这几个候选式 (是的话多看几个单词也没用)
+    function<bool(const vector<pair<uint32_t, int16_t>>&, uint32_t, size_t)> inseparable =
+        [&](const vector<pair<uint32_t, int16_t>>& items, uint32_t depth, size_t altCount) {
+        if (depth == LL_K) return true;
+        map<uint32_t, vector<pair<uint32_t, int16_t>>> groups;
+        for (const auto& item : items) {
+            if (depth < seqLen(item.first)) groups[seqAt(item.first, depth)].push_back(item);
+        }
+        for (const auto& g : groups) {
+            set<int16_t> alts;
+            for (const auto& item : g.second) alts.insert(item.second);
+            if (alts.size() != altCount || !inseparable(g.second, depth + 1, altCount)) return false;
+        }
+        return true;
+    };
+    function<int32_t(size_t, const vector<pair<uint32_t, int16_t>>&, uint32_t)> buildRow =
+        [&](size_t a, const vector<pair<uint32_t, int16_t>>& items, uint32_t depth) {
+        int32_t row = (int32_t)(t.rows.size() / t.terminalCount);
+        t.rows.resize(t.rows.size() + t.terminalCount, -1);
+        map<uint32_t, vector<pair<uint32_t, int16_t>>> groups;
+        for (const auto& item : items) {
+            if (depth < seqLen(item.first)) groups[seqAt(item.first, depth)].push_back(item);
+        }
+        for (const auto& g : groups) {
+            set<int16_t> alts;
+            for (const auto& item : g.second) alts.insert(item.second);
+            int16_t cell = *alts.begin();
+            if (alts.size() > 1 && g.first != eof && !inseparable(g.second, depth + 1, alts.size())) {
+                cell = (int16_t)(-2 - buildRow(a, g.second, depth + 1));
+            } else if (alts.size() > 1 && t.predicate[t.altBegin[a] + cell] >= 0) {
+                t.predicateElse[t.altBegin[a] + cell] = *next(alts.begin());
+            } else if (alts.size() > 1) {
+                uint32_t prefix = 0;
+                for (uint32_t i = 0; i <= depth; i++) prefix = seqPush(prefix, seqAt(g.second[0].first, i));
+                t.conflicts.push_back(t.names[t.terminalCount + a] + " on " + seqText(t, prefix)
+                                      + ": alternative " + to_string(cell));
+            }
+            t.rows[row * t.terminalCount + g.first] = cell;
+        }
+        return row;
+    };
+    for (size_t a = 0; a < ntCount; a++) {
+        t.decisionRow.push_back(-1);
+        if (t.altBegin[a + 1] - t.altBegin[a] < 2) continue;
+        vector<pair<uint32_t, int16_t>> items;
+        for (uint32_t p = t.altBegin[a]; p < t.altBegin[a + 1]; p++) {
+            SeqSet alt, lookahead;
+            firstOf(t.rhsBegin[p], t.rhsBegin[p + 1], alt);
+            seqConcat(alt, follow[a], eof, lookahead);
+            for (uint32_t s : lookahead) items.push_back({s, (int16_t)(p - t.altBegin[a])});
+        }
+        t.decisionRow[a] = buildRow(a, items, 0);
+    }
+    return t;
+}
+
+// 分析表只生成一次，各线程共用 (只读)
+const ParseTable& parseTable() {
+    static const ParseTable table = buildParseTable(grammarText);
+    return table;
+}
+
+// --- 分析器 ---
+
+// 符号栈：>= 0 是待分析的文法符号或语义动作，< 0 是结点结束标记 (~NodeKind)；
+// llMarks 记录还没结束的结点的子结点起点
+thread_local vector<int16_t> llStack;
+thread_local vector<uint32_t> llMarks;
+thread_local TokenKind llDeclType = INTTK; // @类型 记下的类型，供之后的 @常量/@变量/@函数 使用
+// 表驱动分析器在输入不合文法、无法继续时停下的位置：出错的单词和当时在选候选式的非终结符 (-1 表示没有出错)。
+// 分析时输入缓冲区可能在词法线程或主线程手里，这里只记单词，由 checkEndOfInput 换算成出错原因
+struct TableParseError {
+    int16_t nonterminal = -1;
+    bool stalled = false; // true: 在同一个单词上反复展开；false: 没有候选式可选
+    Token token{};
+};
+thread_local TableParseError llError;
+// 各个非终结符上一次展开时已经读入的单词数和展开时符号栈的深度，用来发现在同一个单词上的循环展开
+struct LastExpansion {
+    uint32_t consumed;
+    uint32_t depth;
+};
+thread_local vector<LastExpansion> llLastExpansion;
+
+void runAction(GrammarAction action) {
+    switch (action) {
+    case GA_TYPE: llDeclType = currentToken.kind; break;
+    case GA_CONST: declareCurrent(SK_CONST, llDeclType); break;
+    case GA_VAR: declareVariable(llDeclType); break;
+    case GA_FUNC: declareCurrent(SK_FUNC, llDeclType); break;
+    case GA_ENTER: scopes.push(); break;
+    case GA_LEAVE: scopes.pop(); break;
+    default: break;
+    }
+}
+
+bool testPredicate(GrammarPredicate predicate) {
+    switch (predicate) {
+    case GP_RETURNS_VALUE: return callKind(currentToken) == NT_CALL_RET;
+    default: return true;
+    }
+}
+
+// 按判定表为非终结符 a 选候选式：从当前单词开始，需要时再往后预读
+int chooseAlternative(const ParseTable& t, size_t a) {
+    int32_t row = t.decisionRow[a];
+    if (row < 0) return 0;
+    TokenKind term = currentToken.kind;
+    for (size_t depth = 1;; depth++) {
+        int16_t cell = t.rows[row * t.terminalCount + term];
+        if (cell == -1) return t.fallback[a];
+        if (cell >= 0) {
+            while (cell >= 0 && t.predicate[t.altBegin[a] + cell] >= 0
+                   && !testPredicate((GrammarPredicate)t.predicate[t.altBegin[a] + cell])) {
+                cell = t.predicateElse[t.altBegin[a] + cell];
+            }
+            return cell;
+        }
+        row = -2 - cell;
+        term = peekToken(depth).kind;
+    }
+}
+
+// 记下第一个出错的地方
+void setTableParseError(int16_t sym, bool stalled) {
+    if (llError.nonterminal < 0) llError = {sym, stalled, currentToken};
+}
+
+// 从文法符号 start 开始分析，语法树留在 astStack 上。
+// 输入不合文法、没有候选式可选时停下，把还没结束的结点依次结束 (语法树仍然完整)，出错的地方记在 llError，返回 false
+bool runTableParser(int16_t start) {
+    const ParseTable& t = parseTable();
+    llStack.clear();
+    llMarks.clear();
+    llStack.push_back(start);
+    // 同一个非终结符在没有读入新单词时再次展开是正常的，只要符号栈比上次浅：
+    // 比如 } 前面嵌套了很多层 if，每一层都在这个 } 上展开一次 [ ELSETK <语句> ] 的辅助规则，一层比一层浅。
+    // 栈没有变浅就是它自己展开出来的 (如 {<语句>} 的辅助规则每次都选中一个什么也不读的候选式)，会一直循环下去
+    llLastExpansion.assign(t.actionBase - t.terminalCount, {UINT32_MAX, 0});
+    uint32_t consumed = 0;
+    bool ok = true;
+    while (!llStack.empty()) {
+        int16_t sym = llStack.back();
+        llStack.pop_back();
+        if (sym < 0) {
+            finishNode((NodeKind)~sym, llMarks.back());
+            llMarks.pop_back();
+        } else if (!ok) {
+            // 出错后只结束结点，并退出已经进入的作用域
+            if ((size_t)sym == t.actionBase + GA_LEAVE) runAction(GA_LEAVE);
+        } else if ((size_t)sym < t.terminalCount) {
+            match();
+            consumed++;
+        } else if ((size_t)sym >= t.actionBase) {
+            runAction((GrammarAction)(sym - t.actionBase));
+        } else {
+            size_t a = sym - t.terminalCount;
+            int alt = chooseAlternative(t, a);
+            LastExpansion& last = llLastExpansion[a];
+            bool stalled = last.consumed == consumed && llStack.size() >= last.depth;
+            last = {consumed, (uint32_t)llStack.size()};
+            if (t.nodeKind[a] >= 0) {
+                llStack.push_back((int16_t)~t.nodeKind[a]);
+                llMarks.push_back((uint32_t)beginNode());
+            }
+            if (alt < 0) {
+                setTableParseError(sym, false);
+                ok = false;
+            } else if (stalled) {
+                setTableParseError(sym, true);
+                ok = false;
+            } else {
+                uint32_t p = t.altBegin[a] + alt;
+                for (uint32_t i = t.rhsBegin[p + 1]; i > t.rhsBegin[p]; i--) llStack.push_back(t.rhs[i - 1]);
+            }
+        }
+    }
+    return ok;
+}
+
+// 与 parseProgram 输出完全相同的语法树 (输入合法时)；出错时返回 false
+bool parseProgramByTable() {
+    return runTableParser(parseTable().start);
+}
+
+// 按名字找文法符号 (如 "<无返回值函数定义>")，没有时返回 -1
+int16_t tableSymbol(const string& name) {
+    const vector<string>& names = parseTable().names;
+    auto it = find(names.begin(), names.end(), name);
+    return it == names.end() ? -1 : (int16_t)(it - names.begin());
+}
+
+// 调试输出：规则、判定表和冲突
+void dumpParseTable(ostream& out) {
+    const ParseTable& t = parseTable();
+    size_t ntCount = t.actionBase - t.terminalCount;
+    out << t.terminalCount << " terminals, " << ntCount << " nonterminals, "
+        << t.rhsBegin.size() - 1 << " alternatives, " << t.rows.size() / t.terminalCount << " rows ("
+        << t.rows.size() * sizeof(int16_t) << " bytes), LL(" << LL_K << ")\n";
+    // 把判定树展开成 "预读单词序列 -> 候选式"
+    function<void(int32_t, const string&)> dumpRow = [&](int32_t row, const string& prefix) {
+        for (size_t term = 0; term < t.terminalCount; term++) {
+            int16_t cell = t.rows[row * t.terminalCount + term];
+            string seq = prefix + (prefix.empty() ? "" : " ") + t.names[term];
+            if (cell >= 0) out << "    " << seq << " -> " << cell << "\n";
+            else if (cell <= -2) dumpRow(-2 - cell, seq);
+        }
+    };
+    for (size_t a = 0; a < ntCount; a++) {
+        out << t.names[t.terminalCount + a] << (t.nodeKind[a] < 0 ? "" : " *") << "\n";
+        for (uint32_t p = t.altBegin[a]; p < t.altBegin[a + 1]; p++) {
+            out << "  " << p - t.altBegin[a] << ":";
+            if (t.predicate[p] >= 0) out << " " << predicateNames[t.predicate[p]];
+            if (t.rhsBegin[p] == t.rhsBegin[p + 1]) out << " <空>";
+            for (uint32_t i = t.rhsBegin[p]; i < t.rhsBegin[p + 1]; i++) out << " " << t.names[t.rhs[i]];
+            if (t.predicate[p] >= 0) out << " (else " << t.predicateElse[p] << ")";
+            out << "\n";
+        }
+        if (t.decisionRow[a] >= 0) dumpRow(t.decisionRow[a], "");
+    }
+    for (const string& c : t.conflicts) out << "conflict: " << c << "\n";
+}
+
+// ==========================================
+// 6. 字节码编译器与虚拟机
+// ==========================================
+
+// 寄存器式字节码：每个函数的栈帧是一段连续的 32 位槽，依次放参数、局部变量 (含数组)、表达式的临时量，
+// 指令的操作数直接是槽号，读局部变量不需要单独的取数指令；全局量在另一块区域，用 GETG/SETG 访问。
+// 条件和跳转合成一条比较转移指令，常量表达式在编译时算好
+enum Opcode : uint8_t {
+    OP_LOADK,   // a = 立即数 b
+    OP_MOV,     // a = b
+    OP_GETG,    // a = 全局[b]
+    OP_SETG,    // 全局[a] = b
+    OP_ADD,     // a = b + c
+    OP_SUB,     // a = b - c
+    OP_MUL,     // a = b * c
+    OP_DIV,     // a = b / c
+    OP_ADDI,    // a = b + 立即数 c
+    OP_NEG,     // a = -b
+    OP_LOADA,   // a = 局部数组 b 的第 c 个元素
+    OP_STOREA,  // 局部数组 a 的第 b 个元素 = c
+    OP_LOADGA,  // a = 全局数组 b 的第 c 个元素
+    OP_STOREGA, // 全局数组 a 的第 b 个元素 = c
+    OP_JMP,     // 跳到 a
+    OP_JZ,      // b == 0 时跳到 a
+    OP_JNZ,     // b != 0 时跳到 a
+    OP_JEQ,     // b == c 时跳到 a (以下同)
+    OP_JNE,
+    OP_JLT,
+    OP_JLE,
+    OP_JGT,
+    OP_JGE,
+    OP_CALL,    // 调用函数 a，实参在从 b 开始的连续槽里，返回值放到 c (c < 0 表示不要)
+    OP_RET,     // 返回 a
+    OP_RETV,    // 无返回值返回
+    OP_READI,   // 读一个整数到 a
+    OP_READC,   // 读一个字符到 a (跳过空白)
+    OP_PRINTS,  // 输出字符串常量 a
+    OP_PRINTI,  // 按整数输出 a
+    OP_PRINTC,  // 按字符输出 a
+    OP_PRINTNL, // 换行
+    OP_HALT,
+    OP_COUNT
+};
+
+const char* const opcodeNames[] = {
+    "LOADK", "MOV", "GETG", "SETG", "ADD", "SUB", "MUL", "DIV", "ADDI", "NEG",
+    "LOADA", "STOREA", "LOADGA", "STOREGA", "JMP", "JZ", "JNZ", "JEQ", "JNE", "JLT", "JLE", "JGT", "JGE",
+    "CALL", "RET", "RETV", "READI", "READC", "PRINTS", "PRINTI", "PRINTC", "PRINTNL", "HALT"
+};
+
+struct Instr {
+    Opcode op;
+    int32_t a, b, c;
+};
+
+struct FuncInfo {
+    string name;
+    TokenKind type = VOIDTK; // 返回类型
+    uint32_t entry = 0;      // 第一条指令
+    uint32_t params = 0;     // 参数占槽 [0, params)
+    uint32_t locals = 0;     // 参数之后的局部变量槽数，调用时清零
+    uint32_t frameSize = 0;  // 参数 + 局部变量 + 临时量
+};
+
+// 数组：首元素的槽号 (局部数组相对栈帧，全局数组相对全局区) 和长度
+struct ArrayInfo {
+    int32_t base;
+    int32_t len;
+};
+
+struct Bytecode {
+    vector<Instr> code;
+    vector<uint32_t> offsets; // 每条指令对应的源程序位置，运行时报错用
+    vector<FuncInfo> funcs;
+    vector<ArrayInfo> arrays;
+    vector<string> strings;
+    uint32_t globalSize = 0;
+    uint32_t mainFunc = 0;
+};
+
+// --- 编译器：遍历语法树生成字节码 ---
+
+// 名字在编译时代表的东西
+enum NameKind : uint8_t { NK_NONE, NK_CONST, NK_LOCAL, NK_GLOBAL, NK_LOCAL_ARRAY, NK_GLOBAL_ARRAY, NK_FUNC };
+
+struct NameRef {
+    NameKind kind = NK_NONE;
+    TokenKind type = INTTK;
+    int32_t value = 0; // 常量值 / 槽号 / 数组编号 / 函数编号
+};
+
+// 表达式的结果：编译时已知的常量，或者某个槽
+struct Operand {
+    bool isConst;
+    int32_t value; // 常量值或槽号
+};
+
+// 嵌套超过这么多层的语句/表达式不编译 (编译器是递归的，再深会耗尽调用栈)
+const int COMPILE_NEST_LIMIT = 2000;
+
+class BytecodeCompiler {
+public:
+    // 编译整棵语法树；出错时返回 false，err 是第一个错误
+    bool compile(uint32_t root, Bytecode& out, string& err) {
+        bc = &out;
+        globalNames.assign(symbols.size(), NameRef());
+        localNames.assign(symbols.size(), NameRef());
+        // 先登记全局量和所有函数，函数体里可以调用后面定义的函数
+        const AstNode& program = astNodes[root];
+        for (uint32_t i = 0; i < program.count; i++) {
+            uint32_t ref = astChildren[program.first + i];
+            const AstNode& n = astNodes[ref];
+            if (n.kind == NT_CONST_DECL) constDecl(ref, true);
+            else if (n.kind == NT_VAR_DECL) varDecl(ref, true);
+            else {
+                FuncInfo f;
+                uint32_t name = 0;
+                if (n.kind == NT_FUNC_RET) {
+                    const AstNode& head = astNodes[childAt(n, 0)];
+                    f.type = tokenAt(childAt(head, 0)).kind;
+                    name = childAt(head, 1);
+                } else {
+                    name = childAt(n, 1);
+                }
+                f.name = string(tokenText(tokenAt(name)));
+                if (n.kind != NT_MAIN_FUNC) f.params = (astNodes[childAt(n, n.count - 5)].count + 1) / 3;
+                if (n.kind == NT_MAIN_FUNC) bc->mainFunc = (uint32_t)bc->funcs.size();
+                else declare(tokenAt(name), {NK_FUNC, f.type, (int32_t)bc->funcs.size()}, true);
+                bc->funcs.push_back(f);
+            }
+        }
+        uint32_t funcId = 0;
+        for (uint32_t i = 0; i < program.count; i++) {
+            uint32_t ref = astChildren[program.first + i];
+            NodeKind kind = astNodes[ref].kind;
+            if (kind == NT_FUNC_RET || kind == NT_FUNC_VOID || kind == NT_MAIN_FUNC) function(ref, funcId++);
+        }
+        err = error;
+        return error.empty();
+    }
+
+private:
+    Bytecode* bc = nullptr;
+    string error;
+    vector<NameRef> globalNames, localNames; // 按驻留编号索引
+    vector<uint32_t> localSyms;              // 当前函数登记过的名字，换函数时清掉
+    FuncInfo* func = nullptr;
+    bool inMain = false;
+    int32_t nextSlot = 0;   // 下一个局部变量槽
+    int32_t localsEnd = 0;  // 临时量从这里开始
+    int32_t tempTop = 0;    // 下一个临时量
+    int32_t frameSize = 0;
+    uint32_t at = 0;        // 正在编译的单词位置，记到生成的指令上
+    int depth = 0;
+
+    static uint32_t childAt(const AstNode& n, uint32_t i) { return astChildren[n.first + i]; }
+    static const Token& tokenAt(uint32_t ref) { return astTokens[refIndex(ref)]; }
+    static bool isToken(const AstNode& n, uint32_t i, TokenKind kind) {
+        uint32_t ref = childAt(n, i);
+        return isTokenRef(ref) && tokenAt(ref).kind == kind;
+    }
+
+    void fail(const Token& tk, const string& msg) {
+        if (!error.empty()) return;
+        SourcePos pos = resolvePos(tk.offset);
+        error = "line " + to_string(pos.line) + ", column " + to_string(pos.column) + ": " + msg;
+    }
+
+    // 进入一层嵌套 (调用方随后总要 depth--)；太深时报错并返回 false
+    bool enter(const Token& tk) {
+        if (++depth <= COMPILE_NEST_LIMIT) return true;
+        fail(tk, "nesting too deep");
+        return false;
+    }
+
+    uint32_t emit(Opcode op, int32_t a = 0, int32_t b = 0, int32_t c = 0) {
+        bc->code.push_back({op, a, b, c});
+        bc->offsets.push_back(at);
+        return (uint32_t)bc->code.size() - 1;
+    }
+
+    // 把跳转指令 j 的目标改成当前位置；NO_JUMP 表示条件恒定、没有生成跳转
+    static constexpr uint32_t NO_JUMP = UINT32_MAX;
+    void patch(uint32_t j) {
+        if (j != NO_JUMP) bc->code[j].a = (int32_t)bc->code.size();
+    }
+
+    int32_t newTemp() {
+        frameSize = max(frameSize, tempTop + 1);
+        return tempTop++;
+    }
+
+    // --- 名字 ---
+
+    void declare(const Token& name, NameRef ref, bool global) {
+        NameRef& slot = (global ? globalNames : localNames)[name.sym];
+        if (slot.kind != NK_NONE) {
+            fail(name, "redefinition of " + string(tokenText(name)));
+            return;
+        }
+        slot = ref;
+        if (!global) localSyms.push_back(name.sym);
+    }
+
+    const NameRef& lookup(const Token& name) {
+        const NameRef& local = localNames[name.sym];
+        const NameRef& ref = local.kind != NK_NONE ? local : globalNames[name.sym];
+        if (ref.kind == NK_NONE) fail(name, "undefined name " + string(tokenText(name)));
+        return ref;
+    }
+
+    // <无符号整数> / <整数> 的值 (按 32 位补码回绕)
+    static int32_t unsignedValue(uint32_t node) {
+        uint32_t v = 0;
+        for (char ch : tokenText(tokenAt(childAt(astNodes[node], 0)))) v = v * 10 + (uint32_t)(ch - '0');
+        return (int32_t)v;
+    }
+    static int32_t integerValue(uint32_t node) {
+        const AstNode& n = astNodes[node];
+        int32_t v = unsignedValue(childAt(n, n.count - 1));
+        return n.count == 2 && tokenAt(childAt(n, 0)).kind == MINU ? (int32_t)(0u - (uint32_t)v) : v;
+    }
+
+    // <常量说明> ::= const <常量定义> ; { const <常量定义> ; }
+    void constDecl(uint32_t node, bool global) {
+        const AstNode& n = astNodes[node];
+        for (uint32_t i = 1; i < n.count; i += 3) {
+            const AstNode& def = astNodes[childAt(n, i)];
+            TokenKind type = tokenAt(childAt(def, 0)).kind;
+            for (uint32_t j = 1; j < def.count; j += 4) {
+                uint32_t value = childAt(def, j + 2);
+                int32_t v = type == CHARTK ? charValue(tokenAt(value)) : integerValue(value);
+                declare(tokenAt(childAt(def, j)), {NK_CONST, type, v}, global);
+            }
+        }
+    }
+
+    // <变量说明> ::= <变量定义> ; { <变量定义> ; }
+    void varDecl(uint32_t node, bool global) {
+        const AstNode& n = astNodes[node];
+        for (uint32_t i = 0; i < n.count; i += 2) {
+            const AstNode& def = astNodes[childAt(n, i)];
+            TokenKind type = tokenAt(childAt(def, 0)).kind;
+            for (uint32_t j = 1; j < def.count;) {
+                const Token& name = tokenAt(childAt(def, j));
+                if (j + 1 < def.count && isToken(def, j + 1, LBRACK)) {
+                    int32_t len = unsignedValue(childAt(def, j + 2));
+                    if (len <= 0) fail(name, "bad array size");
+                    declare(name, {global ? NK_GLOBAL_ARRAY : NK_LOCAL_ARRAY, type, (int32_t)bc->arrays.size()}, global);
+                    bc->arrays.push_back({global ? (int32_t)bc->globalSize : nextSlot, len});
+                    if (global) bc->globalSize += (uint32_t)max(len, 0);
+                    else nextSlot += max(len, 0);
+                    j += 5;
+                } else {
+                    declare(name, {global ? NK_GLOBAL : NK_LOCAL, type, global ? (int32_t)bc->globalSize++ : nextSlot++}, global);
+                    j += 2;
+                }
+            }
+        }
+    }
+
+    // --- 函数 ---
+
+    // <有返回值函数定义> / <无返回值函数定义> / <主函数>
+    void function(uint32_t node, uint32_t id) {
+        const AstNode& n = astNodes[node];
+        func = &bc->funcs[id];
+        func->entry = (uint32_t)bc->code.size();
+        inMain = n.kind == NT_MAIN_FUNC;
+        for (uint32_t sym : localSyms) localNames[sym] = NameRef();
+        localSyms.clear();
+        nextSlot = 0;
+        if (!inMain) {
+            // <参数表> ::= <类型标识符> <标识符> { , <类型标识符> <标识符> } | <空>
+            const AstNode& params = astNodes[childAt(n, n.count - 5)];
+            for (uint32_t i = 0; i < params.count; i += 3) {
+                declare(tokenAt(childAt(params, i + 1)), {NK_LOCAL, tokenAt(childAt(params, i)).kind, nextSlot++}, false);
+            }
+        }
+        // <复合语句> ::= [ <常量说明> ] [ <变量说明> ] <语句列>
+        const AstNode& body = astNodes[childAt(n, n.count - 2)];
+        for (uint32_t i = 0; i + 1 < body.count; i++) {
+            uint32_t ref = childAt(body, i);
+            if (astNodes[ref].kind == NT_CONST_DECL) constDecl(ref, false);
+            else varDecl(ref, false);
+        }
+        localsEnd = nextSlot;
+        frameSize = localsEnd;
+        func->locals = (uint32_t)localsEnd - func->params;
+        stmtList(childAt(body, body.count - 1));
+        emit(inMain ? OP_HALT : OP_RETV);
+        func->frameSize = (uint32_t)frameSize;
+    }
+
+    // --- 语句 ---
+
+    void stmtList(uint32_t node) {
+        const AstNode& n = astNodes[node];
+        for (uint32_t i = 0; i < n.count; i++) stmt(childAt(n, i));
+    }
+
+    // <语句>：临时量在语句之间不保留
+    void stmt(uint32_t node) {
+        const AstNode& n = astNodes[node];
+        tempTop = localsEnd;
+        uint32_t first = childAt(n, 0);
+        if (isTokenRef(first)) {
+            if (tokenAt(first).kind == LBRACE) {
+                if (enter(tokenAt(first))) stmtList(childAt(n, 1));
+                depth--;
+            }
+            return;
+        }
+        switch (astNodes[first].kind) {
+        case NT_COND_STMT: condStmt(first); break;
+        case NT_LOOP_STMT: loopStmt(first); break;
+        case NT_CALL_RET:
+        case NT_CALL_VOID: call(first, -1, false); break;
+        case NT_ASSIGN_STMT: assignStmt(first); break;
+        case NT_SCANF: scanfStmt(first); break;
+        case NT_PRINTF: printfStmt(first); break;
+        case NT_RETURN_STMT: returnStmt(first); break;
+        default: break;
+        }
+    }
+
+    // 给变量 name 赋值为 value；value 已经在目标槽里时不再移动
+    void store(const Token& name, Operand value) {
+        const NameRef& ref = lookup(name);
+        if (ref.kind == NK_LOCAL) moveTo(ref.value, value);
+        else if (ref.kind == NK_GLOBAL) emit(OP_SETG, ref.value, slotOf(value));
+        else if (ref.kind != NK_NONE) fail(name, string(tokenText(name)) + " is not a variable");
+    }
+
+    // 局部变量作为表达式的目标槽 (结果直接写进去)，其他情况返回 -1
+    int32_t targetOf(const Token& name) {
+        const NameRef& ref = lookup(name);
+        return ref.kind == NK_LOCAL ? ref.value : -1;
+    }
+
+    // <赋值语句> ::= <标识符> = <表达式> | <标识符> '[' <表达式> ']' = <表达式>
+    void assignStmt(uint32_t node) {
+        const AstNode& n = astNodes[node];
+        const Token& name = tokenAt(childAt(n, 0));
+        at = name.offset;
+        if (n.count == 3) {
+            store(name, expression(childAt(n, 2), targetOf(name)));
+            return;
+        }
+        const NameRef& ref = lookup(name);
+        int32_t index = slotOf(expression(childAt(n, 2)));
+        int32_t value = slotOf(expression(childAt(n, 5)));
+        at = name.offset;
+        if (ref.kind == NK_LOCAL_ARRAY) emit(OP_STOREA, ref.value, index, value);
+        else if (ref.kind == NK_GLOBAL_ARRAY) emit(OP_STOREGA, ref.value, index, value);
+        else if (ref.kind != NK_NONE) fail(name, string(tokenText(name)) + " is not an array");
+    }
+
+    // <条件语句> ::= if '(' <条件> ')' <语句> [ else <语句> ]
+    void condStmt(uint32_t node) {
+        const AstNode& n = astNodes[node];
+        if (enter(tokenAt(childAt(n, 0)))) {
+            uint32_t skip = condJump(childAt(n, 2), false);
+            stmt(childAt(n, 4));
+            if (n.count == 7) {
+                uint32_t end = emit(OP_JMP);
+                patch(skip);
+                stmt(childAt(n, 6));
+                patch(end);
+            } else {
+                patch(skip);
+            }
+        }
+        depth--;
+    }
+
+    // <循环语句>：条件放在循环体之后，每趟只执行一条转移指令
+    void loopStmt(uint32_t node) {
+        const AstNode& n = astNodes[node];
+        const Token& keyword = tokenAt(childAt(n, 0));
+        if (!enter(keyword)) {
+            // 出错后不再生成代码
+        } else if (keyword.kind == WHILETK) {
+            // while '(' <条件> ')' <语句>
+            uint32_t toCond = emit(OP_JMP);
+            uint32_t body = (uint32_t)bc->code.size();
+            stmt(childAt(n, 4));
+            patch(toCond);
+            jumpTo(condJump(childAt(n, 2), true), body);
+        } else if (keyword.kind == DOTK) {
+            // do <语句> while '(' <条件> ')'
+            uint32_t body = (uint32_t)bc->code.size();
+            stmt(childAt(n, 1));
+            tempTop = localsEnd;
+            jumpTo(condJump(childAt(n, 4), true), body);
+        } else {
+            // for '(' <标识符> = <表达式> ; <条件> ; <标识符> = <标识符> (+|-) <步长> ')' <语句>
+            const Token& var = tokenAt(childAt(n, 2));
+            at = var.offset;
+            store(var, expression(childAt(n, 4), targetOf(var)));
+            uint32_t toCond = emit(OP_JMP);
+            uint32_t body = (uint32_t)bc->code.size();
+            stmt(childAt(n, 14));
+            tempTop = localsEnd;
+            const Token& target = tokenAt(childAt(n, 8));
+            const Token& source = tokenAt(childAt(n, 10));
+            int32_t step = unsignedValue(childAt(astNodes[childAt(n, 12)], 0));
+            if (tokenAt(childAt(n, 11)).kind == MINU) step = (int32_t)(0u - (uint32_t)step);
+            at = target.offset;
+            store(target, binary(PLUS, variable(source, -1), {true, step}, targetOf(target)));
+            patch(toCond);
+            jumpTo(condJump(childAt(n, 6), true), body);
+        }
+        depth--;
+    }
+
+    void jumpTo(uint32_t j, uint32_t target) {
+        if (j != NO_JUMP) bc->code[j].a = (int32_t)target;
+    }
+
+    // <读语句> ::= scanf '(' <标识符> { , <标识符> } ')'
+    void scanfStmt(uint32_t node) {
+        const AstNode& n = astNodes[node];
+        for (uint32_t i = 2; i + 1 < n.count; i += 2) {
+            const Token& name = tokenAt(childAt(n, i));
+            at = name.offset;
+            const NameRef& ref = lookup(name);
+            Opcode op = ref.type == CHARTK ? OP_READC : OP_READI;
+            if (ref.kind == NK_LOCAL) {
+                emit(op, ref.value);
+            } else if (ref.kind == NK_GLOBAL) {
+                int32_t t = newTemp();
+                emit(op, t);
+                emit(OP_SETG, ref.value, t);
+            } else if (ref.kind != NK_NONE) {
+                fail(name, string(tokenText(name)) + " is not a variable");
+            }
+        }
+    }
+
+    // <写语句> ::= printf '(' <字符串> , <表达式> ')' | printf '(' <字符串> ')' | printf '(' <表达式> ')'
+    void printfStmt(uint32_t node) {
+        const AstNode& n = astNodes[node];
+        at = tokenAt(childAt(n, 0)).offset;
+        uint32_t i = 2;
+        if (astNodes[childAt(n, i)].kind == NT_STRING) {
+            bc->strings.emplace_back(tokenText(tokenAt(childAt(astNodes[childAt(n, i)], 0))));
+            emit(OP_PRINTS, (int32_t)bc->strings.size() - 1);
+            i += 2;
+        }
+        if (i < n.count) {
+            uint32_t expr = childAt(n, i);
+            int32_t value = slotOf(expression(expr));
+            emit(isCharExpression(expr) ? OP_PRINTC : OP_PRINTI, value);
+        }
+        emit(OP_PRINTNL);
+    }
+
+    // <返回语句> ::= return [ '(' <表达式> ')' ]
+    void returnStmt(uint32_t node) {
+        const AstNode& n = astNodes[node];
+        at = tokenAt(childAt(n, 0)).offset;
+        if (inMain) {
+            emit(OP_HALT);
+        } else if (n.count == 1) {
+            emit(OP_RETV);
+        } else {
+            int32_t value = slotOf(expression(childAt(n, 2)));
+            emit(OP_RET, value);
+        }
+    }
+
+    // <条件> ::= <表达式> <关系运算符> <表达式> | <表达式>
+    // 条件为 when 时跳转，返回跳转指令 (目标待填)；条件恒定时只在需要跳转时生成 JMP
+    uint32_t condJump(uint32_t node, bool when) {
+        const AstNode& n = astNodes[node];
+        Operand left = expression(childAt(n, 0));
+        if (n.count == 1) {
+            if (left.isConst) return (left.value != 0) == when ? emit(OP_JMP) : NO_JUMP;
+            return emit(when ? OP_JNZ : OP_JZ, 0, left.value);
+        }
+        TokenKind rel = tokenAt(childAt(n, 1)).kind;
+        Operand right = expression(childAt(n, 2));
+        if (!when) {
+            // 取反：< 变 >=，== 变 != ...
+            static const TokenKind negated[][2] = {{LSS, GEQ}, {LEQ, GRE}, {GRE, LEQ}, {GEQ, LSS}, {EQL, NEQ}, {NEQ, EQL}};
+            for (const auto& pair : negated) {
+                if (pair[0] == rel) {
+                    rel = pair[1];
+                    break;
+                }
+            }
+        }
+        if (left.isConst && right.isConst) return compare(rel, left.value, right.value) ? emit(OP_JMP) : NO_JUMP;
+        Opcode op = rel == LSS ? OP_JLT : rel == LEQ ? OP_JLE : rel == GRE ? OP_JGT
+                  : rel == GEQ ? OP_JGE : rel == EQL ? OP_JEQ : OP_JNE;
+        int32_t l = slotOf(left), r = slotOf(right);
+        return emit(op, 0, l, r);
+    }
+
+    static bool compare(TokenKind rel, int32_t l, int32_t r) {
+        switch (rel) {
+        case LSS: return l < r;
+        case LEQ: return l <= r;
+        case GRE: return l > r;
+        case GEQ: return l >= r;
+        case EQL: return l == r;
+        default: return l != r;
+        }
+    }
+
+    // --- 表达式 ---
+
+    // 常量放进临时量，返回槽号
+    int32_t slotOf(Operand v) {
+        if (!v.isConst) return v.value;
+        int32_t t = newTemp();
+        emit(OP_LOADK, t, v.value);
+        return t;
+    }
+
+    void moveTo(int32_t dst, Operand v) {
+        if (v.isConst) emit(OP_LOADK, dst, v.value);
+        else if (v.value != dst) emit(OP_MOV, dst, v.value);
+    }
+
+    // 结果槽：调用方指定了目标槽 (hint >= 0) 就直接写进去，否则新开一个临时量。
+    // 只有整个表达式的最后一条指令才会写 hint，前面的运算可以放心读它原来的值
+    int32_t resultSlot(int32_t hint) {
+        return hint >= 0 ? hint : newTemp();
+    }
+
+    // 32 位补码运算 (溢出时回绕)；除以 0 和 INT_MIN / -1 留到运行时处理
+    static bool fold(TokenKind op, int32_t l, int32_t r, int32_t& out) {
+        uint32_t a = (uint32_t)l, b = (uint32_t)r;
+        switch (op) {
+        case PLUS: out = (int32_t)(a + b); return true;
+        case MINU: out = (int32_t)(a - b); return true;
+        case MULT: out = (int32_t)(a * b); return true;
+        default:
+            if (r == 0 || (r == -1 && l == INT32_MIN)) return false;
+            out = l / r;
+            return true;
+        }
+    }
+
+    Operand binary(TokenKind op, Operand l, Operand r, int32_t hint) {
+        int32_t folded;
+        if (l.isConst && r.isConst && fold(op, l.value, r.value, folded)) return {true, folded};
+        if (op == PLUS && l.isConst) swap(l, r);
+        if ((op == PLUS || op == MINU) && r.isConst) {
+            if (r.value == 0) return l;
+            int32_t imm = op == PLUS ? r.value : (int32_t)(0u - (uint32_t)r.value);
+            int32_t dst = resultSlot(hint);
+            emit(OP_ADDI, dst, l.value, imm);
+            return {false, dst};
+        }
+        int32_t a = slotOf(l), b = slotOf(r);
+        int32_t dst = resultSlot(hint);
+        emit(op == PLUS ? OP_ADD : op == MINU ? OP_SUB : op == MULT ? OP_MUL : OP_DIV, dst, a, b);
+        return {false, dst};
+    }
+
+    // <表达式> ::= [ + | - ] <项> { (+|-) <项> }
+    Operand expression(uint32_t node, int32_t hint = -1) {
+        const AstNode& n = astNodes[node];
+        uint32_t i = 0;
+        bool negate = false;
+        if (isTokenRef(childAt(n, 0))) {
+            negate = tokenAt(childAt(n, 0)).kind == MINU;
+            i = 1;
+        }
+        bool single = i + 1 == n.count;
+        Operand acc = term(childAt(n, i), single && !negate ? hint : -1);
+        if (negate) {
+            if (acc.isConst) {
+                acc.value = (int32_t)(0u - (uint32_t)acc.value);
+            } else {
+                int32_t dst = resultSlot(single ? hint : -1);
+                emit(OP_NEG, dst, acc.value);
+                acc = {false, dst};
+            }
+        }
+        for (i++; i < n.count; i += 2) {
+            const Token& op = tokenAt(childAt(n, i));
+            Operand right = term(childAt(n, i + 1));
+            at = op.offset;
+            acc = binary(op.kind, acc, right, i + 2 >= n.count ? hint : -1);
+        }
+        return acc;
+    }
+
+    // <项> ::= <因子> { (*|/) <因子> }
+    Operand term(uint32_t node, int32_t hint = -1) {
+        const AstNode& n = astNodes[node];
+        Operand acc = factor(childAt(n, 0), n.count == 1 ? hint : -1);
+        for (uint32_t i = 1; i < n.count; i += 2) {
+            const Token& op = tokenAt(childAt(n, i));
+            Operand right = factor(childAt(n, i + 1));
+            at = op.offset;
+            acc = binary(op.kind, acc, right, i + 2 >= n.count ? hint : -1);
+        }
+        return acc;
+    }
+
+    // 读一个变量或常量
+    Operand variable(const Token& name, int32_t hint) {
+        const NameRef& ref = lookup(name);
+        switch (ref.kind) {
+        case NK_CONST: return {true, ref.value};
+        case NK_LOCAL: return {false, ref.value};
+        case NK_GLOBAL: {
+            int32_t dst = resultSlot(hint);
+            at = name.offset;
+            emit(OP_GETG, dst, ref.value);
+            return {false, dst};
+        }
+        case NK_NONE: return {true, 0};
+        default:
+            fail(name, string(tokenText(name)) + " is not a variable");
+            return {true, 0};
+        }
+    }
+
+    // <因子> ::= <标识符> | <标识符> '[' <表达式> ']' | '(' <表达式> ')' | <整数> | <字符> | <有返回值函数调用语句>
+    Operand factor(uint32_t node, int32_t hint = -1) {
+        const AstNode& n = astNodes[node];
+        uint32_t first = childAt(n, 0);
+        if (!isTokenRef(first)) {
+            if (astNodes[first].kind == NT_INTEGER) return {true, integerValue(first)};
+            return call(first, hint, true);
+        }
+        const Token& tk = tokenAt(first);
+        if (tk.kind == CHARCON) return {true, charValue(tk)};
+        Operand result = {true, 0};
+        if (!enter(tk)) {
+            // 出错后不再生成代码
+        } else if (tk.kind == LPARENT) {
+            result = expression(childAt(n, 1), hint);
+        } else if (n.count == 1) {
+            result = variable(tk, hint);
+        } else {
+            const NameRef& ref = lookup(tk);
+            int32_t index = slotOf(expression(childAt(n, 2)));
+            int32_t dst = resultSlot(hint);
+            at = tk.offset;
+            if (ref.kind == NK_LOCAL_ARRAY) emit(OP_LOADA, dst, ref.value, index);
+            else if (ref.kind == NK_GLOBAL_ARRAY) emit(OP_LOADGA, dst, ref.value, index);
+            else if (ref.kind != NK_NONE) fail(tk, string(tokenText(tk)) + " is not an array");
+            result = {false, dst};
+        }
+        depth--;
+        return result;
+    }
+
+    // <有返回值函数调用语句> / <无返回值函数调用语句> ::= <标识符> '(' <值参数表> ')'
+    // 实参依次算进连续的临时量，CALL 把它们复制到被调函数的参数槽
+    Operand call(uint32_t node, int32_t hint, bool wantValue) {
+        const AstNode& n = astNodes[node];
+        const Token& name = tokenAt(childAt(n, 0));
+        const NameRef& ref = lookup(name);
+        if (ref.kind != NK_FUNC) {
+            if (ref.kind != NK_NONE) fail(name, string(tokenText(name)) + " is not a function");
+            return {true, 0};
+        }
+        const AstNode& args = astNodes[childAt(n, 2)];
+        uint32_t argc = (args.count + 1) / 2;
+        if (argc != bc->funcs[ref.value].params) {
+            fail(name, "wrong number of arguments to " + string(tokenText(name)));
+            return {true, 0};
+        }
+        if (!enter(name)) {
+            depth--;
+            return {true, 0};
+        }
+        int32_t base = tempTop;
+        for (uint32_t i = 0; i < argc; i++) newTemp();
+        for (uint32_t i = 0; i < argc; i++) moveTo(base + (int32_t)i, expression(childAt(args, 2 * i), base + (int32_t)i));
+        int32_t dst = wantValue ? resultSlot(hint) : -1;
+        at = name.offset;
+        emit(OP_CALL, ref.value, base, dst);
+        depth--;
+        return {false, dst};
+    }
+
+    // 字符型表达式：只由一个字符型的因子构成 (字符常量、char 变量/常量/数组元素、返回 char 的函数调用)
+    bool isCharExpression(uint32_t node) {
+        const AstNode& expr = astNodes[node];
+        if (expr.count != 1) return false;
+        const AstNode& t = astNodes[childAt(expr, 0)];
+        if (t.count != 1) return false;
+        const AstNode& f = astNodes[childAt(t, 0)];
+        uint32_t first = childAt(f, 0);
+        if (!isTokenRef(first)) {
+            if (astNodes[first].kind != NT_CALL_RET) return false;
+            const NameRef& ref = lookup(tokenAt(childAt(astNodes[first], 0)));
+            return ref.kind == NK_FUNC && bc->funcs[ref.value].type == CHARTK;
+        }
+        const Token& tk = tokenAt(first);
+        if (tk.kind == CHARCON) return true;
+        return tk.kind == IDENFR && lookup(tk).type == CHARTK;
+    }
+};
+
+// --- 虚拟机 ---
+
+// 栈帧和调用记录在开始运行时一次分配好 (只有用到的内存页才真正占用内存)，调用函数时不再分配
+const size_t VM_STACK_SLOTS = (size_t)1 << 24;
+const size_t VM_MAX_CALL_DEPTH = (size_t)1 << 20;
+const size_t VM_OUTPUT_CHUNK = 64 * 1024;
+
+void flushVmOutput(string& out) {
+    fwrite(out.data(), 1, out.size(), stdout);
+    fflush(stdout);
+    out.clear();
+}
+
+void appendInt(string& out, int32_t v) {
+    char buf[12];
+    char* p = buf + sizeof(buf);
+    uint32_t u = v < 0 ? 0u - (uint32_t)v : (uint32_t)v;
+    do {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u != 0);
+    if (v < 0) *--p = '-';
+    out.append(p, buf + sizeof(buf) - p);
+}
+
+// GCC/Clang 下每条指令处理完直接按标签地址表跳到下一条的处理代码 (computed goto)，
+// 每种指令各有一处间接跳转，分支预测比集中在一处的 switch 准；其他编译器退回 switch
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO
+#define VM_CASE(op) L_##op:
+#define VM_DISPATCH() goto *labels[pc->op]
+#else
+#define VM_CASE(op) case op:
+#define VM_DISPATCH() continue
+#endif
+#define VM_NEXT() { pc++; VM_DISPATCH(); }
+#define VM_JUMP(target) { pc = code + (target); VM_DISPATCH(); }
+
+// 执行字节码，输入输出用标准输入输出；运行时错误返回 false，err 中带出错的源程序位置
+bool runBytecode(const Bytecode& bc, string& err) {
+    struct CallRecord {
+        const Instr* ret; // 返回后执行的指令
+        int32_t* fp;      // 调用方的栈帧
+        int32_t dst;      // 返回值放到调用方的哪个槽
+        uint32_t frameSize;
+    };
+    unique_ptr<int32_t[]> stack(new int32_t[VM_STACK_SLOTS]);
+    unique_ptr<CallRecord[]> calls(new CallRecord[VM_MAX_CALL_DEPTH]);
+    vector<int32_t> globalArea(bc.globalSize);
+    string out;
+
+    const Instr* code = bc.code.data();
+    const FuncInfo* funcs = bc.funcs.data();
+    const ArrayInfo* arrays = bc.arrays.data();
+    int32_t* g = globalArea.data();
+    int32_t* fp = stack.get();
+    int32_t* stackEnd = fp + VM_STACK_SLOTS;
+    size_t depth = 0;
+    uint32_t frameSize = funcs[bc.mainFunc].frameSize;
+    const Instr* pc = code + funcs[bc.mainFunc].entry;
+    const char* fault = nullptr;
+    int32_t retValue = 0;
+    if (frameSize > VM_STACK_SLOTS) {
+        fault = "stack overflow";
+        goto failed;
+    }
+    fill(fp, fp + frameSize, 0);
+
+#ifdef VM_COMPUTED_GOTO
+    static const void* const labels[] = {
+        &&L_OP_LOADK, &&L_OP_MOV, &&L_OP_GETG, &&L_OP_SETG, &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL, &&L_OP_DIV,
+        &&L_OP_ADDI, &&L_OP_NEG, &&L_OP_LOADA, &&L_OP_STOREA, &&L_OP_LOADGA, &&L_OP_STOREGA,
+        &&L_OP_JMP, &&L_OP_JZ, &&L_OP_JNZ, &&L_OP_JEQ, &&L_OP_JNE, &&L_OP_JLT, &&L_OP_JLE, &&L_OP_JGT, &&L_OP_JGE,
+        &&L_OP_CALL, &&L_OP_RET, &&L_OP_RETV, &&L_OP_READI, &&L_OP_READC,
+        &&L_OP_PRINTS, &&L_OP_PRINTI, &&L_OP_PRINTC, &&L_OP_PRINTNL, &&L_OP_HALT
+    };
+    static_assert(sizeof(labels) / sizeof(labels[0]) == OP_COUNT, "labels[] must follow enum Opcode");
+    VM_DISPATCH();
+#else
+    for (;;) switch (pc->op) {
+#endif
+    // 算术按 32 位补码回绕
+    VM_CASE(OP_LOADK) fp[pc->a] = pc->b; VM_NEXT();
+    VM_CASE(OP_MOV) fp[pc->a] = fp[pc->b]; VM_NEXT();
+    VM_CASE(OP_GETG) fp[pc->a] = g[pc->b]; VM_NEXT();
+    VM_CASE(OP_SETG) g[pc->a] = fp[pc->b]; VM_NEXT();
+    VM_CASE(OP_ADD) fp[pc->a] = (int32_t)((uint32_t)fp[pc->b] + (uint32_t)fp[pc->c]); VM_NEXT();
+    VM_CASE(OP_SUB) fp[pc->a] = (int32_t)((uint32_t)fp[pc->b] - (uint32_t)fp[pc->c]); VM_NEXT();
+    VM_CASE(OP_MUL) fp[pc->a] = (int32_t)((uint32_t)fp[pc->b] * (uint32_t)fp[pc->c]); VM_NEXT();
+    VM_CASE(OP_DIV) {
+        int32_t l = fp[pc->b], r = fp[pc->c];
+        if (r == 0) {
+            fault = "division by zero";
+            goto failed;
+        }
+        fp[pc->a] = r == -1 ? (int32_t)(0u - (uint32_t)l) : l / r;
+        VM_NEXT();
+    }
+    VM_CASE(OP_ADDI) fp[pc->a] = (int32_t)((uint32_t)fp[pc->b] + (uint32_t)pc->c); VM_NEXT();
+    VM_CASE(OP_NEG) fp[pc->a] = (int32_t)(0u - (uint32_t)fp[pc->b]); VM_NEXT();
+    VM_CASE(OP_LOADA) {
+        const ArrayInfo& arr = arrays[pc->b];
+        uint32_t i = (uint32_t)fp[pc->c];
+        if (i >= (uint32_t)arr.len) {
+            fault = "array index out of bounds";
+            goto failed;
+        }
+        fp[pc->a] = fp[arr.base + i];
+        VM_NEXT();
+    }
+    VM_CASE(OP_STOREA) {
+        const ArrayInfo& arr = arrays[pc->a];
+        uint32_t i = (uint32_t)fp[pc->b];
+        if (i >= (uint32_t)arr.len) {
+            fault = "array index out of bounds";
+            goto failed;
+        }
+        fp[arr.base + i] = fp[pc->c];
+        VM_NEXT();
+    }
+    VM_CASE(OP_LOADGA) {
+        const ArrayInfo& arr = arrays[pc->b];
+        uint32_t i = (uint32_t)fp[pc->c];
+        if (i >= (uint32_t)arr.len) {
+            fault = "array index out of bounds";
+            goto failed;
+        }
+        fp[pc->a] = g[arr.base + i];
+        VM_NEXT();
+    }
+    VM_CASE(OP_STOREGA) {
+        const ArrayInfo& arr = arrays[pc->a];
+        uint32_t i = (uint32_t)fp[pc->b];
+        if (i >= (uint32_t)arr.len) {
+            fault = "array index out of bounds";
+            goto failed;
+        }
+        g[arr.base + i] = fp[pc->c];
+        VM_NEXT();
+    }
+    VM_CASE(OP_JMP) VM_JUMP(pc->a);
+    VM_CASE(OP_JZ) if (fp[pc->b] == 0) VM_JUMP(pc->a); VM_NEXT();
+    VM_CASE(OP_JNZ) if (fp[pc->b] != 0) VM_JUMP(pc->a); VM_NEXT();
+    VM_CASE(OP_JEQ) if (fp[pc->b] == fp[pc->c]) VM_JUMP(pc->a); VM_NEXT();
+    VM_CASE(OP_JNE) if (fp[pc->b] != fp[pc->c]) VM_JUMP(pc->a); VM_NEXT();
+    VM_CASE(OP_JLT) if (fp[pc->b] < fp[pc->c]) VM_JUMP(pc->a); VM_NEXT();
+    VM_CASE(OP_JLE) if (fp[pc->b] <= fp[pc->c]) VM_JUMP(pc->a); VM_NEXT();
+    VM_CASE(OP_JGT) if (fp[pc->b] > fp[pc->c]) VM_JUMP(pc->a); VM_NEXT();
+    VM_CASE(OP_JGE) if (fp[pc->b] >= fp[pc->c]) VM_JUMP(pc->a); VM_NEXT();
+    VM_CASE(OP_CALL) {
+        // 被调函数的栈帧紧接在调用方之后：复制实参，局部变量清零
+        const FuncInfo& f = funcs[pc->a];
+        int32_t* callee = fp + frameSize;
+        if (depth == VM_MAX_CALL_DEPTH || f.frameSize > (size_t)(stackEnd - callee)) {
+            fault = "stack overflow";
+            goto failed;
+        }
+        for (uint32_t i = 0; i < f.params; i++) callee[i] = fp[pc->b + i];
+        memset(callee + f.params, 0, f.locals * sizeof(int32_t));
+        calls[depth++] = {pc + 1, fp, pc->c, frameSize};
+        fp = callee;
+        frameSize = f.frameSize;
+        VM_JUMP(f.entry);
+    }
+    VM_CASE(OP_RET) retValue = fp[pc->a]; goto returned;
+    VM_CASE(OP_RETV) retValue = 0; goto returned;
+    returned: {
+        if (depth == 0) goto halted;
+        const CallRecord& r = calls[--depth];
+        fp = r.fp;
+        frameSize = r.frameSize;
+        if (r.dst >= 0) fp[r.dst] = retValue;
+        pc = r.ret;
+        VM_DISPATCH();
+    }
+    // 读入之前先把已有的输出写出去 (交互运行时提示先出现)；读不到时得 0
+    VM_CASE(OP_READI) {
+        int v;
+        if (!out.empty()) flushVmOutput(out);
+        fp[pc->a] = scanf("%d", &v) == 1 ? v : 0;
+        VM_NEXT();
+    }
+    VM_CASE(OP_READC) {
+        char ch;
+        if (!out.empty()) flushVmOutput(out);
+        fp[pc->a] = scanf(" %c", &ch) == 1 ? (unsigned char)ch : 0;
+        VM_NEXT();
+    }
+    VM_CASE(OP_PRINTS) out += bc.strings[pc->a]; VM_NEXT();
+    VM_CASE(OP_PRINTI) appendInt(out, fp[pc->a]); VM_NEXT();
+    VM_CASE(OP_PRINTC) out += (char)fp[pc->a]; VM_NEXT();
+    VM_CASE(OP_PRINTNL) {
+        out += '\n';
+        if (out.size() >= VM_OUTPUT_CHUNK) flushVmOutput(out);
+        VM_NEXT();
+    }
+    VM_CASE(OP_HALT) goto halted;
+#ifndef VM_COMPUTED_GOTO
+    default: goto halted;
+    }
+#endif
+
+halted:
+    flushVmOutput(out);
+    return true;
+failed:
+    flushVmOutput(out);
+    {
+        SourcePos pos = resolvePos(bc.offsets[pc - code]);
+        err = "line " + to_string(pos.line) + ", column " + to_string(pos.column) + ": runtime error: " + fault;
+    }
+    return false;
+}
+
+#undef VM_CASE
+#undef VM_DISPATCH
+#undef VM_NEXT
+#undef VM_JUMP
+
+// 指令的操作数：读哪些槽、写哪个槽 (-1 表示不写)，是否调用 C 库或其他函数
+void instrOperands(const Bytecode& bc, const Instr& in, vector<int32_t>& uses, int32_t& def, bool& isCall) {
+    uses.clear();
+    def = -1;
+    isCall = false;
+    switch (in.op) {
+    case OP_LOADK: case OP_GETG: def = in.a; break;
+    case OP_MOV: case OP_ADDI: case OP_NEG: def = in.a; uses.push_back(in.b); break;
+    case OP_SETG: uses.push_back(in.b); break;
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: def = in.a; uses.push_back(in.b); uses.push_back(in.c); break;
+    case OP_LOADA: case OP_LOADGA: def = in.a; uses.push_back(in.c); break;
+    case OP_STOREA: case OP_STOREGA: uses.push_back(in.b); uses.push_back(in.c); break;
+    case OP_JZ: case OP_JNZ: uses.push_back(in.b); break;
+    case OP_JEQ: case OP_JNE: case OP_JLT: case OP_JLE: case OP_JGT: case OP_JGE:
+        uses.push_back(in.b);
+        uses.push_back(in.c);
+        break;
+    case OP_CALL:
+        for (uint32_t i = 0; i < bc.funcs[in.a].params; i++) uses.push_back(in.b + (int32_t)i);
+        def = in.c;
+        isCall = true;
+        break;
+    case OP_RET: uses.push_back(in.a); break;
+    case OP_READI: case OP_READC: def = in.a; isCall = true; break;
+    case OP_PRINTI: case OP_PRINTC: uses.push_back(in.a); isCall = true; break;
+    case OP_PRINTS: case OP_PRINTNL: isCall = true; break;
+    default: break;
+    }
+}
+
+// 调试输出：逐个函数列出字节码
+void dumpBytecode(const Bytecode& bc, ostream& out) {
+    for (size_t f = 0; f < bc.funcs.size(); f++) {
+        const FuncInfo& info = bc.funcs[f];
+        uint32_t end = f + 1 < bc.funcs.size() ? bc.funcs[f + 1].entry : (uint32_t)bc.code.size();
+        out << info.name << ": params " << info.params << ", locals " << info.locals << ", frame " << info.frameSize << "\n";
+        for (uint32_t i = info.entry; i < end; i++) {
+            const Instr& in = bc.code[i];
+            out << "  " << i << "\t" << opcodeNames[in.op] << " " << in.a << " " << in.b << " " << in.c << "\n";
+        }
+    }
+    for (size_t s = 0; s < bc.strings.size(); s++) out << "string " << s << ": \"" << bc.strings[s] << "\"\n";
+}
+
+// ==========================================
+// 7. SSA 中间表示与优化
+// ==========================================
+
+// 把每个函数的字节码提升成 SSA 形式：每个槽的每次赋值成为一个只定义一次的值，控制流汇合处用 φ 合并。
+// 在上面依次做常量传播与折叠、复写传播、死代码删除、循环不变量外提，再翻译回字节码 (重新分配槽)，
+// 解释器 (--run) 和 x86-64 后端 (--asm) 用的都是优化后的字节码。--ir 列出优化前后的中间表示，-O0 不做优化
+enum IrOp : uint8_t {
+    IR_CONST,   // 常量 imm
+    IR_PARAM,   // 第 imm 个参数
+    IR_COPY,    // args[0]
+    IR_PHI,     // 从第 i 个前驱进来时取 args[i]
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_NEG,
+    IR_GETG,    // 全局[imm]
+    IR_SETG,    // 全局[imm] = args[0]
+    IR_LOADA,   // 局部数组 imm 的第 args[0] 个元素
+    IR_STOREA,  // 局部数组 imm 的第 args[0] 个元素 = args[1]
+    IR_LOADGA,  // 全局数组，同上
+    IR_STOREGA,
+    IR_CALL,    // 调用函数 imm，实参是 args
+    IR_READI,
+    IR_READC,
+    IR_PRINTS,  // 输出字符串常量 imm
+    IR_PRINTI,
+    IR_PRINTC,
+    IR_PRINTNL,
+    IR_JMP,     // 转到 succs[0]
+    IR_BR,      // 按 imm (OP_JZ .. OP_JGE 之一) 比较 args，成立时转到 succs[0]，否则转到 succs[1]
+    IR_RET,
+    IR_RETV,
+    IR_HALT,
+    IR_COUNT
+};
+
+const char* const irOpNames[] = {
+    "const", "param", "copy", "phi", "add", "sub", "mul", "div", "neg", "getg", "setg",
+    "loada", "storea", "loadga", "storega", "call", "readi", "readc", "prints", "printi", "printc", "printnl",
+    "jmp", "br", "ret", "retv", "halt"
+};
+
+struct IrValue {
+    IrOp op;
+    int32_t imm = 0;
+    uint32_t block = 0;  // 所在的基本块
+    uint32_t offset = 0; // 对应的源程序位置，运行时报错用
+    vector<int32_t> args;
+};
+
+// 基本块：code 依次是 φ、普通指令和最后一条转移指令 (都是值的编号)
+struct IrBlock {
+    vector<int32_t> code;
+    vector<uint32_t> preds, succs;
+    bool removed = false;
+};
+
+struct IrFunction {
+    uint32_t func = 0;
+    vector<IrValue> values;
+    vector<IrBlock> blocks;  // 0 号是入口
+    vector<uint32_t> layout; // 翻译回字节码时块的排列顺序
+};
+
+static bool irHasResult(IrOp op) {
+    return op <= IR_NEG || op == IR_GETG || op == IR_LOADA || op == IR_LOADGA || op == IR_CALL || op == IR_READI || op == IR_READC;
+}
+
+// 比较转移指令的条件是否成立，以及条件取反
+static bool irCompare(int32_t cond, int32_t l, int32_t r) {
+    switch (cond) {
+    case OP_JZ: return l == 0;
+    case OP_JNZ: return l != 0;
+    case OP_JEQ: return l == r;
+    case OP_JNE: return l != r;
+    case OP_JLT: return l < r;
+    case OP_JLE: return l <= r;
+    case OP_JGT: return l > r;
+    default: return l >= r;
+    }
+}
+
+static Opcode irNegate(int32_t cond) {
+    switch (cond) {
+    case OP_JZ: return OP_JNZ;
+    case OP_JNZ: return OP_JZ;
+    case OP_JEQ: return OP_JNE;
+    case OP_JNE: return OP_JEQ;
+    case OP_JLT: return OP_JGE;
+    case OP_JLE: return OP_JGT;
+    case OP_JGT: return OP_JLE;
+    default: return OP_JLT;
+    }
+}
+
+// 逆后序和直接支配者 (Cooper, Harvey, Kennedy 的迭代算法)；从入口到不了的块 idom 为 -1
+void computeDominators(const IrFunction& fn, vector<uint32_t>& rpo, vector<int32_t>& idom) {
+    size_t n = fn.blocks.size();
+    rpo.clear();
+    vector<bool> seen(n, false);
+    vector<pair<uint32_t, size_t>> stack;
+    stack.push_back({0, 0});
+    seen[0] = true;
+    while (!stack.empty()) {
+        uint32_t b = stack.back().first;
+        size_t i = stack.back().second;
+        if (i < fn.blocks[b].succs.size()) {
+            stack.back().second++;
+            uint32_t s = fn.blocks[b].succs[i];
+            if (!seen[s]) {
+                seen[s] = true;
+                stack.push_back({s, 0});
+            }
+        } else {
+            rpo.push_back(b);
+            stack.pop_back();
+        }
+    }
+    reverse(rpo.begin(), rpo.end());
+    vector<int32_t> order(n, -1);
+    for (size_t i = 0; i < rpo.size(); i++) order[rpo[i]] = (int32_t)i;
+    idom.assign(n, -1);
+    idom[0] = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t i = 1; i < rpo.size(); i++) {
+            uint32_t b = rpo[i];
+            int32_t best = -1;
+            for (uint32_t p : fn.blocks[b].preds) {
+                if (idom[p] < 0) continue;
+                if (best < 0) {
+                    best = (int32_t)p;
+                    continue;
+                }
+                int32_t x = (int32_t)p, y = best;
+                while (x != y) {
+                    while (order[x] > order[y]) x = idom[x];
+                    while (order[y] > order[x]) y = idom[y];
+                }
+                best = x;
+            }
+            if (best != idom[b]) {
+                idom[b] = best;
+                changed = true;
+            }
+        }
+    }
+}
+
+// --- 从字节码构造 SSA ---
+
+class IrBuilder {
+public:
+    void build(const Bytecode& program, uint32_t id, IrFunction& fn) {
+        bc = &program;
+        ir = &fn;
+        const FuncInfo& f = bc->funcs[id];
+        begin = f.entry;
+        end = id + 1 < bc->funcs.size() ? bc->funcs[id + 1].entry : (uint32_t)bc->code.size();
+        slots = f.frameSize;
+        params = f.params;
+        fn = IrFunction();
+        fn.func = id;
+        splitBlocks();
+        placePhis();
+        rename();
+    }
+
+private:
+    const Bytecode* bc = nullptr;
+    IrFunction* ir = nullptr;
+    uint32_t begin = 0, end = 0, slots = 0, params = 0;
+    vector<uint32_t> blockStart;   // IR 块 (除入口外) 对应的字节码范围的起点；入口块是额外加的
+    vector<uint32_t> blockEnd;
+    vector<int32_t> phiSlot;       // φ -> 它合并的槽
+    vector<int32_t> initial;       // 槽在入口处的值：参数，或者 0 (局部变量调用时清零)
+    vector<vector<int32_t>> current; // 每个槽当前的定义 (沿支配树向下时压栈)
+    vector<int32_t> pushed;        // 压过栈的槽，退出块时弹出
+    uint32_t curBlock = 0;
+    uint32_t curOffset = 0;
+
+    int32_t add(IrOp op, int32_t imm, vector<int32_t> args) {
+        IrValue v;
+        v.op = op;
+        v.imm = imm;
+        v.block = curBlock;
+        v.offset = curOffset;
+        v.args = move(args);
+        ir->values.push_back(move(v));
+        int32_t id = (int32_t)ir->values.size() - 1;
+        ir->blocks[curBlock].code.push_back(id);
+        return id;
+    }
+    int32_t use(int32_t slot) const { return current[slot].empty() ? initial[slot] : current[slot].back(); }
+    void define(int32_t slot, int32_t v) {
+        current[slot].push_back(v);
+        pushed.push_back(slot);
+    }
+
+    // 1. 划分基本块，只保留从入口能到达的；前面加一个入口块放参数和初值
+    void splitBlocks() {
+        vector<bool> leader(end - begin + 1, false);
+        leader[0] = true;
+        for (uint32_t i = begin; i < end; i++) {
+            const Instr& in = bc->code[i];
+            if (in.op >= OP_JMP && in.op <= OP_JGE) leader[in.a - begin] = true;
+            if ((in.op >= OP_JMP && in.op <= OP_JGE) || in.op == OP_RET || in.op == OP_RETV || in.op == OP_HALT) leader[i + 1 - begin] = true;
+        }
+        vector<uint32_t> starts;
+        for (uint32_t i = begin; i < end; i++) {
+            if (leader[i - begin]) starts.push_back(i);
+        }
+        vector<int32_t> blockAt(end - begin, -1); // 字节码块首 -> 字节码块编号
+        for (size_t b = 0; b < starts.size(); b++) blockAt[starts[b] - begin] = (int32_t)b;
+        auto successors = [&](size_t b) {
+            vector<uint32_t> succ;
+            uint32_t last = (b + 1 < starts.size() ? starts[b + 1] : end) - 1;
+            const Instr& in = bc->code[last];
+            if (in.op >= OP_JMP && in.op <= OP_JGE) succ.push_back((uint32_t)blockAt[in.a - begin]);
+            if (in.op != OP_JMP && in.op != OP_RET && in.op != OP_RETV && in.op != OP_HALT && last + 1 < end) {
+                if (succ.empty() || succ[0] != b + 1) succ.push_back((uint32_t)b + 1);
+            }
+            return succ;
+        };
+        // 可达的字节码块按原来的顺序编号为 1, 2, ...
+        vector<bool> reached(starts.size(), false);
+        vector<uint32_t> work;
+        if (!starts.empty()) {
+            reached[0] = true;
+            work.push_back(0);
+        }
+        while (!work.empty()) {
+            uint32_t b = work.back();
+            work.pop_back();
+            for (uint32_t s : successors(b)) {
+                if (!reached[s]) {
+                    reached[s] = true;
+                    work.push_back(s);
+                }
+            }
+        }
+        vector<int32_t> irBlock(starts.size(), -1);
+        ir->blocks.emplace_back();
+        blockStart.assign(1, begin);
+        blockEnd.assign(1, begin);
+        for (size_t b = 0; b < starts.size(); b++) {
+            if (!reached[b]) continue;
+            irBlock[b] = (int32_t)ir->blocks.size();
+            ir->blocks.emplace_back();
+            blockStart.push_back(starts[b]);
+            blockEnd.push_back(b + 1 < starts.size() ? starts[b + 1] : end);
+        }
+        if (ir->blocks.size() > 1) {
+            ir->blocks[0].succs.push_back(1);
+            ir->blocks[1].preds.push_back(0);
+        }
+        for (size_t b = 0; b < starts.size(); b++) {
+            if (!reached[b]) continue;
+            for (uint32_t s : successors(b)) {
+                ir->blocks[irBlock[b]].succs.push_back((uint32_t)irBlock[s]);
+                ir->blocks[irBlock[s]].preds.push_back((uint32_t)irBlock[b]);
+            }
+        }
+        for (uint32_t b = 0; b < ir->blocks.size(); b++) ir->layout.push_back(b);
+    }
+
+    // 2. 在被赋值的槽的迭代支配边界上放 φ (只考虑在某个块里先读后写、跨块活跃的槽)
+    void placePhis() {
+        size_t n = ir->blocks.size();
+        vector<uint32_t> rpo;
+        vector<int32_t> idom;
+        computeDominators(*ir, rpo, idom);
+        vector<vector<uint32_t>> frontier(n);
+        for (uint32_t b = 0; b < n; b++) {
+            if (ir->blocks[b].preds.size() < 2) continue;
+            for (uint32_t p : ir->blocks[b].preds) {
+                for (int32_t r = (int32_t)p; r != idom[b]; r = idom[r]) {
+                    if (frontier[r].empty() || frontier[r].back() != b) frontier[r].push_back(b);
+                }
+            }
+        }
+        vector<bool> crossBlock(slots, false);
+        vector<vector<uint32_t>> defBlocks(slots);
+        vector<uint32_t> killedIn(slots, UINT32_MAX);
+        vector<int32_t> uses;
+        int32_t def;
+        bool isCall;
+        for (uint32_t b = 1; b < n; b++) {
+            for (uint32_t i = blockStart[b]; i < blockEnd[b]; i++) {
+                instrOperands(*bc, bc->code[i], uses, def, isCall);
+                for (int32_t s : uses) {
+                    if (killedIn[s] != b) crossBlock[s] = true;
+                }
+                if (def >= 0 && killedIn[def] != b) {
+                    killedIn[def] = b;
+                    defBlocks[def].push_back(b);
+                }
+            }
+        }
+        ir->values.reserve(bc->code.size());
+        vector<uint32_t> hasPhi(n, UINT32_MAX);
+        vector<uint32_t> work;
+        for (uint32_t s = 0; s < slots; s++) {
+            if (!crossBlock[s] || defBlocks[s].empty()) continue;
+            work = defBlocks[s];
+            while (!work.empty()) {
+                uint32_t b = work.back();
+                work.pop_back();
+                for (uint32_t d : frontier[b]) {
+                    if (hasPhi[d] == s) continue;
+                    hasPhi[d] = s;
+                    curBlock = d;
+                    curOffset = bc->offsets[blockStart[d]];
+                    add(IR_PHI, 0, vector<int32_t>(ir->blocks[d].preds.size(), -1));
+                    phiSlot.resize(ir->values.size(), -1);
+                    phiSlot.back() = (int32_t)s;
+                    work.push_back(d);
+                }
+            }
+        }
+        phiSlot.resize(ir->values.size(), -1);
+    }
+
+    // 3. 沿支配树深度优先改名，同时把字节码翻译成 SSA 指令
+    void rename() {
+        size_t n = ir->blocks.size();
+        vector<uint32_t> rpo;
+        vector<int32_t> idom;
+        computeDominators(*ir, rpo, idom);
+        vector<vector<uint32_t>> children(n);
+        for (uint32_t b : rpo) {
+            if (b != 0) children[idom[b]].push_back(b);
+        }
+        current.assign(slots, {});
+        initial.assign(slots, -1);
+        curBlock = 0;
+        curOffset = bc->offsets[begin];
+        int32_t zero = -1;
+        for (uint32_t s = 0; s < slots; s++) {
+            if (s < params) {
+                initial[s] = add(IR_PARAM, (int32_t)s, {});
+            } else {
+                if (zero < 0) zero = add(IR_CONST, 0, {});
+                initial[s] = zero;
+            }
+        }
+        if (n > 1) add(IR_JMP, 0, {});
+
+        struct Frame {
+            uint32_t block;
+            size_t child;
+            size_t mark;
+        };
+        vector<Frame> stack;
+        for (uint32_t c : children[0]) stack.push_back({c, SIZE_MAX, 0});
+        while (!stack.empty()) {
+            Frame& top = stack.back();
+            if (top.child == SIZE_MAX) {
+                top.child = 0;
+                top.mark = pushed.size();
+                translate(top.block);
+            }
+            if (top.child < children[top.block].size()) {
+                uint32_t c = children[top.block][top.child++];
+                stack.push_back({c, SIZE_MAX, 0});
+                continue;
+            }
+            while (pushed.size() > top.mark) {
+                current[pushed.back()].pop_back();
+                pushed.pop_back();
+            }
+            stack.pop_back();
+        }
+        // 入口块的后继 (1 号块) 里的 φ 取初值
+        fillPhis(0);
+    }
+
+    void fillPhis(uint32_t b) {
+        for (uint32_t s : ir->blocks[b].succs) {
+            IrBlock& succ = ir->blocks[s];
+            size_t k = find(succ.preds.begin(), succ.preds.end(), b) - succ.preds.begin();
+            for (int32_t v : succ.code) {
+                if (ir->values[v].op != IR_PHI) break;
+                ir->values[v].args[k] = use(phiSlot[v]);
+            }
+        }
+    }
+
+    void translate(uint32_t b) {
+        curBlock = b;
+        for (int32_t v : ir->blocks[b].code) {
+            if (ir->values[v].op == IR_PHI) define(phiSlot[v], v);
+        }
+        bool terminated = false;
+        for (uint32_t i = blockStart[b]; i < blockEnd[b]; i++) {
+            const Instr& in = bc->code[i];
+            curOffset = bc->offsets[i];
+            switch (in.op) {
+            case OP_LOADK: define(in.a, add(IR_CONST, in.b, {})); break;
+            case OP_MOV: define(in.a, add(IR_COPY, 0, {use(in.b)})); break;
+            case OP_GETG: define(in.a, add(IR_GETG, in.b, {})); break;
+            case OP_SETG: add(IR_SETG, in.a, {use(in.b)}); break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+                define(in.a, add((IrOp)(IR_ADD + (in.op - OP_ADD)), 0, {use(in.b), use(in.c)}));
+                break;
+            case OP_ADDI: {
+                int32_t k = add(IR_CONST, in.c, {});
+                define(in.a, add(IR_ADD, 0, {use(in.b), k}));
+                break;
+            }
+            case OP_NEG: define(in.a, add(IR_NEG, 0, {use(in.b)})); break;
+            case OP_LOADA: define(in.a, add(IR_LOADA, in.b, {use(in.c)})); break;
+            case OP_LOADGA: define(in.a, add(IR_LOADGA, in.b, {use(in.c)})); break;
+            case OP_STOREA: add(IR_STOREA, in.a, {use(in.b), use(in.c)}); break;
+            case OP_STOREGA: add(IR_STOREGA, in.a, {use(in.b), use(in.c)}); break;
+            case OP_CALL: {
+                vector<int32_t> args;
+                for (uint32_t p = 0; p < bc->funcs[in.a].params; p++) args.push_back(use(in.b + (int32_t)p));
+                int32_t v = add(IR_CALL, in.a, move(args));
+                if (in.c >= 0) define(in.c, v);
+                break;
+            }
+            case OP_READI: define(in.a, add(IR_READI, 0, {})); break;
+            case OP_READC: define(in.a, add(IR_READC, 0, {})); break;
+            case OP_PRINTS: add(IR_PRINTS, in.a, {}); break;
+            case OP_PRINTI: add(IR_PRINTI, 0, {use(in.a)}); break;
+            case OP_PRINTC: add(IR_PRINTC, 0, {use(in.a)}); break;
+            case OP_PRINTNL: add(IR_PRINTNL, 0, {}); break;
+            case OP_JMP: add(IR_JMP, 0, {}); terminated = true; break;
+            case OP_JZ: case OP_JNZ:
+                if (ir->blocks[b].succs.size() == 2) add(IR_BR, in.op, {use(in.b)});
+                else add(IR_JMP, 0, {});
+                terminated = true;
+                break;
+            case OP_JEQ: case OP_JNE: case OP_JLT: case OP_JLE: case OP_JGT: case OP_JGE:
+                if (ir->blocks[b].succs.size() == 2) add(IR_BR, in.op, {use(in.b), use(in.c)});
+                else add(IR_JMP, 0, {});
+                terminated = true;
+                break;
+            case OP_RET: add(IR_RET, 0, {use(in.a)}); terminated = true; break;
+            case OP_RETV: add(IR_RETV, 0, {}); terminated = true; break;
+            case OP_HALT: add(IR_HALT, 0, {}); terminated = true; break;
+            default: break;
+            }
+        }
+        if (!terminated) add(IR_JMP, 0, {});
+        fillPhis(b);
+    }
+};
+
+// --- 优化 ---
+
+class IrOptimizer {
+public:
+    IrOptimizer(IrFunction& function, const Bytecode& program) : fn(function), bc(program) {}
+
+    void run() {
+        for (bool changed = true; changed;) {
+            changed = foldConstants();
+            if (propagateCopies()) changed = true;
+        }
+        removeDeadCode();
+        hoistInvariants();
+        propagateCopies();
+        removeDeadCode();
+    }
+
+private:
+    IrFunction& fn;
+    const Bytecode& bc;
+    vector<int32_t> alias; // 值被哪个值代替 (复写传播)，-1 表示没有
+
+    bool isConst(int32_t v) const { return fn.values[v].op == IR_CONST; }
+    int32_t constOf(int32_t v) const { return fn.values[v].imm; }
+
+    int32_t resolve(int32_t v) {
+        int32_t root = v;
+        while (alias[root] >= 0) root = alias[root];
+        while (alias[v] >= 0) {
+            int32_t next = alias[v];
+            alias[v] = root;
+            v = next;
+        }
+        return root;
+    }
+
+    // 删掉 from -> to 这条边，to 里的 φ 去掉对应的参数
+    void removeEdge(uint32_t from, uint32_t to) {
+        IrBlock& t = fn.blocks[to];
+        size_t k = find(t.preds.begin(), t.preds.end(), from) - t.preds.begin();
+        t.preds.erase(t.preds.begin() + k);
+        // 折叠成常量的 φ 还留在块首，所以要看完整个块
+        for (int32_t v : t.code) {
+            if (fn.values[v].op == IR_PHI) fn.values[v].args.erase(fn.values[v].args.begin() + k);
+        }
+        IrBlock& f = fn.blocks[from];
+        f.succs.erase(find(f.succs.begin(), f.succs.end(), to));
+    }
+
+    void removeUnreachable() {
+        vector<bool> seen(fn.blocks.size(), false);
+        vector<uint32_t> work = {0};
+        seen[0] = true;
+        while (!work.empty()) {
+            uint32_t b = work.back();
+            work.pop_back();
+            for (uint32_t s : fn.blocks[b].succs) {
+                if (!seen[s]) {
+                    seen[s] = true;
+                    work.push_back(s);
+                }
+            }
+        }
+        // 只需要断开到达不了的块指向能到达的块的边，到达不了的块之间的边随块一起丢掉
+        for (uint32_t b = 0; b < fn.blocks.size(); b++) {
+            if (seen[b] || fn.blocks[b].removed) continue;
+            vector<uint32_t> succs = fn.blocks[b].succs;
+            for (uint32_t s : succs) {
+                if (seen[s]) removeEdge(b, s);
+            }
+        }
+        for (uint32_t b = 0; b < fn.blocks.size(); b++) {
+            if (seen[b] || fn.blocks[b].removed) continue;
+            fn.blocks[b].removed = true;
+            fn.blocks[b].succs.clear();
+            fn.blocks[b].code.clear();
+            fn.blocks[b].preds.clear();
+        }
+    }
+
+    // 常量传播与折叠：运算数都是常量的算出来，恒等式 (x+0, x*1, x*0 ...) 化简，条件已知的转移改成无条件转移
+    bool foldConstants() {
+        bool changed = false, cutEdges = false;
+        for (uint32_t b = 0; b < fn.blocks.size(); b++) {
+            if (fn.blocks[b].removed) continue;
+            for (int32_t id : fn.blocks[b].code) {
+                IrValue& v = fn.values[id];
+                auto toConst = [&](int32_t value) {
+                    v.op = IR_CONST;
+                    v.imm = value;
+                    v.args.clear();
+                    changed = true;
+                };
+                auto toCopy = [&](int32_t src) {
+                    v.op = IR_COPY;
+                    v.args = {src};
+                    changed = true;
+                };
+                switch (v.op) {
+                case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: {
+                    int32_t l = v.args[0], r = v.args[1];
+                    uint32_t x = (uint32_t)constOf(l), y = (uint32_t)constOf(r);
+                    if (isConst(l) && isConst(r)) {
+                        if (v.op == IR_ADD) toConst((int32_t)(x + y));
+                        else if (v.op == IR_SUB) toConst((int32_t)(x - y));
+                        else if (v.op == IR_MUL) toConst((int32_t)(x * y));
+                        else if (y == UINT32_MAX) toConst((int32_t)(0u - x));
+                        else if (y != 0) toConst((int32_t)x / (int32_t)y);
+                    } else if (isConst(r) && y == 0 && (v.op == IR_ADD || v.op == IR_SUB)) {
+                        toCopy(l);
+                    } else if (isConst(l) && x == 0 && v.op == IR_ADD) {
+                        toCopy(r);
+                    } else if (isConst(r) && y == 1 && (v.op == IR_MUL || v.op == IR_DIV)) {
+                        toCopy(l);
+                    } else if (isConst(l) && x == 1 && v.op == IR_MUL) {
+                        toCopy(r);
+                    } else if (((isConst(l) && x == 0) || (isConst(r) && y == 0)) && v.op == IR_MUL) {
+                        toConst(0);
+                    }
+                    break;
+                }
+                case IR_NEG:
+                    if (isConst(v.args[0])) toConst((int32_t)(0u - (uint32_t)constOf(v.args[0])));
+                    break;
+                case IR_PHI: {
+                    bool same = !v.args.empty();
+                    for (int32_t a : v.args) {
+                        if (!isConst(a) || constOf(a) != constOf(v.args[0])) same = false;
+                    }
+                    if (same) toConst(constOf(v.args[0]));
+                    break;
+                }
+                case IR_BR: {
+                    bool known = true;
+                    for (int32_t a : v.args) {
+                        if (!isConst(a)) known = false;
+                    }
+                    if (!known) break;
+                    bool taken = irCompare(v.imm, constOf(v.args[0]), v.args.size() > 1 ? constOf(v.args[1]) : 0);
+                    uint32_t dropped = fn.blocks[b].succs[taken ? 1 : 0];
+                    removeEdge(b, dropped);
+                    v.op = IR_JMP;
+                    v.imm = 0;
+                    v.args.clear();
+                    changed = cutEdges = true;
+                    break;
+                }
+                default:
+                    break;
+                }
+            }
+        }
+        if (cutEdges) removeUnreachable();
+        return changed;
+    }
+
+    // 复写传播：copy 和所有参数都相同 (或是它自己) 的 φ 由它们的来源代替
+    bool propagateCopies() {
+        alias.assign(fn.values.size(), -1);
+        bool any = false;
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (const IrBlock& block : fn.blocks) {
+                for (int32_t id : block.code) {
+                    const IrValue& v = fn.values[id];
+                    if (alias[id] >= 0) continue;
+                    int32_t src = -1;
+                    if (v.op == IR_COPY) {
+                        src = resolve(v.args[0]);
+                    } else if (v.op == IR_PHI) {
+                        bool trivial = true;
+                        for (int32_t a : v.args) {
+                            a = resolve(a);
+                            if (a == id || a == src) continue;
+                            if (src >= 0) trivial = false;
+                            src = a;
+                        }
+                        if (!trivial) src = -1;
+                    }
+                    if (src >= 0 && src != id) {
+                        alias[id] = src;
+                        changed = any = true;
+                    }
+                }
+            }
+        }
+        if (!any) return false;
+        bool changed = false;
+        for (const IrBlock& block : fn.blocks) {
+            for (int32_t id : block.code) {
+                for (int32_t& a : fn.values[id].args) {
+                    int32_t r = resolve(a);
+                    if (r != a) {
+                        a = r;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        return changed;
+    }
+
+    // 有副作用 (或可能在运行时报错) 的指令必须保留
+    bool hasSideEffect(const IrValue& v) const {
+        switch (v.op) {
+        case IR_CONST: case IR_PARAM: case IR_COPY: case IR_PHI:
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_NEG: case IR_GETG:
+            return false;
+        case IR_DIV:
+            return !isConst(v.args[1]) || constOf(v.args[1]) == 0;
+        case IR_LOADA: case IR_LOADGA:
+            return !isConst(v.args[0]) || (uint32_t)constOf(v.args[0]) >= (uint32_t)bc.arrays[v.imm].len;
+        default:
+            return true;
+        }
+    }
+
+    // 死代码删除：从有副作用的指令出发标记用到的值，其余的删掉
+    void removeDeadCode() {
+        vector<bool> live(fn.values.size(), false);
+        vector<int32_t> work;
+        for (const IrBlock& block : fn.blocks) {
+            for (int32_t id : block.code) {
+                if (hasSideEffect(fn.values[id])) {
+                    live[id] = true;
+                    work.push_back(id);
+                }
+            }
+        }
+        while (!work.empty()) {
+            int32_t id = work.back();
+            work.pop_back();
+            for (int32_t a : fn.values[id].args) {
+                if (!live[a]) {
+                    live[a] = true;
+                    work.push_back(a);
+                }
+            }
+        }
+        for (IrBlock& block : fn.blocks) {
+            block.code.erase(remove_if(block.code.begin(), block.code.end(), [&](int32_t id) { return !live[id]; }), block.code.end());
+        }
+    }
+
+    // 循环不变量外提：先给每个循环头准备唯一的前置块，再由内向外把运算数都在循环外定义的纯运算移到前置块末尾
+    void hoistInvariants() {
+        vector<uint32_t> rpo;
+        vector<int32_t> idom;
+        computeDominators(fn, rpo, idom);
+        auto dominates = [&](uint32_t a, uint32_t b) {
+            for (;;) {
+                if (a == b) return true;
+                if (b == 0) return false;
+                b = (uint32_t)idom[b];
+            }
+        };
+        vector<uint32_t> headers;
+        for (uint32_t b : rpo) {
+            for (uint32_t s : fn.blocks[b].succs) {
+                if (dominates(s, b) && find(headers.begin(), headers.end(), s) == headers.end()) headers.push_back(s);
+            }
+        }
+        if (headers.empty()) return;
+        for (uint32_t h : headers) makePreheader(h, idom);
+
+        computeDominators(fn, rpo, idom);
+        struct Loop {
+            uint32_t header;
+            vector<uint32_t> body;
+        };
+        vector<Loop> loops;
+        vector<uint32_t> order(fn.blocks.size(), 0);
+        for (size_t i = 0; i < rpo.size(); i++) order[rpo[i]] = (uint32_t)i;
+        vector<uint32_t> mark(fn.blocks.size(), UINT32_MAX);
+        for (uint32_t h : headers) {
+            Loop loop{h, {h}};
+            mark[h] = h;
+            vector<uint32_t> work;
+            for (uint32_t p : fn.blocks[h].preds) {
+                if (dominates(h, p) && mark[p] != h) {
+                    mark[p] = h;
+                    work.push_back(p);
+                }
+            }
+            while (!work.empty()) {
+                uint32_t b = work.back();
+                work.pop_back();
+                loop.body.push_back(b);
+                for (uint32_t p : fn.blocks[b].preds) {
+                    if (mark[p] != h) {
+                        mark[p] = h;
+                        work.push_back(p);
+                    }
+                }
+            }
+            sort(loop.body.begin(), loop.body.end(), [&](uint32_t x, uint32_t y) { return order[x] < order[y]; });
+            loops.push_back(move(loop));
+        }
+        sort(loops.begin(), loops.end(), [](const Loop& x, const Loop& y) { return x.body.size() < y.body.size(); });
+
+        vector<uint32_t> inLoop(fn.blocks.size(), UINT32_MAX);
+        for (size_t l = 0; l < loops.size(); l++) {
+            const Loop& loop = loops[l];
+            for (uint32_t b : loop.body) inLoop[b] = (uint32_t)l;
+            uint32_t pre = UINT32_MAX;
+            for (uint32_t p : fn.blocks[loop.header].preds) {
+                if (inLoop[p] != l) pre = p;
+            }
+            if (pre == UINT32_MAX || fn.blocks[pre].succs.size() != 1) continue;
+            vector<int32_t> hoisted;
+            for (uint32_t b : loop.body) {
+                vector<int32_t>& code = fn.blocks[b].code;
+                size_t kept = 0;
+                for (size_t i = 0; i < code.size(); i++) {
+                    IrValue& v = fn.values[code[i]];
+                    bool movable = v.op == IR_ADD || v.op == IR_SUB || v.op == IR_MUL || v.op == IR_NEG || v.op == IR_COPY
+                        || (v.op == IR_DIV && !hasSideEffect(v));
+                    for (int32_t a : v.args) {
+                        if (inLoop[fn.values[a].block] == l) movable = false;
+                    }
+                    if (movable) {
+                        v.block = pre;
+                        hoisted.push_back(code[i]);
+                    } else {
+                        code[kept++] = code[i];
+                    }
+                }
+                code.resize(kept);
+            }
+            vector<int32_t>& preCode = fn.blocks[pre].code;
+            preCode.insert(preCode.end() - 1, hoisted.begin(), hoisted.end());
+        }
+    }
+
+    // 循环头 h 从循环外进入的边都改成先到一个新的前置块 (只有一条这样的边且那个块只转向 h 时不用新建)
+    void makePreheader(uint32_t h, const vector<int32_t>& idom) {
+        vector<uint32_t> outside;
+        for (uint32_t p : fn.blocks[h].preds) {
+            // 回边的起点被 h 支配
+            bool back = false;
+            for (int32_t r = (int32_t)p; r >= 0; r = r == 0 ? -1 : idom[r]) {
+                if ((uint32_t)r == h) {
+                    back = true;
+                    break;
+                }
+            }
+            if (!back) outside.push_back(p);
+        }
+        if (outside.empty()) return;
+        if (outside.size() == 1 && fn.blocks[outside[0]].succs.size() == 1) return;
+
+        uint32_t pre = (uint32_t)fn.blocks.size();
+        fn.blocks.emplace_back();
+        IrBlock& header = fn.blocks[h];
+        // 头里的 φ：来自循环外的参数合并到前置块里的新 φ
+        vector<size_t> outsideIndex;
+        for (size_t k = 0; k < header.preds.size(); k++) {
+            if (find(outside.begin(), outside.end(), header.preds[k]) != outside.end()) outsideIndex.push_back(k);
+        }
+        vector<int32_t> newPhis;
+        for (int32_t id : header.code) {
+            if (fn.values[id].op != IR_PHI) continue;
+            vector<int32_t> args;
+            for (size_t k : outsideIndex) args.push_back(fn.values[id].args[k]);
+            int32_t merged = args[0];
+            if (outside.size() > 1) {
+                IrValue phi;
+                phi.op = IR_PHI;
+                phi.block = pre;
+                phi.offset = fn.values[id].offset;
+                phi.args = args;
+                fn.values.push_back(move(phi));
+                merged = (int32_t)fn.values.size() - 1;
+                newPhis.push_back(merged);
+            }
+            vector<int32_t> kept;
+            for (size_t k = 0; k < fn.values[id].args.size(); k++) {
+                if (find(outsideIndex.begin(), outsideIndex.end(), k) == outsideIndex.end()) kept.push_back(fn.values[id].args[k]);
+            }
+            kept.push_back(merged);
+            fn.values[id].args = move(kept);
+        }
+        vector<uint32_t> preds;
+        for (uint32_t p : fn.blocks[h].preds) {
+            if (find(outside.begin(), outside.end(), p) == outside.end()) preds.push_back(p);
+        }
+        preds.push_back(pre);
+        fn.blocks[h].preds = move(preds);
+        for (uint32_t p : outside) replace(fn.blocks[p].succs.begin(), fn.blocks[p].succs.end(), h, pre);
+
+        IrValue jump;
+        jump.op = IR_JMP;
+        jump.block = pre;
+        jump.offset = fn.values[fn.blocks[h].code.back()].offset;
+        fn.values.push_back(move(jump));
+        IrBlock& block = fn.blocks[pre];
+        block.code = newPhis;
+        block.code.push_back((int32_t)fn.values.size() - 1);
+        block.preds = outside;
+        block.succs = {h};
+        fn.layout.insert(find(fn.layout.begin(), fn.layout.end(), h), pre);
+    }
+};
+
+// --- 翻译回字节码 ---
+
+// 值先各占一个虚拟槽，φ 变成前驱末尾的并行复制；常量在每次使用前重新装入 (后端可以直接用成立即数)。
+// 最后按冲突图把虚拟槽分配到实际的槽：参数留在原来的槽，调用的实参先复制到栈帧里一段固定的槽
+class IrLowering {
+public:
+    void lower(IrFunction& function, const Bytecode& program, vector<Instr>& code, vector<uint32_t>& offsets, uint32_t& frameSize) {
+        fn = &function;
+        bc = &program;
+        const FuncInfo& f = bc->funcs[fn->func];
+        uint32_t maxArgs = 0;
+        for (const IrBlock& block : fn->blocks) {
+            for (int32_t id : block.code) {
+                if (fn->values[id].op == IR_CALL) maxArgs = max(maxArgs, (uint32_t)fn->values[id].args.size());
+            }
+        }
+        staging = (int32_t)(f.params + f.locals);
+        base = staging + (int32_t)maxArgs;
+        nextTemp = base + (int32_t)fn->values.size();
+        used.assign(fn->values.size(), false);
+        for (const IrBlock& block : fn->blocks) {
+            for (int32_t id : block.code) {
+                for (int32_t a : fn->values[id].args) used[a] = true;
+            }
+        }
+        splitCriticalEdges();
+        emit();
+        frameSize = allocateSlots();
+        uint32_t entry = (uint32_t)code.size();
+        for (size_t i = 0; i < vcode.size(); i++) {
+            Instr in = vcode[i];
+            if (in.op >= OP_JMP && in.op <= OP_JGE) in.a = (int32_t)(entry + blockPc[in.a]);
+            code.push_back(in);
+            offsets.push_back(voffsets[i]);
+        }
+    }
+
+private:
+    IrFunction* fn = nullptr;
+    const Bytecode* bc = nullptr;
+    int32_t staging = 0, base = 0, nextTemp = 0;
+    vector<bool> used;
+    vector<bool> constTemp; // 虚拟槽 (减去 base) 是不是装常量的临时槽
+    vector<Instr> vcode;
+    vector<uint32_t> voffsets;
+    vector<uint32_t> blockPc;
+    uint32_t curOffset = 0;
+
+    void put(Opcode op, int32_t a, int32_t b = 0, int32_t c = 0) {
+        vcode.push_back({op, a, b, c});
+        voffsets.push_back(curOffset);
+    }
+
+    // 值所在的 (虚拟) 槽；常量先装进一个临时槽
+    int32_t operand(int32_t v) {
+        const IrValue& x = fn->values[v];
+        if (x.op == IR_PARAM) return x.imm;
+        if (x.op == IR_CONST) {
+            int32_t t = nextTemp++;
+            constTemp.resize(t - base + 1, false);
+            constTemp[t - base] = true;
+            put(OP_LOADK, t, x.imm);
+            return t;
+        }
+        return base + v;
+    }
+
+    // 有 φ 的块如果有多个前驱，从有两个后继的前驱到它的边上插一个空块 (放 φ 的复制)
+    void splitCriticalEdges() {
+        size_t n = fn->blocks.size();
+        for (uint32_t b = 0; b < n; b++) {
+            if (fn->blocks[b].removed || fn->blocks[b].succs.size() < 2) continue;
+            for (size_t k = 0; k < fn->blocks[b].succs.size(); k++) {
+                uint32_t s = fn->blocks[b].succs[k];
+                const IrBlock& succ = fn->blocks[s];
+                bool hasPhi = false;
+                for (int32_t id : succ.code) {
+                    if (fn->values[id].op == IR_PHI) hasPhi = true;
+                }
+                if (succ.preds.size() < 2 || !hasPhi) continue;
+                uint32_t e = (uint32_t)fn->blocks.size();
+                IrValue jump;
+                jump.op = IR_JMP;
+                jump.block = e;
+                jump.offset = fn->values[fn->blocks[b].code.back()].offset;
+                fn->values.push_back(move(jump));
+                used.push_back(false);
+                fn->blocks.emplace_back();
+                fn->blocks[e].code = {(int32_t)fn->values.size() - 1};
+                fn->blocks[e].preds = {b};
+                fn->blocks[e].succs = {s};
+                fn->blocks[b].succs[k] = e;
+                replace(fn->blocks[s].preds.begin(), fn->blocks[s].preds.end(), b, e);
+                fn->layout.push_back(e);
+            }
+        }
+        nextTemp = base + (int32_t)fn->values.size();
+    }
+
+    // 并行复制 dst_i = src_i 排成顺序执行的 MOV/LOADK：先做目标不再被别的复制读的，剩下成环的借一个临时槽打开
+    void parallelCopy(vector<pair<int32_t, int32_t>> copies) {
+        // 源是常量时用 src = INT32_MIN 之外的编码：这里统一用值编号，到发出时再判断
+        vector<pair<int32_t, int32_t>> moves; // (目标槽, 源槽)，源 < 0 表示常量值编号 -(v+1)
+        for (auto& c : copies) {
+            const IrValue& x = fn->values[c.second];
+            if (x.op == IR_CONST) moves.push_back({c.first, -(c.second + 1)});
+            else if (base + c.second != c.first || x.op == IR_PARAM) moves.push_back({c.first, x.op == IR_PARAM ? x.imm : base + c.second});
+        }
+        while (!moves.empty()) {
+            bool progress = false;
+            for (size_t i = 0; i < moves.size(); i++) {
+                int32_t dst = moves[i].first;
+                bool blocked = false;
+                for (size_t j = 0; j < moves.size(); j++) {
+                    if (j != i && moves[j].second == dst) blocked = true;
+                }
+                if (blocked) continue;
+                if (moves[i].second < 0) put(OP_LOADK, dst, fn->values[-moves[i].second - 1].imm);
+                else if (moves[i].second != dst) put(OP_MOV, dst, moves[i].second);
+                moves.erase(moves.begin() + i);
+                progress = true;
+                break;
+            }
+            if (progress) continue;
+            // 全都成环：把第一个复制的目标先存到临时槽，读它的复制改读临时槽
+            int32_t t = nextTemp++;
+            int32_t dst = moves[0].first;
+            put(OP_MOV, t, dst);
+            for (auto& m : moves) {
+                if (m.second == dst) m.second = t;
+            }
+        }
+    }
+
+    void emit() {
+        blockPc.assign(fn->blocks.size(), 0);
+        vector<uint32_t> order;
+        for (uint32_t b : fn->layout) {
+            if (!fn->blocks[b].removed) order.push_back(b);
+        }
+        for (size_t i = 0; i < order.size(); i++) {
+            uint32_t b = order[i];
+            uint32_t next = i + 1 < order.size() ? order[i + 1] : UINT32_MAX;
+            blockPc[b] = (uint32_t)vcode.size();
+            const IrBlock& block = fn->blocks[b];
+            for (int32_t id : block.code) {
+                const IrValue& v = fn->values[id];
+                curOffset = v.offset;
+                int32_t dst = base + id;
+                switch (v.op) {
+                case IR_CONST: case IR_PARAM: case IR_PHI:
+                    break;
+                case IR_COPY: put(OP_MOV, dst, operand(v.args[0])); break;
+                case IR_ADD: case IR_SUB: {
+                    // 加减常量用 ADDI
+                    int32_t l = v.args[0], r = v.args[1];
+                    if (fn->values[r].op == IR_CONST) {
+                        uint32_t k = (uint32_t)fn->values[r].imm;
+                        put(OP_ADDI, dst, operand(l), (int32_t)(v.op == IR_ADD ? k : 0u - k));
+                    } else if (v.op == IR_ADD && fn->values[l].op == IR_CONST) {
+                        put(OP_ADDI, dst, operand(r), fn->values[l].imm);
+                    } else {
+                        int32_t x = operand(l), y = operand(r);
+                        put(v.op == IR_ADD ? OP_ADD : OP_SUB, dst, x, y);
+                    }
+                    break;
+                }
+                case IR_MUL: case IR_DIV: {
+                    int32_t x = operand(v.args[0]), y = operand(v.args[1]);
+                    put(v.op == IR_MUL ? OP_MUL : OP_DIV, dst, x, y);
+                    break;
+                }
+                case IR_NEG: put(OP_NEG, dst, operand(v.args[0])); break;
+                case IR_GETG: put(OP_GETG, dst, v.imm); break;
+                case IR_SETG: put(OP_SETG, v.imm, operand(v.args[0])); break;
+                case IR_LOADA: case IR_LOADGA: put(v.op == IR_LOADA ? OP_LOADA : OP_LOADGA, dst, v.imm, operand(v.args[0])); break;
+                case IR_STOREA: case IR_STOREGA: {
+                    int32_t x = operand(v.args[0]), y = operand(v.args[1]);
+                    put(v.op == IR_STOREA ? OP_STOREA : OP_STOREGA, v.imm, x, y);
+                    break;
+                }
+                case IR_CALL: {
+                    vector<pair<int32_t, int32_t>> copies;
+                    for (size_t a = 0; a < v.args.size(); a++) copies.push_back({staging + (int32_t)a, v.args[a]});
+                    parallelCopy(copies);
+                    put(OP_CALL, v.imm, staging, used[id] ? dst : -1);
+                    break;
+                }
+                case IR_READI: put(OP_READI, dst); break;
+                case IR_READC: put(OP_READC, dst); break;
+                case IR_PRINTS: put(OP_PRINTS, v.imm); break;
+                case IR_PRINTI: put(OP_PRINTI, operand(v.args[0])); break;
+                case IR_PRINTC: put(OP_PRINTC, operand(v.args[0])); break;
+                case IR_PRINTNL: put(OP_PRINTNL, 0); break;
+                case IR_JMP: {
+                    uint32_t s = block.succs[0];
+                    phiCopies(b, s);
+                    curOffset = v.offset;
+                    if (s != next) put(OP_JMP, (int32_t)s);
+                    break;
+                }
+                case IR_BR: {
+                    int32_t x = operand(v.args[0]);
+                    int32_t y = v.args.size() > 1 ? operand(v.args[1]) : 0;
+                    uint32_t yes = block.succs[0], no = block.succs[1];
+                    if (yes == next) {
+                        put(irNegate(v.imm), (int32_t)no, x, y);
+                    } else {
+                        put((Opcode)v.imm, (int32_t)yes, x, y);
+                        if (no != next) put(OP_JMP, (int32_t)no);
+                    }
+                    break;
+                }
+                case IR_RET: put(OP_RET, operand(v.args[0])); break;
+                case IR_RETV: put(OP_RETV, 0); break;
+                case IR_HALT: put(OP_HALT, 0); break;
+                default: break;
+                }
+            }
+        }
+    }
+
+    void phiCopies(uint32_t from, uint32_t to) {
+        const IrBlock& succ = fn->blocks[to];
+        size_t k = find(succ.preds.begin(), succ.preds.end(), from) - succ.preds.begin();
+        vector<pair<int32_t, int32_t>> copies;
+        for (int32_t id : succ.code) {
+            if (fn->values[id].op == IR_PHI) copies.push_back({base + id, fn->values[id].args[k]});
+        }
+        if (!copies.empty()) parallelCopy(copies);
+    }
+
+    // 给虚拟槽分配实际的槽 (槽的个数不限，不冲突的共用一个)，返回栈帧大小
+    uint32_t allocateSlots() {
+        size_t n = vcode.size();
+        // 调用的实参槽也参加分配，但槽是固定的 (预先着色)，这样算实参的指令可以直接写到实参槽里
+        int32_t virtualCount = nextTemp - staging;
+        int32_t fixedCount = base - staging;
+        vector<int32_t> uses;
+        int32_t def;
+        bool isCall;
+        vector<bool> leader(n + 1, false);
+        leader[0] = true;
+        for (size_t i = 0; i < n; i++) {
+            const Instr& in = vcode[i];
+            if (in.op >= OP_JMP && in.op <= OP_JGE) leader[blockPc[in.a]] = true;
+            if ((in.op >= OP_JMP && in.op <= OP_JGE) || in.op == OP_RET || in.op == OP_RETV || in.op == OP_HALT) leader[i + 1] = true;
+        }
+        vector<uint32_t> starts;
+        for (size_t i = 0; i < n; i++) {
+            if (leader[i]) starts.push_back((uint32_t)i);
+        }
+        size_t blocks = starts.size();
+        starts.push_back((uint32_t)n);
+        vector<uint32_t> blockAt(n + 1, 0);
+        for (size_t b = 0; b < blocks; b++) blockAt[starts[b]] = (uint32_t)b;
+        size_t words = ((size_t)virtualCount + 63) / 64;
+        vector<uint64_t> gen(blocks * words), kill(blocks * words), liveIn(blocks * words), liveOut(blocks * words);
+        auto isVirtual = [&](int32_t s) { return s >= staging; };
+        for (size_t b = 0; b < blocks; b++) {
+            for (uint32_t i = starts[b]; i < starts[b + 1]; i++) {
+                instrOperands(*bc, vcode[i], uses, def, isCall);
+                for (int32_t s : uses) {
+                    if (!isVirtual(s)) continue;
+                    size_t k = (size_t)(s - staging);
+                    if (!((kill[b * words + k / 64] >> (k % 64)) & 1)) gen[b * words + k / 64] |= (uint64_t)1 << (k % 64);
+                }
+                if (def >= 0 && isVirtual(def)) kill[b * words + (def - staging) / 64] |= (uint64_t)1 << ((def - staging) % 64);
+            }
+        }
+        auto successors = [&](size_t b, uint32_t succ[2]) {
+            const Instr& last = vcode[starts[b + 1] - 1];
+            int cnt = 0;
+            if (last.op >= OP_JMP && last.op <= OP_JGE) succ[cnt++] = blockAt[blockPc[last.a]];
+            if (last.op != OP_JMP && last.op != OP_RET && last.op != OP_RETV && last.op != OP_HALT && b + 1 < blocks) succ[cnt++] = (uint32_t)b + 1;
+            return cnt;
+        };
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (size_t b = blocks; b-- > 0;) {
+                uint32_t succ[2];
+                int cnt = successors(b, succ);
+                for (int s = 0; s < cnt; s++) {
+                    for (size_t w = 0; w < words; w++) liveOut[b * words + w] |= liveIn[succ[s] * words + w];
+                }
+                for (size_t w = 0; w < words; w++) {
+                    uint64_t in = gen[b * words + w] | (liveOut[b * words + w] & ~kill[b * words + w]);
+                    if (in != liveIn[b * words + w]) {
+                        liveIn[b * words + w] = in;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        // 冲突图：定义一个虚拟槽时，与此刻活跃的其他虚拟槽冲突 (复制指令的源除外)；
+        // 常量临时槽还与用它的指令的结果冲突，这样后端总能把它当成立即数
+        vector<set<int32_t>> conflicts(virtualCount);
+        vector<uint64_t> live(words);
+        for (size_t b = 0; b < blocks; b++) {
+            copy(liveOut.begin() + b * words, liveOut.begin() + (b + 1) * words, live.begin());
+            for (uint32_t i = starts[b + 1]; i-- > starts[b];) {
+                const Instr& in = vcode[i];
+                instrOperands(*bc, in, uses, def, isCall);
+                if (def >= 0 && isVirtual(def)) {
+                    int32_t d = def - staging;
+                    int32_t src = in.op == OP_MOV && isVirtual(in.b) ? in.b - staging : -1;
+                    for (size_t w = 0; w < words; w++) {
+                        for (uint64_t bits = live[w]; bits; bits &= bits - 1) {
+                            int32_t k = (int32_t)(w * 64 + __builtin_ctzll(bits));
+                            if (k == d || k == src) continue;
+                            conflicts[d].insert(k);
+                            conflicts[k].insert(d);
+                        }
+                    }
+                    live[d / 64] &= ~((uint64_t)1 << (d % 64));
+                    for (int32_t u : uses) {
+                        if (u >= base && (size_t)(u - base) < constTemp.size() && constTemp[u - base] && u - staging != d) {
+                            conflicts[d].insert(u - staging);
+                            conflicts[u - staging].insert(d);
+                        }
+                    }
+                }
+                for (int32_t u : uses) {
+                    if (isVirtual(u)) live[(u - staging) / 64] |= (uint64_t)1 << ((u - staging) % 64);
+                }
+            }
+        }
+        // 合并互不冲突的复制两端 (主要是 φ 的复制)，合并后复制指令变成自己复制给自己，最后删掉
+        vector<int32_t> group(virtualCount);
+        for (int32_t k = 0; k < virtualCount; k++) group[k] = k;
+        auto findLeader = [&](int32_t k) {
+            while (group[k] != k) k = group[k] = group[group[k]];
+            return k;
+        };
+        for (const Instr& in : vcode) {
+            if (in.op != OP_MOV || !isVirtual(in.a) || !isVirtual(in.b)) continue;
+            int32_t x = findLeader(in.a - staging), y = findLeader(in.b - staging);
+            if (x == y || conflicts[x].count(y) || (x < fixedCount && y < fixedCount)) continue;
+            if (y < fixedCount) swap(x, y);
+            group[y] = x;
+            for (int32_t n : conflicts[y]) {
+                conflicts[n].erase(y);
+                conflicts[n].insert(x);
+                conflicts[x].insert(n);
+            }
+            conflicts[y].clear();
+        }
+        // 按第一次出现的顺序给每组分配与相邻的组都不同的、编号最小的槽
+        vector<int32_t> slotOf(virtualCount, -1);
+        for (int32_t k = 0; k < fixedCount; k++) slotOf[k] = staging + k;
+        int32_t frame = base;
+        auto assign = [&](int32_t v) {
+            int32_t k = findLeader(v - staging);
+            if (slotOf[k] >= 0) return;
+            vector<bool> taken;
+            for (int32_t n : conflicts[k]) {
+                if (slotOf[n] < base) continue;
+                if ((size_t)(slotOf[n] - base) >= taken.size()) taken.resize(slotOf[n] - base + 1, false);
+                taken[slotOf[n] - base] = true;
+            }
+            int32_t slot = 0;
+            while ((size_t)slot < taken.size() && taken[slot]) slot++;
+            slotOf[k] = base + slot;
+            frame = max(frame, base + slot + 1);
+        };
+        for (const Instr& in : vcode) {
+            instrOperands(*bc, in, uses, def, isCall);
+            if (def >= 0 && isVirtual(def)) assign(def);
+            for (int32_t u : uses) {
+                if (isVirtual(u)) assign(u);
+            }
+        }
+        auto mapSlot = [&](int32_t& s) {
+            if (s >= staging) s = slotOf[findLeader(s - staging)];
+        };
+        for (Instr& in : vcode) {
+            switch (in.op) {
+            case OP_LOADK: case OP_GETG: case OP_READI: case OP_READC: case OP_RET: case OP_PRINTI: case OP_PRINTC:
+                mapSlot(in.a);
+                break;
+            case OP_MOV: case OP_ADDI: case OP_NEG:
+                mapSlot(in.a);
+                mapSlot(in.b);
+                break;
+            case OP_SETG: case OP_JZ: case OP_JNZ:
+                mapSlot(in.b);
+                break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+                mapSlot(in.a);
+                mapSlot(in.b);
+                mapSlot(in.c);
+                break;
+            case OP_LOADA: case OP_LOADGA:
+                mapSlot(in.a);
+                mapSlot(in.c);
+                break;
+            case OP_STOREA: case OP_STOREGA: case OP_JEQ: case OP_JNE: case OP_JLT: case OP_JLE: case OP_JGT: case OP_JGE:
+                mapSlot(in.b);
+                mapSlot(in.c);
+                break;
+            case OP_CALL:
+                mapSlot(in.c);
+                break;
+            default:
+                break;
+            }
+        }
+        vector<uint32_t> newPc(n + 1);
+        size_t kept = 0;
+        for (size_t i = 0; i < n; i++) {
+            newPc[i] = (uint32_t)kept;
+            if (vcode[i].op == OP_MOV && vcode[i].a == vcode[i].b) continue;
+            vcode[kept] = vcode[i];
+            voffsets[kept++] = voffsets[i];
+        }
+        newPc[n] = (uint32_t)kept;
+        vcode.resize(kept);
+        voffsets.resize(kept);
+        for (uint32_t& pc : blockPc) pc = newPc[pc];
+        return (uint32_t)frame;
+    }
+};
+
+// 调试输出：列出一个函数的中间表示
+void dumpIr(const IrFunction& fn, const Bytecode& bc, ostream& out) {
+    const FuncInfo& f = bc.funcs[fn.func];
+    out << "function " << f.name << " (params " << f.params << ")\n";
+    for (uint32_t b : fn.layout) {
+        const IrBlock& block = fn.blocks[b];
+        if (block.removed) continue;
+        out << "  b" << b << ":";
+        if (!block.preds.empty()) {
+            out << "    ; preds";
+            for (uint32_t p : block.preds) out << " b" << p;
+        }
+        out << "\n";
+        for (int32_t id : block.code) {
+            const IrValue& v = fn.values[id];
+            out << "    ";
+            if (irHasResult(v.op)) out << "v" << id << " = ";
+            out << irOpNames[v.op];
+            switch (v.op) {
+            case IR_CONST: case IR_PARAM: out << " " << v.imm; break;
+            case IR_GETG: case IR_SETG: out << " g" << v.imm; break;
+            case IR_LOADA: case IR_STOREA: case IR_LOADGA: case IR_STOREGA: out << " a" << v.imm; break;
+            case IR_CALL: out << " " << bc.funcs[v.imm].name; break;
+            case IR_PRINTS: out << " \"" << bc.strings[v.imm] << "\""; break;
+            case IR_BR: out << " " << opcodeNames[v.imm]; break;
+            default: break;
+            }
+            for (size_t a = 0; a < v.args.size(); a++) {
+                out << (a ? ", v" : " v") << v.args[a];
+                if (v.op == IR_PHI) out << " [b" << block.preds[a] << "]";
+            }
+            if (v.op == IR_JMP || v.op == IR_BR) {
+                out << " ->";
+                for (uint32_t s : block.succs) out << " b" << s;
+            }
+            out << "\n";
+        }
+    }
+}
+
+// 整个程序逐个函数提升、优化、翻译回字节码
+void optimizeBytecode(Bytecode& bc) {
+    vector<Instr> code;
+    vector<uint32_t> offsets;
+    code.reserve(bc.code.size());
+    offsets.reserve(bc.code.size());
+    vector<FuncInfo> funcs = bc.funcs;
+    for (uint32_t f = 0; f < bc.funcs.size(); f++) {
+        IrFunction fn;
+        IrBuilder().build(bc, f, fn);
+        IrOptimizer(fn, bc).run();
+        funcs[f].entry = (uint32_t)code.size();
+        IrLowering().lower(fn, bc, code, offsets, funcs[f].frameSize);
+    }
+    bc.code.swap(code);
+    bc.offsets.swap(offsets);
+    bc.funcs.swap(funcs);
+}
+
+// --ir：列出每个函数优化前后的中间表示
+void dumpIrPasses(const Bytecode& bc, ostream& out) {
+    for (uint32_t f = 0; f < bc.funcs.size(); f++) {
+        IrFunction fn;
+        IrBuilder().build(bc, f, fn);
+        out << "; before\n";
+        dumpIr(fn, bc, out);
+        IrOptimizer(fn, bc).run();
+        out << "; after\n";
+        dumpIr(fn, bc, out);
+    }
+}
+
+// ==========================================
+// 8. x86-64 代码生成
+// ==========================================
+
+// 从字节码生成 GNU as (AT&T 语法) 汇编，用系统的 gcc/cc 汇编链接成可执行文件：
+//     实验三 --asm prog.txt > prog.s && gcc prog.s -o prog
+// 每个函数里的标量槽用线性扫描分配到寄存器，数组和溢出的槽放在栈帧里 (槽号 s 在 帧底 + 4s)；
+// 函数之间按 System V 调用约定传参，输入输出调用 C 库的 scanf/printf/putchar
+
+// 可分配的寄存器：跨调用活跃的值只能放被调函数保存的寄存器，其余的也可以放调用方保存的寄存器。
+// eax/ecx/edx 留作指令展开时的临时寄存器 (除法、数组下标、参数传递)
+const char* const calleeSavedRegs[] = {"%ebx", "%r12d", "%r13d", "%r14d", "%r15d"};
+const char* const calleeSavedRegs64[] = {"%rbx", "%r12", "%r13", "%r14", "%r15"};
+const char* const callerSavedRegs[] = {"%esi", "%edi", "%r8d", "%r9d", "%r10d", "%r11d"};
+const char* const callerSavedRegs64[] = {"%rsi", "%rdi", "%r8", "%r9", "%r10", "%r11"};
+const char* const argRegs[] = {"%edi", "%esi", "%edx", "%ecx", "%r8d", "%r9d"};
+const int CALLEE_SAVED_COUNT = 5;
+const int CALLER_SAVED_COUNT = 6;
+
+// 调用前检查栈空间时按被调函数最大可能的栈帧估算：返回地址、rbp、被调方保存的寄存器、对齐
+const int32_t ASM_FRAME_OVERHEAD = 16 + 8 * CALLEE_SAVED_COUNT + 16;
+
+class AsmGenerator {
+public:
+    void generate(const Bytecode& program, OutBuffer& out) {
+        bc = &program;
+        os = &out;
+        out << "\t.text\n";
+        for (size_t f = 0; f < bc->funcs.size(); f++) function((uint32_t)f);
+        runtime();
+        out << "\t.section .rodata\n"
+            << ".Lfmt_d:\n\t.string \"%d\"\n"
+            << ".Lfmt_c:\n\t.string \" %c\"\n"
+            << ".Lfmt_s:\n\t.string \"%s\"\n"
+            << ".Lfmt_err:\n\t.string \"Error: line %d, column %d: runtime error: %s\\n\"\n"
+            << ".Lmsg_div:\n\t.string \"division by zero\"\n"
+            << ".Lmsg_oob:\n\t.string \"array index out of bounds\"\n"
+            << ".Lmsg_stack:\n\t.string \"stack overflow\"\n";
+        for (size_t s = 0; s < bc->strings.size(); s++) {
+            out << ".Lstr" << to_string(s) << ":\n\t.string \"";
+            for (char ch : bc->strings[s]) {
+                if (ch == '"' || ch == '\\') out << '\\' << ch;
+                else if ((unsigned char)ch < 32 || (unsigned char)ch >= 127) out << '\\' << to_string((ch >> 6) & 3) << to_string((ch >> 3) & 7) << to_string(ch & 7);
+                else out << ch;
+            }
+            out << "\"\n";
+        }
+        out << "\t.bss\n\t.align 8\nlab3_stack_limit:\n\t.zero 8\n"
+            << "lab3_globals:\n\t.zero " << to_string(max<uint32_t>(4, bc->globalSize * 4)) << "\n"
+            << "\t.section .note.GNU-stack,\"\",@progbits\n";
+    }
+
+private:
+    const Bytecode* bc = nullptr;
+    OutBuffer* os = nullptr;
+
+    // 一个槽从某次赋值到最后一次使用之间的一段活跃范围；沿控制流边连在一起的几段合成一个值 (web)，
+    // 同一个值的所有段放在同一个位置。临时量的槽会被反复复用，按值分配才不会把互不相干的几次使用连成一个长区间
+    struct Segment {
+        uint32_t from, to;
+        int32_t parent; // 并查集
+    };
+    struct Web {
+        int32_t slot;
+        uint32_t from = UINT32_MAX, to = 0;
+        int32_t reg = -1; // 寄存器编号 (先被调方保存的，再调用方保存的)，-1 表示在栈帧里
+    };
+    // 指令展开时的一个操作数：寄存器、栈帧里的槽或立即数
+    struct Val {
+        int32_t slot;
+        int32_t reg;
+        bool imm;
+        int32_t value;
+    };
+
+    // 当前函数
+    uint32_t funcId = 0, begin = 0, end = 0;
+    vector<int32_t> index;                // 槽 -> 参与分配的槽的编号
+    vector<vector<uint32_t>> slotSegs;    // 每个槽的各段，按位置排序
+    vector<Segment> segs;
+    vector<int32_t> webOf;                // 段 -> 值
+    vector<Web> webs;
+    vector<pair<int32_t, uint32_t>> entryLive; // 入口处活跃的槽和它所在的段 (参数，或先读后写、要清零的局部变量)
+    vector<bool> jumpTarget;              // 指令是跳转目标，需要标号
+    vector<bool> folded;                  // LOADK 并进了下一条指令的立即数 (那个槽在下一条指令之后就不再用)
+    uint32_t curPos = 0;                  // 正在展开的指令读操作数的位置
+    int32_t frameBytes = 0;               // 被调方保存寄存器以下、槽所在区域的大小
+    int savedCount = 0;                   // 用到的被调方保存寄存器个数
+    struct ErrorStub {
+        string label;
+        uint32_t offset;
+        const char* msg;
+    };
+    vector<ErrorStub> stubs;
+
+    OutBuffer& out() { return *os; }
+
+    void operands(const Instr& in, vector<int32_t>& uses, int32_t& def, bool& isCall) const {
+        instrOperands(*bc, in, uses, def, isCall);
+    }
+
+    static bool isJump(Opcode op) { return op >= OP_JMP && op <= OP_JGE; }
+    static bool endsBlock(Opcode op) { return isJump(op) || op == OP_RET || op == OP_RETV || op == OP_HALT; }
+    static bool fallsThrough(Opcode op) { return op != OP_JMP && op != OP_RET && op != OP_RETV && op != OP_HALT; }
+
+    int32_t findRoot(int32_t s) {
+        while (segs[s].parent != s) s = segs[s].parent = segs[segs[s].parent].parent;
+        return s;
+    }
+
+    uint32_t newSegment(int32_t k, uint32_t pos) {
+        segs.push_back({pos, pos, (int32_t)segs.size()});
+        slotSegs[k].push_back((uint32_t)segs.size() - 1);
+        return (uint32_t)segs.size() - 1;
+    }
+
+    // --- 活跃范围与线性扫描 ---
+
+    void allocate() {
+        const FuncInfo& f = bc->funcs[funcId];
+        size_t slots = f.frameSize;
+        vector<int32_t> uses;
+        int32_t def;
+        bool isCall;
+
+        // 1. 参与分配的槽 (在指令里出现过的) 和基本块
+        index.assign(slots, -1);
+        vector<int32_t> slotOf;
+        jumpTarget.assign(end - begin + 1, false);
+        vector<bool> leader(end - begin + 1, false);
+        leader[0] = true;
+        for (uint32_t i = begin; i < end; i++) {
+            const Instr& in = bc->code[i];
+            operands(in, uses, def, isCall);
+            if (def >= 0) uses.push_back(def);
+            for (int32_t s : uses) {
+                if (index[s] < 0) {
+                    index[s] = (int32_t)slotOf.size();
+                    slotOf.push_back(s);
+                }
+            }
+            if (isJump(in.op)) jumpTarget[in.a - begin] = leader[in.a - begin] = true;
+            if (endsBlock(in.op)) leader[i + 1 - begin] = true;
+        }
+        vector<uint32_t> blockStart;
+        for (uint32_t i = begin; i < end; i++) {
+            if (leader[i - begin]) blockStart.push_back(i);
+        }
+        size_t blockCount = blockStart.size();
+        blockStart.push_back(end);
+        vector<uint32_t> blockOf(end - begin);
+        for (size_t b = 0; b < blockCount; b++) {
+            for (uint32_t i = blockStart[b]; i < blockStart[b + 1]; i++) blockOf[i - begin] = (uint32_t)b;
+        }
+        auto successors = [&](size_t b, uint32_t succ[2]) {
+            const Instr& last = bc->code[blockStart[b + 1] - 1];
+            int n = 0;
+            if (isJump(last.op)) succ[n++] = blockOf[last.a - begin];
+            if (fallsThrough(last.op) && blockStart[b + 1] < end) succ[n++] = (uint32_t)b + 1;
+            return n;
+        };
+
+        // 2. 按基本块求活跃变量 (位集合，迭代到不动点)
+        size_t words = (slotOf.size() + 63) / 64;
+        vector<uint64_t> gen(blockCount * words), kill(blockCount * words), liveIn(blockCount * words), liveOut(blockCount * words);
+        auto bit = [&](const vector<uint64_t>& set, size_t b, size_t k) -> bool { return (set[b * words + k / 64] >> (k % 64)) & 1; };
+        for (size_t b = 0; b < blockCount; b++) {
+            for (uint32_t i = blockStart[b]; i < blockStart[b + 1]; i++) {
+                operands(bc->code[i], uses, def, isCall);
+                for (int32_t s : uses) {
+                    if (!bit(kill, b, index[s])) gen[b * words + index[s] / 64] |= (uint64_t)1 << (index[s] % 64);
+                }
+                if (def >= 0) kill[b * words + index[def] / 64] |= (uint64_t)1 << (index[def] % 64);
+            }
+        }
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (size_t b = blockCount; b-- > 0;) {
+                uint32_t succ[2];
+                int n = successors(b, succ);
+                uint64_t* outSet = &liveOut[b * words];
+                for (int s = 0; s < n; s++) {
+                    for (size_t w = 0; w < words; w++) outSet[w] |= liveIn[succ[s] * words + w];
+                }
+                for (size_t w = 0; w < words; w++) {
+                    uint64_t in = gen[b * words + w] | (outSet[w] & ~kill[b * words + w]);
+                    if (in != liveIn[b * words + w]) {
+                        liveIn[b * words + w] = in;
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        // 常量折进下一条指令：LOADK t 之后紧接着 (同一基本块) 读 t、随后 t 不再活跃
+        folded.assign(end - begin, false);
+        vector<uint64_t> live(words);
+        for (size_t b = 0; b < blockCount; b++) {
+            copy(liveOut.begin() + b * words, liveOut.begin() + (b + 1) * words, live.begin());
+            for (uint32_t i = blockStart[b + 1]; i-- > blockStart[b];) {
+                const Instr& in = bc->code[i];
+                operands(in, uses, def, isCall);
+                if (i > blockStart[b] && in.op != OP_JZ && in.op != OP_JNZ) {
+                    int32_t t = bc->code[i - 1].a;
+                    if (bc->code[i - 1].op == OP_LOADK && def != t && !((live[index[t] / 64] >> (index[t] % 64)) & 1)
+                        && find(uses.begin(), uses.end(), t) != uses.end()) {
+                        folded[i - 1 - begin] = true;
+                    }
+                }
+                if (def >= 0) live[index[def] / 64] &= ~((uint64_t)1 << (index[def] % 64));
+                for (int32_t s : uses) live[index[s] / 64] |= (uint64_t)1 << (index[s] % 64);
+            }
+        }
+
+        // 3. 活跃范围：位置 2i 是指令 i 读操作数的时刻，2i+1 是写结果的时刻。
+        // 每个块里从入口活跃或者被赋值处开始一段，读的时候延长，出口活跃的延长到块尾
+        segs.clear();
+        slotSegs.assign(slotOf.size(), {});
+        vector<int32_t> open(slotOf.size(), -1);
+        vector<int32_t> touched;
+        vector<vector<pair<int32_t, uint32_t>>> startSegs(blockCount), endSegs(blockCount);
+        vector<uint32_t> callPos;
+        auto forEachBit = [&](const vector<uint64_t>& set, size_t b, auto fn) {
+            for (size_t w = 0; w < words; w++) {
+                for (uint64_t bits = set[b * words + w]; bits; bits &= bits - 1) {
+                    int low = 0;
+                    while (!((bits >> low) & 1)) low++;
+                    fn((int32_t)(w * 64 + low));
+                }
+            }
+        };
+        for (size_t b = 0; b < blockCount; b++) {
+            uint32_t first = 2 * (blockStart[b] - begin), last = 2 * (blockStart[b + 1] - begin) - 1;
+            touched.clear();
+            forEachBit(liveIn, b, [&](int32_t k) {
+                open[k] = (int32_t)newSegment(k, first);
+                touched.push_back(k);
+                startSegs[b].push_back({k, (uint32_t)open[k]});
+            });
+            for (uint32_t i = blockStart[b]; i < blockStart[b + 1]; i++) {
+                uint32_t pos = 2 * (i - begin);
+                operands(bc->code[i], uses, def, isCall);
+                int32_t imm = i > begin && folded[i - 1 - begin] ? bc->code[i - 1].a : -1;
+                for (int32_t s : uses) {
+                    if (s == imm) continue;
+                    int32_t k = index[s];
+                    if (open[k] < 0) {
+                        open[k] = (int32_t)newSegment(k, pos);
+                        touched.push_back(k);
+                    }
+                    segs[open[k]].to = pos;
+                }
+                if (def >= 0 && !folded[i - begin]) {
+                    int32_t k = index[def];
+                    open[k] = (int32_t)newSegment(k, pos + 1);
+                    touched.push_back(k);
+                }
+                if (isCall) callPos.push_back(pos);
+            }
+            forEachBit(liveOut, b, [&](int32_t k) {
+                if (open[k] < 0) {
+                    open[k] = (int32_t)newSegment(k, last);
+                    touched.push_back(k);
+                }
+                segs[open[k]].to = last;
+                endSegs[b].push_back({k, (uint32_t)open[k]});
+            });
+            for (int32_t k : touched) open[k] = -1;
+        }
+        if (blockCount > 0) entryLive = startSegs[0];
+        else entryLive.clear();
+        for (auto& e : entryLive) e.first = slotOf[e.first];
+
+        // 沿每条控制流边把出口处和入口处的段连起来
+        vector<int32_t> endOf(slotOf.size(), -1);
+        for (size_t b = 0; b < blockCount; b++) {
+            for (auto& e : endSegs[b]) endOf[e.first] = (int32_t)e.second;
+            uint32_t succ[2];
+            int n = successors(b, succ);
+            for (int s = 0; s < n; s++) {
+                for (auto& e : startSegs[succ[s]]) {
+                    if (endOf[e.first] >= 0) segs[findRoot((int32_t)e.second)].parent = findRoot(endOf[e.first]);
+                }
+            }
+            for (auto& e : endSegs[b]) endOf[e.first] = -1;
+        }
+        webs.clear();
+        webOf.assign(segs.size(), -1);
+        for (size_t k = 0; k < slotOf.size(); k++) {
+            for (uint32_t s : slotSegs[k]) {
+                int32_t root = findRoot((int32_t)s);
+                if (webOf[root] < 0) {
+                    webOf[root] = (int32_t)webs.size();
+                    webs.push_back(Web{slotOf[k]});
+                }
+                Web& w = webs[webOf[root]];
+                webOf[s] = webOf[root];
+                w.from = min(w.from, segs[s].from);
+                w.to = max(w.to, segs[s].to);
+            }
+        }
+
+        // 4. 线性扫描：按起点排序，依次分配；没有空闲寄存器时，终点最远的那个值整个留在栈帧里
+        vector<size_t> order(webs.size());
+        for (size_t k = 0; k < order.size(); k++) order[k] = k;
+        sort(order.begin(), order.end(), [&](size_t x, size_t y) { return webs[x].from < webs[y].from; });
+        auto crossesCall = [&](const Web& w) {
+            auto it = lower_bound(callPos.begin(), callPos.end(), w.from > 0 ? w.from - 1 : 0);
+            return it != callPos.end() && *it <= w.to;
+        };
+        vector<size_t> active; // 占着寄存器的值
+        bool regFree[CALLEE_SAVED_COUNT + CALLER_SAVED_COUNT];
+        fill(regFree, regFree + CALLEE_SAVED_COUNT + CALLER_SAVED_COUNT, true);
+        bool calleeUsed[CALLEE_SAVED_COUNT] = {};
+        for (size_t k : order) {
+            Web& w = webs[k];
+            for (size_t a = 0; a < active.size();) {
+                if (webs[active[a]].to < w.from) {
+                    regFree[webs[active[a]].reg] = true;
+                    active[a] = active.back();
+                    active.pop_back();
+                } else {
+                    a++;
+                }
+            }
+            bool callerOk = !crossesCall(w);
+            int chosen = -1;
+            if (callerOk) {
+                for (int r = CALLEE_SAVED_COUNT; r < CALLEE_SAVED_COUNT + CALLER_SAVED_COUNT && chosen < 0; r++) {
+                    if (regFree[r]) chosen = r;
+                }
+            }
+            for (int r = 0; r < CALLEE_SAVED_COUNT && chosen < 0; r++) {
+                if (regFree[r]) chosen = r;
+            }
+            if (chosen < 0) {
+                // 挑一个能换给它的、终点最远的值
+                size_t victim = SIZE_MAX;
+                for (size_t a = 0; a < active.size(); a++) {
+                    const Web& v = webs[active[a]];
+                    if ((callerOk || v.reg < CALLEE_SAVED_COUNT) && (victim == SIZE_MAX || v.to > webs[active[victim]].to)) victim = a;
+                }
+                if (victim == SIZE_MAX || webs[active[victim]].to <= w.to) continue; // 自己留在栈帧里
+                chosen = webs[active[victim]].reg;
+                webs[active[victim]].reg = -1;
+                active[victim] = active.back();
+                active.pop_back();
+            }
+            w.reg = chosen;
+            regFree[chosen] = false;
+            if (chosen < CALLEE_SAVED_COUNT) calleeUsed[chosen] = true;
+            active.push_back(k);
+        }
+        // 用到的被调方保存寄存器按编号连续使用，方便入口/出口保存恢复
+        savedCount = 0;
+        for (int r = 0; r < CALLEE_SAVED_COUNT; r++) {
+            if (calleeUsed[r]) savedCount = r + 1;
+        }
+        // 栈帧只需要容纳真正放在内存里的槽：溢出的值、经过栈帧装入的参数、局部数组
+        int32_t memSlots = 0;
+        for (const Web& w : webs) {
+            if (w.reg < 0) memSlots = max(memSlots, w.slot + 1);
+        }
+        for (const auto& e : entryLive) {
+            int32_t r = webs[webOf[slotSegs[index[e.first]][0]]].reg;
+            if ((uint32_t)e.first < f.params && (r < 0 || r >= CALLEE_SAVED_COUNT)) memSlots = max(memSlots, e.first + 1);
+        }
+        for (uint32_t i = begin; i < end; i++) {
+            const Instr& in = bc->code[i];
+            int32_t arr = in.op == OP_LOADA ? in.b : in.op == OP_STOREA ? in.a : -1;
+            if (arr >= 0) memSlots = max(memSlots, bc->arrays[arr].base + bc->arrays[arr].len);
+        }
+        int32_t total = 8 * savedCount + 4 * memSlots;
+        total = (total + 15) / 16 * 16;
+        frameBytes = total - 8 * savedCount;
+    }
+
+    // --- 操作数的写法 ---
+
+    int32_t slotOffset(int32_t slot) const { return -8 * savedCount - frameBytes + 4 * slot; }
+    string mem(int32_t slot) const { return to_string(slotOffset(slot)) + "(%rbp)"; }
+
+    // 槽在位置 pos 所属的值
+    Val at(int32_t slot, uint32_t pos) const {
+        const vector<uint32_t>& list = slotSegs[index[slot]];
+        size_t lo = 0, hi = list.size();
+        while (hi - lo > 1) {
+            size_t mid = (lo + hi) / 2;
+            if (segs[list[mid]].from <= pos) lo = mid;
+            else hi = mid;
+        }
+        return {slot, webs[webOf[list[lo]]].reg, false, 0};
+    }
+    // 当前指令读的操作数 (并进来的常量是立即数) 和写的结果
+    Val src(int32_t slot) const {
+        uint32_t pc = begin + curPos / 2;
+        if (pc > begin && folded[pc - 1 - begin] && bc->code[pc - 1].a == slot) return {slot, -1, true, bc->code[pc - 1].b};
+        return at(slot, curPos);
+    }
+    Val dst(int32_t slot) const { return at(slot, curPos + 1); }
+
+    static bool inReg(const Val& v) { return v.reg >= 0; }
+    string loc(const Val& v) const {
+        if (v.imm) return "$" + to_string(v.value);
+        if (v.reg < 0) return mem(v.slot);
+        return v.reg < CALLEE_SAVED_COUNT ? calleeSavedRegs[v.reg] : callerSavedRegs[v.reg - CALLEE_SAVED_COUNT];
+    }
+    static string loc64(const Val& v) {
+        return v.reg < CALLEE_SAVED_COUNT ? calleeSavedRegs64[v.reg] : callerSavedRegs64[v.reg - CALLEE_SAVED_COUNT];
+    }
+    static string global(int32_t index) { return "lab3_globals+" + to_string(4 * index) + "(%rip)"; }
+    static string label(uint32_t target) { return ".L" + to_string(target); }
+
+    void ins(const string& text) { out() << '\t' << text << '\n'; }
+
+    // dst = src，两边都在内存时经过 eax
+    void move(const string& to, const string& from) {
+        if (to == from) return;
+        if (to.back() == ')' && from.back() == ')') {
+            ins("movl " + from + ", %eax");
+            ins("movl %eax, " + to);
+        } else {
+            ins("movl " + from + ", " + to);
+        }
+    }
+
+    // 运行时错误：条件成立时跳到函数末尾的出错代码
+    void check(const string& jcc, const char* msg, uint32_t pc) {
+        string l = ".Lerr" + to_string(pc) + "_" + to_string(stubs.size());
+        ins(jcc + " " + l);
+        stubs.push_back({l, bc->offsets[pc], msg});
+    }
+
+    // 检查下标越界并给出数组元素的地址。寄存器里的 32 位值高半部分总是 0，可以直接当 64 位下标用；
+    // 常量下标在编译时检查
+    string element(int32_t arr, const Val& idx, bool isGlobal, uint32_t pc) {
+        const ArrayInfo& info = bc->arrays[arr];
+        if (idx.imm && idx.value >= 0 && idx.value < info.len) {
+            return isGlobal ? global(info.base + idx.value) : to_string(slotOffset(info.base) + 4 * idx.value) + "(%rbp)";
+        }
+        string reg64 = "%rcx";
+        if (inReg(idx)) {
+            reg64 = loc64(idx);
+            ins("cmpl $" + to_string(info.len) + ", " + loc(idx));
+        } else {
+            ins("movl " + loc(idx) + ", %ecx");
+            ins("cmpl $" + to_string(info.len) + ", %ecx");
+        }
+        check("jae", ".Lmsg_oob", pc);
+        if (!isGlobal) return to_string(slotOffset(info.base)) + "(%rbp," + reg64 + ",4)";
+        ins("leaq lab3_globals(%rip), %rdx");
+        return to_string(4 * info.base) + "(%rdx," + reg64 + ",4)";
+    }
+
+    // --- 函数 ---
+
+    void function(uint32_t id) {
+        const FuncInfo& f = bc->funcs[id];
+        funcId = id;
+        begin = f.entry;
+        end = id + 1 < bc->funcs.size() ? bc->funcs[id + 1].entry : (uint32_t)bc->code.size();
+        stubs.clear();
+        allocate();
+
+        string name = id == bc->mainFunc ? "main" : "lab3_" + f.name;
+        if (id == bc->mainFunc) out() << "\t.globl main\n";
+        out() << "\t.type " << name << ", @function\n" << name << ":\n";
+        ins("pushq %rbp");
+        ins("movq %rsp, %rbp");
+        if (id == bc->mainFunc) ins("call lab3_init");
+        for (int r = 0; r < savedCount; r++) ins(string("pushq ") + calleeSavedRegs64[r]);
+        if (frameBytes > 0) ins("subq $" + to_string(frameBytes) + ", %rsp");
+        if (id == bc->mainFunc) {
+            ins("cmpq lab3_stack_limit(%rip), %rsp");
+            check("jb", ".Lmsg_stack", begin);
+        }
+        // 参数：分到被调方保存寄存器的直接装入；分到调用方保存寄存器的可能和参数寄存器互相覆盖，
+        // 先存进栈帧，局部数组清零之后再装入
+        vector<int32_t> viaFrame;
+        for (const auto& e : entryLive) {
+            uint32_t i = (uint32_t)e.first;
+            if (i >= f.params) continue;
+            Val v = at(e.first, 0);
+            string incoming = i < 6 ? argRegs[i] : to_string(16 + 8 * (i - 6)) + "(%rbp)";
+            if (v.reg < 0 || v.reg >= CALLEE_SAVED_COUNT) {
+                move(mem(e.first), incoming);
+                if (inReg(v)) viaFrame.push_back(e.first);
+            } else {
+                ins("movl " + incoming + ", " + loc(v));
+            }
+        }
+        // 局部数组清零
+        vector<bool> zeroed(bc->arrays.size(), false);
+        for (uint32_t i = begin; i < end; i++) {
+            const Instr& in = bc->code[i];
+            int32_t arr = in.op == OP_LOADA ? in.b : in.op == OP_STOREA ? in.a : -1;
+            if (arr < 0 || zeroed[arr]) continue;
+            zeroed[arr] = true;
+            ins("leaq " + mem(bc->arrays[arr].base) + ", %rdi");
+            ins("movl $" + to_string(bc->arrays[arr].len) + ", %ecx");
+            ins("xorl %eax, %eax");
+            ins("rep stosl");
+        }
+        for (int32_t p : viaFrame) ins("movl " + mem(p) + ", " + loc(at(p, 0)));
+        for (const auto& e : entryLive) {
+            if ((uint32_t)e.first >= f.params) ins("movl $0, " + loc(at(e.first, 0)));
+        }
+
+        for (uint32_t i = begin; i < end; i++) {
+            if (jumpTarget[i - begin]) out() << label(i) << ":\n";
+            curPos = 2 * (i - begin);
+            instruction(i);
+        }
+
+        out() << ".Lret" << to_string(id) << ":\n";
+        if (savedCount > 0) ins("leaq " + to_string(-8 * savedCount) + "(%rbp), %rsp");
+        else if (frameBytes > 0) ins("movq %rbp, %rsp");
+        for (int r = savedCount; r-- > 0;) ins(string("popq ") + calleeSavedRegs64[r]);
+        ins("popq %rbp");
+        ins("ret");
+        for (const ErrorStub& stub : stubs) {
+            SourcePos pos = resolvePos(stub.offset);
+            out() << stub.label << ":\n";
+            ins("movl $" + to_string(pos.line) + ", %edi");
+            ins("movl $" + to_string(pos.column) + ", %esi");
+            ins(string("leaq ") + stub.msg + "(%rip), %rdx");
+            ins("call lab3_fail");
+        }
+        out() << "\t.size " << name << ", .-" << name << "\n";
+    }
+
+    void instruction(uint32_t pc) {
+        const Instr& in = bc->code[pc];
+        string ret = ".Lret" + to_string(funcId);
+        switch (in.op) {
+        case OP_LOADK:
+            if (!folded[pc - begin]) ins("movl $" + to_string(in.b) + ", " + loc(dst(in.a)));
+            break;
+        case OP_MOV:
+            move(loc(dst(in.a)), loc(src(in.b)));
+            break;
+        case OP_GETG:
+            move(loc(dst(in.a)), global(in.b));
+            break;
+        case OP_SETG:
+            move(global(in.a), loc(src(in.b)));
+            break;
+        case OP_ADD: case OP_SUB: case OP_MUL: {
+            const char* op = in.op == OP_ADD ? "addl" : in.op == OP_SUB ? "subl" : "imull";
+            Val av = dst(in.a);
+            string a = loc(av), b = loc(src(in.b)), c = loc(src(in.c));
+            if (inReg(av) && a != c) {
+                move(a, b);
+                ins(string(op) + " " + c + ", " + a);
+            } else if (inReg(av) && in.op != OP_SUB) {
+                ins(string(op) + " " + b + ", " + a); // a 与 c 是同一个寄存器，交换律
+            } else {
+                ins("movl " + b + ", %eax");
+                ins(string(op) + " " + c + ", %eax");
+                ins("movl %eax, " + a);
+            }
+            break;
+        }
+        case OP_DIV:
+            // 除数为 -1 时直接取负 (INT_MIN / -1 在 idiv 上会触发异常)
+            ins("movl " + loc(src(in.b)) + ", %eax");
+            ins("movl " + loc(src(in.c)) + ", %ecx");
+            ins("testl %ecx, %ecx");
+            check("je", ".Lmsg_div", pc);
+            ins("cmpl $-1, %ecx");
+            ins("jne 1f");
+            ins("negl %eax");
+            ins("jmp 2f");
+            out() << "1:\n";
+            ins("cltd");
+            ins("idivl %ecx");
+            out() << "2:\n";
+            ins("movl %eax, " + loc(dst(in.a)));
+            break;
+        case OP_ADDI: {
+            Val av = dst(in.a), bv = src(in.b);
+            string a = loc(av), b = loc(bv), imm = "$" + to_string(in.c);
+            if (a == b) {
+                ins("addl " + imm + ", " + a);
+            } else if (inReg(av) && inReg(bv)) {
+                ins("leal " + to_string(in.c) + "(" + loc64(bv) + "), " + a);
+            } else if (inReg(av)) {
+                ins("movl " + b + ", " + a);
+                ins("addl " + imm + ", " + a);
+            } else {
+                ins("movl " + b + ", %eax");
+                ins("addl " + imm + ", %eax");
+                ins("movl %eax, " + a);
+            }
+            break;
+        }
+        case OP_NEG: {
+            Val av = dst(in.a);
+            string a = loc(av), b = loc(src(in.b));
+            if (inReg(av) || a == b) {
+                move(a, b);
+                ins("negl " + a);
+            } else {
+                ins("movl " + b + ", %eax");
+                ins("negl %eax");
+                ins("movl %eax, " + a);
+            }
+            break;
+        }
+        case OP_LOADA: case OP_LOADGA:
+            move(loc(dst(in.a)), element(in.b, src(in.c), in.op == OP_LOADGA, pc));
+            break;
+        case OP_STOREA: case OP_STOREGA:
+            move(element(in.a, src(in.b), in.op == OP_STOREGA, pc), loc(src(in.c)));
+            break;
+        case OP_JMP:
+            ins("jmp " + label((uint32_t)in.a));
+            break;
+        case OP_JZ: case OP_JNZ:
+            ins("cmpl $0, " + loc(src(in.b)));
+            ins(string(in.op == OP_JZ ? "je " : "jne ") + label((uint32_t)in.a));
+            break;
+        case OP_JEQ: case OP_JNE: case OP_JLT: case OP_JLE: case OP_JGT: case OP_JGE: {
+            static const char* const jcc[] = {"je", "jne", "jl", "jle", "jg", "jge"};
+            static const char* const swapped[] = {"je", "jne", "jg", "jge", "jl", "jle"};
+            Val bv = src(in.b), cv = src(in.c);
+            string b = loc(bv), c = loc(cv);
+            if (bv.imm && inReg(cv)) {
+                // 常量在左边：交换比较的两边
+                ins("cmpl " + b + ", " + c);
+                ins(string(swapped[in.op - OP_JEQ]) + " " + label((uint32_t)in.a));
+                break;
+            }
+            if (!inReg(bv) && !inReg(cv)) {
+                ins("movl " + b + ", %eax");
+                b = "%eax";
+            }
+            ins("cmpl " + c + ", " + b);
+            ins(string(jcc[in.op - OP_JEQ]) + " " + label((uint32_t)in.a));
+            break;
+        }
+        case OP_CALL: {
+            // 先检查栈空间；跨越调用的值都不在调用方保存的寄存器里，实参可以按顺序直接装进参数寄存器
+            const FuncInfo& callee = bc->funcs[in.a];
+            uint32_t n = callee.params;
+            uint32_t stackArgs = n > 6 ? n - 6 : 0;
+            uint32_t pad = stackArgs % 2 ? 8 : 0;
+            int64_t need = ASM_FRAME_OVERHEAD + 4 * (int64_t)callee.frameSize + 8 * stackArgs + pad;
+            if (need < INT32_MAX) {
+                ins("leaq -" + to_string(need) + "(%rsp), %rax");
+                ins("cmpq lab3_stack_limit(%rip), %rax");
+                check("jb", ".Lmsg_stack", pc);
+            } else {
+                check("jmp", ".Lmsg_stack", pc);
+            }
+            if (pad) ins("subq $8, %rsp");
+            for (uint32_t i = n; i-- > 6;) {
+                Val v = src(in.b + (int32_t)i);
+                if (inReg(v)) {
+                    ins("pushq " + loc64(v));
+                } else {
+                    ins("movl " + loc(v) + ", %eax");
+                    ins("pushq %rax");
+                }
+            }
+            for (uint32_t i = 0; i < n && i < 6; i++) ins("movl " + loc(src(in.b + (int32_t)i)) + ", " + argRegs[i]);
+            ins("call lab3_" + callee.name);
+            if (stackArgs) ins("addq $" + to_string(8 * stackArgs + pad) + ", %rsp");
+            if (in.c >= 0) ins("movl %eax, " + loc(dst(in.c)));
+            break;
+        }
+        case OP_RET:
+            ins("movl " + loc(src(in.a)) + ", %eax");
+            ins("jmp " + ret);
+            break;
+        case OP_RETV:
+        case OP_HALT:
+            ins("xorl %eax, %eax");
+            ins("jmp " + ret);
+            break;
+        case OP_READI: case OP_READC:
+            ins(string("call ") + (in.op == OP_READI ? "lab3_readi" : "lab3_readc"));
+            ins("movl %eax, " + loc(dst(in.a)));
+            break;
+        case OP_PRINTS:
+            ins("leaq .Lstr" + to_string(in.a) + "(%rip), %rsi");
+            ins("leaq .Lfmt_s(%rip), %rdi");
+            ins("xorl %eax, %eax");
+            ins("call printf@PLT");
+            break;
+        case OP_PRINTI:
+            ins("movl " + loc(src(in.a)) + ", %esi");
+            ins("leaq .Lfmt_d(%rip), %rdi");
+            ins("xorl %eax, %eax");
+            ins("call printf@PLT");
+            break;
+        case OP_PRINTC:
+            ins("movl " + loc(src(in.a)) + ", %edi");
+            ins("call putchar@PLT");
+            break;
+        case OP_PRINTNL:
+            ins("movl $10, %edi");
+            ins("call putchar@PLT");
+            break;
+        default:
+            break;
+        }
+    }
+
+    void flushStdout() {
+        ins("movq stdout@GOTPCREL(%rip), %rax");
+        ins("movq (%rax), %rdi");
+        ins("call fflush@PLT");
+    }
+
+    // 运行时支持：栈空间上限、读整数/字符 (读之前先把已有的输出写出去，读不到时得 0)、运行时报错
+    void runtime() {
+        // 栈的上限按 getrlimit 取 (没有限制时按 1GB 算)，留出 256KB 给命令行参数、环境变量和 C 库函数
+        out() << "lab3_init:\n";
+        ins("subq $24, %rsp");
+        ins("movq $8388608, (%rsp)");
+        ins("movl $3, %edi"); // RLIMIT_STACK
+        ins("movq %rsp, %rsi");
+        ins("call getrlimit@PLT");
+        ins("movq (%rsp), %rax");
+        ins("movq $1073741824, %rdx");
+        ins("cmpq %rdx, %rax");
+        ins("cmovaq %rdx, %rax");
+        ins("cmpq $524288, %rax");
+        ins("jbe 1f");
+        ins("subq $262144, %rax");
+        ins("leaq 24(%rsp), %rdx");
+        ins("subq %rax, %rdx");
+        ins("movq %rdx, lab3_stack_limit(%rip)");
+        out() << "1:\n";
+        ins("addq $24, %rsp");
+        ins("ret");
+        out() << "lab3_readi:\n";
+        ins("subq $24, %rsp");
+        flushStdout();
+        ins("movl $0, 12(%rsp)");
+        ins("leaq 12(%rsp), %rsi");
+        ins("leaq .Lfmt_d(%rip), %rdi");
+        ins("xorl %eax, %eax");
+        ins("call scanf@PLT");
+        ins("movl 12(%rsp), %eax");
+        ins("addq $24, %rsp");
+        ins("ret");
+        out() << "lab3_readc:\n";
+        ins("subq $24, %rsp");
+        flushStdout();
+        ins("movl $0, 12(%rsp)");
+        ins("leaq 12(%rsp), %rsi");
+        ins("leaq .Lfmt_c(%rip), %rdi");
+        ins("xorl %eax, %eax");
+        ins("call scanf@PLT");
+        ins("movzbl 12(%rsp), %eax");
+        ins("addq $24, %rsp");
+        ins("ret");
+        // lab3_fail(行, 列, 原因)：先把已有的输出写出去，再报错退出
+        out() << "lab3_fail:\n";
+        ins("pushq %r12");
+        ins("pushq %r13");
+        ins("pushq %r14");
+        ins("movl %edi, %r12d");
+        ins("movl %esi, %r13d");
+        ins("movq %rdx, %r14");
+        ins("xorl %edi, %edi");
+        ins("call fflush@PLT");
+        ins("movq stderr@GOTPCREL(%rip), %rax");
+        ins("movq (%rax), %rdi");
+        ins("leaq .Lfmt_err(%rip), %rsi");
+        ins("movl %r12d, %edx");
+        ins("movl %r13d, %ecx");
+        ins("movq %r14, %r8");
+        ins("xorl %eax, %eax");
+        ins("call fprintf@PLT");
+        ins("movl $1, %edi");
+        ins("call exit@PLT");
+    }
+};
+
+// ==========================================
+// 9. 文件处理与主程序
+// ==========================================
+
+// 文件处理、结果缓存 (--cache-dir)、批处理和服务模式的公共部分与实验二共用，见 批处理与服务.h
+// 分析规则或输出格式改变时改这里，旧的缓存项自然失效 (--cache-dir 的结果缓存和 --cache 的函数缓存都用它)
+const char RESULT_CACHE_VERSION[] = "lab3-2";
+const char RESULT_CACHE_MAGIC[] = "LAB3RC02";
+
+#include "批处理与服务.h"
+
+// 用表驱动分析器代替手写的递归下降分析器 (--ll)，在启动工作线程之前设置。
+// 只对合法的输入保证与手写分析器的输出相同 (见第 5 节开头)
+bool useTableParser = false;
+// 词法分析放到单独的线程，与语法分析并行 (--lex-thread)
+bool useLexerThread = false;
+// 按函数并行分析的线程数 (--parallel)，0 表示不拆分；以函数为单位分析时 --lex-thread 不起作用
+unsigned parallelThreads = 0;
+// 编译成字节码后经过 SSA 中间表示优化 (-O0 关闭)
+bool useOptimizer = true;
+
+// --- 以函数定义为单位分析 ---
+
+// 整个文件的单词：主线程一次读好，工作线程只读
+thread_local vector<Token> allTokens;
+
+// 一个函数定义在单词数组中的位置 [begin, end)
+struct FunctionRange {
+    uint32_t begin, end;
+    uint32_t sym;   // 函数名的驻留编号
+    TokenKind type; // 返回类型，无返回值函数为 VOIDTK
+};
+
+// 预扫描：从 pos 开始按 "类型 标识符 (" 认出函数定义，参数表之后只做花括号配对找到它的结尾。
+// 停在 void main 上并返回它的下标；程序不是这样的结构 (括号不配对等) 时返回 SIZE_MAX
+size_t scanFunctions(const vector<Token>& toks, size_t pos, vector<FunctionRange>& funcs) {
+    while (pos + 2 < toks.size()) {
+        TokenKind type = toks[pos].kind;
+        if (type == VOIDTK && toks[pos + 1].kind == MAINTK) return pos;
+        if (!inSet(FIRST_FUNC_DEF, type) || toks[pos + 1].kind != IDENFR || toks[pos + 2].kind != LPARENT) break;
+        size_t i = pos + 3;
+        while (toks[i].kind != LBRACE && toks[i].kind != TK_EOF) i++;
+        for (int depth = 0; toks[i].kind != TK_EOF; i++) {
+            if (toks[i].kind == LBRACE) depth++;
+            else if (toks[i].kind == RBRACE && --depth == 0) break;
+        }
+        if (toks[i].kind == TK_EOF) break;
+        funcs.push_back({(uint32_t)pos, (uint32_t)(i + 1), toks[pos + 1].sym, type});
+        pos = i + 1;
+    }
+    return SIZE_MAX;
+}
+
+// 分析一个语法成分：--ll 时从分析表里同名的非终结符开始，否则调用对应的递归子程序
+void parsePart(const string& name, void (*parse)()) {
+    if (useTableParser) runTableParser(tableSymbol(name));
+    else parse();
+}
+
+// 按函数缓存分析结果 (--cache <文件>)，只用于单个文件：没有改动的函数直接取上次的输出文本
+string cachePath;
+
+// 64 位 FNV-1a，给单词序列算摘要 (只看类别码和单词值，空白和注释的改动不影响)
+struct Digest {
+    uint64_t h = 14695981039346656037ull;
+
+    void add(const char* p, size_t n) {
+        for (size_t i = 0; i < n; i++) h = (h ^ (unsigned char)p[i]) * 1099511628211ull;
+    }
+    void add(const Token& tk) {
+        char kind = (char)tk.kind;
+        string_view text = tokenText(tk);
+        add(&kind, 1);
+        add(text.data(), text.size());
+        add("", 1); // 分隔符
+    }
+};
+
+// 缓存文件：8 字节文件头，之后每项是 8 字节键、4 字节长度和这个函数的输出文本
+const char FUNCTION_CACHE_MAGIC[] = "LAB3FC01";
+
+// 读入缓存，entries 中的文本指向 data；文件不存在或格式不对时返回 false (已读出的项仍可用)
+bool loadFunctionCache(const string& path, string& data, map<uint64_t, string_view>& entries) {
+    string err;
+    if (!readWholeFile(path, data, err) || data.compare(0, 8, FUNCTION_CACHE_MAGIC) != 0) return false;
+    size_t pos = 8;
+    while (pos + 12 <= data.size()) {
+        uint64_t key;
+        uint32_t len;
+        memcpy(&key, &data[pos], 8);
+        memcpy(&len, &data[pos + 8], 4);
+        pos += 12;
+        if (len > data.size() - pos) return false;
+        entries[key] = string_view(data.data() + pos, len);
+        pos += len;
+    }
+    return pos == data.size();
+}
+
+// 写出缓存 (同一个键只写一次)。与结果缓存一样先写临时文件再 rename，
+// 中途崩溃或两个进程同时运行都不会留下截断的缓存文件
+bool saveFunctionCache(const string& path, const vector<uint64_t>& keys, const vector<string_view>& texts) {
+    string body;
+    set<uint64_t> written;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (!written.insert(keys[i]).second) continue;
+        uint32_t len = (uint32_t)texts[i].size();
+        body.append((const char*)&keys[i], 8);
+        body.append((const char*)&len, 4);
+        body += texts[i];
+    }
+    return replaceFile(path, string_view(FUNCTION_CACHE_MAGIC, 8), body);
+}
+
+// 以函数定义为单位分析 (--parallel / --cache)：主线程读好所有单词，分析常量说明和变量说明，
+// 预扫描出各个函数定义；缓存里没有的函数按单词数切成若干段，工作线程各自分析一段、每个函数输出到自己的缓冲区；
+// 主函数仍由主线程分析，最后按源程序顺序拼接到 outFile。
+// 程序结构不适合拆分时返回 false，此时单词数组已经就位、分析器状态已经清空，调用方从头按普通方式分析
+bool parseProgramByFunctions(unsigned threadCount) {
+    allTokens.clear();
+    do allTokens.push_back(getNextTokenFromFile()); while (allTokens.back().kind != TK_EOF);
+    const vector<Token>& toks = allTokens; // 工作线程里 allTokens 指的是它自己的那份，要通过引用访问
+    const Token* first = toks.data();
+    const Token* last = first + toks.size();
+    setTokenSlice(first, last, toks.back().offset);
+
+    // 1. 说明部分，全局量登记进本线程的符号表
+    initParser();
+    if (currentToken.kind == CONSTTK) parsePart("<常量说明>", parseConstDecl);
+    if (inSet(TYPE_SPECIFIERS, currentToken.kind) && peekToken(2).kind != LPARENT) parsePart("<变量说明>", parseVarDecl);
+
+    // 2. 预扫描函数定义 (currentToken 之后还有 lookaheadCount 个单词已经读出)
+    vector<FunctionRange> funcs;
+    size_t declEnd = (size_t)(sliceNext - first) - lookaheadCount - 1;
+    size_t mainPos = scanFunctions(toks, declEnd, funcs);
+    if (mainPos == SIZE_MAX) {
+        resetAst();
+        scopes.reset();
+        llError = TableParseError();
+        lookaheadHead = 0;
+        lookaheadCount = 0;
+        setTokenSlice(first, last, toks.back().offset);
+        return false;
+    }
+
+    // 3. 查缓存。函数的分析结果还取决于它之前登记过哪些名字 (函数调用语句按被调函数的返回类型分类)，
+    //    所以键里还要算进说明部分和所有函数的签名，这些有改动时全部重新分析。
+    //    输出格式的版本 RESULT_CACHE_VERSION 也算进键里，格式改变后旧的缓存项不再命中；
+    //    两种分析器只对合法的输入输出相同 (--ll 遇到不合文法的函数会报错)，所以用的是哪种也算进键里
+    vector<string_view> texts(funcs.size()); // 各个函数的输出：指向缓存文件的内容或 parsed
+    vector<string> parsed(funcs.size());
+    vector<TableParseError> errors(funcs.size()); // --ll 时各个函数里表驱动分析器停下的地方
+    vector<uint64_t> keys;
+    vector<size_t> todo; // 要重新分析的函数
+    string cacheData;
+    map<uint64_t, string_view> cached;
+    if (!cachePath.empty()) {
+        Digest context;
+        context.add(RESULT_CACHE_VERSION, strlen(RESULT_CACHE_VERSION));
+        context.add(useTableParser ? "L" : "R", 1);
+        for (size_t i = 0; i < declEnd; i++) context.add(toks[i]);
+        for (const FunctionRange& f : funcs) {
+            context.add(toks[f.begin]);
+            context.add(toks[f.begin + 1]);
+        }
+        loadFunctionCache(cachePath, cacheData, cached);
+        for (size_t f = 0; f < funcs.size(); f++) {
+            Digest d = context;
+            for (size_t i = funcs[f].begin; i < funcs[f].end; i++) d.add(toks[i]);
+            keys.push_back(d.h);
+            auto it = cached.find(d.h);
+            if (it != cached.end()) texts[f] = it->second;
+            else todo.push_back(f);
+        }
+    } else {
+        for (size_t f = 0; f < funcs.size(); f++) todo.push_back(f);
+    }
+
+    // 4. 按单词数大致均分成 线程数 × 4 段，分析得快的线程可以多领几段
+    size_t chunkCount = min<size_t>(todo.size(), (size_t)threadCount * 4);
+    size_t total = 0, done = 0;
+    for (size_t f : todo) total += funcs[f].end - funcs[f].begin;
+    vector<size_t> chunkBegin; // 每段在 todo 中的起点，最后再放一个 todo.size()
+    for (size_t t = 0; t < todo.size(); t++) {
+        if (chunkBegin.size() < chunkCount && done * chunkCount >= total * chunkBegin.size()) chunkBegin.push_back(t);
+        done += funcs[todo[t]].end - funcs[todo[t]].begin;
+    }
+    chunkBegin.push_back(todo.size());
+
+    // 5. 每个函数看到的符号表与顺序分析时相同：全局量，加上它之前的所有函数
+    const string* source = &srcBuf;
+    const ScopedSymbolTable& globals = scopes;
+    atomic<size_t> next(0);
+    auto worker = [&]() {
+        sharedSource = source;
+        size_t c;
+        while ((c = next.fetch_add(1)) + 1 < chunkBegin.size()) {
+            scopes = globals;
+            size_t declared = 0;
+            for (size_t t = chunkBegin[c]; t < chunkBegin[c + 1]; t++) {
+                const FunctionRange& f = funcs[todo[t]];
+                for (; declared < todo[t]; declared++) scopes.declare(funcs[declared].sym, {SK_FUNC, funcs[declared].type});
+                declared++; // 这个函数在分析它的声明头部时登记
+                resetAst();
+                lookaheadHead = 0;
+                lookaheadCount = 0;
+                setTokenSlice(first + f.begin, first + f.end, toks[f.end].offset);
+                initParser();
+                if (f.type == VOIDTK) parsePart("<无返回值函数定义>", parseFuncDefVoid);
+                else parsePart("<有返回值函数定义>", parseFuncDefWithRet);
+                OutBuffer out;
+                emitAst(astStack.back(), out);
+                parsed[todo[t]] = move(out.data);
+                errors[todo[t]] = llError;
+                llError = TableParseError();
+            }
+        }
+    };
+    vector<thread> pool;
+    for (unsigned t = 0; t < min<size_t>(threadCount, chunkBegin.size() - 1); t++) pool.emplace_back(worker);
+    for (auto& th : pool) th.join();
+    for (size_t f : todo) texts[f] = parsed[f];
+    // 说明部分在所有函数之前，它出的错优先；函数里的错取源程序里最靠前的
+    for (size_t f = 0; f < funcs.size() && llError.nonterminal < 0; f++) llError = errors[f];
+
+    if (!cachePath.empty()) {
+        // 分析出错的函数不存进缓存，下次仍然重新分析、报告错误
+        vector<uint64_t> goodKeys;
+        vector<string_view> goodTexts;
+        for (size_t f = 0; f < funcs.size(); f++) {
+            if (errors[f].nonterminal >= 0) continue;
+            goodKeys.push_back(keys[f]);
+            goodTexts.push_back(texts[f]);
+        }
+        // 缓存里的键正好是这次用到的键 (全部命中，且没有多余的旧项) 时不必重写
+        if (!todo.empty() || cached.size() != set<uint64_t>(goodKeys.begin(), goodKeys.end()).size()) {
+            saveFunctionCache(cachePath, goodKeys, goodTexts);
+        }
+    }
+
+    // 6. 主函数能调用所有函数
+    for (const FunctionRange& f : funcs) scopes.declare(f.sym, {SK_FUNC, f.type});
+    lookaheadHead = 0;
+    lookaheadCount = 0;
+    setTokenSlice(first + mainPos, last, toks.back().offset);
+    initParser();
+    parsePart("<主函数>", parseMainFunc);
+
+    // 7. 说明部分、各个函数、主函数，最后是 <程序>
+    for (size_t i = 0; i + 1 < astStack.size(); i++) emitAst(astStack[i], outFile);
+    for (string_view text : texts) outFile << text;
+    emitAst(astStack.back(), outFile);
+    outFile << tagNames[NT_PROGRAM] << endl;
+    return true;
+}
+
+// 分析完 <程序> 后应当正好读到输入末尾；--ll 时还要检查表驱动分析器是否中途停下
+bool checkEndOfInput(string& err) {
+    if (llError.nonterminal >= 0) {
+        SourcePos pos = resolvePos(llError.token.offset);
+        err = "line " + to_string(pos.line) + ", column " + to_string(pos.column) + ": "
+            + (llError.stalled ? "no progress in " : "no alternative of ") + parseTable().names[llError.nonterminal]
+            + " matches: " + (llError.token.kind == TK_EOF ? string("end of input") : string(tokenText(llError.token)));
+        return false;
+    }
+    if (currentToken.kind == TK_EOF) return true;
+    SourcePos pos = resolvePos(currentToken.offset);
+    err = "line " + to_string(pos.line) + ", column " + to_string(pos.column)
+        + ": unexpected token after <程序>: " + string(tokenText(currentToken));
+    return false;
+}
+
+// 写出 outFile，并检查 <程序> 之后是否还有多余的单词
+bool writeOutput(const string& outPath, string& err) {
+    return writeText(outPath, outFile.data, err) && checkEndOfInput(err);
+}
+
+// 重置上一个文件留下的分析器状态 (缓冲区只清空，不释放)，准备分析 srcBuf
+void resetParser() {
+    srcPos = 0;
+    lineStartsReady = false;
+    resetSymbols();
+    scopes.reset();
+    lookaheadHead = 0;
+    lookaheadCount = 0;
+    sliceNext = nullptr;
+    resetAst();
+    llError = TableParseError();
+}
+
+// 读入源程序，并重置分析器状态
+bool loadSource(const string& inPath, string& err) {
+    if (!readWholeFile(inPath, srcBuf, err)) return false;
+    resetParser();
+    return true;
+}
+
+// 写出结果；分析成功且给出了 --cache-dir 时把输出存进缓存
+bool finishFile(const string& outPath, const string& cacheFile, string& err) {
+    if (!writeOutput(outPath, err)) return false;
+    if (!cacheFile.empty()) storeCacheEntry(cacheFile, srcBuf.size(), outFile.data);
+    return true;
+}
+
+// 处理单个文件：读入 -> 语法分析 -> 写出。失败时返回 false 并在 err 中给出原因
+// 给出 --cache-dir 时先查缓存，命中就直接写出缓存里的输出 (--ll 的结果另存一份，它对不合文法的输入会报错)
+bool processFile(const string& inPath, const string& outPath, string& err) {
+    if (!loadSource(inPath, err)) return false;
+    string cacheFile;
+    if (!cacheDir.empty()) {
+        cacheFile = cacheEntryPath(srcBuf, useTableParser ? ".lab3ll" : ".lab3");
+        CacheEntry cached;
+        if (openCacheEntry(cacheFile, srcBuf.size(), cached)) return writeText(outPath, cached.output, err);
+    }
+    outFile.data.clear();
+    if ((parallelThreads > 0 || !cachePath.empty()) && parseProgramByFunctions(max(1u, parallelThreads))) {
+        return finishFile(outPath, cacheFile, err);
+    }
+    // 按函数分析退回来时单词已经全部读好，不再需要词法线程
+    bool pipelined = useLexerThread && !sliceNext;
+    thread lexer;
+    if (pipelined) {
+        tokenPipe.reset();
+        tokenPipe.src.swap(srcBuf);
+        swap(tokenPipe.names, symbols);
+        lexer = thread(runLexerThread, ref(tokenPipe));
+        pipeActive = true;
+    }
+    initParser();
+    if (useTableParser) parseProgramByTable();
+    else parseProgram();
+    if (pipelined) {
+        // 分析可能在读完输入之前就结束了 (<程序> 之后还有多余的单词)，让词法线程停下
+        tokenPipe.stop.store(true, memory_order_release);
+        lexer.join();
+        pipeActive = false;
+        srcBuf.swap(tokenPipe.src);
+        swap(symbols, tokenPipe.names);
+    }
+    astRoot = astStack.back();
+    emitAst(astRoot, outFile);
+    return finishFile(outPath, cacheFile, err);
+}
+
+// 读入并分析源程序，编译成字节码 (--run / --bytecode / --asm)
+bool compileFile(const string& inPath, Bytecode& bc, string& err) {
+    if (!loadSource(inPath, err)) return false;
+    initParser();
+    if (useTableParser) parseProgramByTable();
+    else parseProgram();
+    if (!checkEndOfInput(err)) return false;
+    astRoot = astStack.back();
+    if (!BytecodeCompiler().compile(astRoot, bc, err)) return false;
+    if (useOptimizer) optimizeBytecode(bc);
+    return true;
+}
+
+// --- 单进程流水线 (--pipeline) ---
+
+// 流水线的各个阶段：读入 -> 词法分析 -> 语法分析 -> 编译成字节码 -> 优化 -> 生成汇编。
+// 前一阶段的结果 (源程序、单词数组、语法树、字节码) 留在内存里交给下一阶段，
+// 不写中间文件，语法分析直接读词法分析阶段的单词数组，不再重复做词法分析
+enum Stage { ST_READ, ST_LEX, ST_PARSE, ST_COMPILE, ST_OPTIMIZE, ST_ASM, ST_COUNT };
+const char* const stageNames[ST_COUNT] = {"read", "lex", "parse", "compile", "optimize", "asm"};
+// --emit 用的名字和写出的文件名 (读入阶段没有输出)。tokens.txt 与实验二的输出格式相同，output.txt 与默认模式相同
+const char* const emitNames[ST_COUNT] = {"", "tokens", "ast", "bytecode", "optimized", "asm"};
+const char* const emitFiles[ST_COUNT] = {"", "tokens.txt", "output.txt", "bytecode.txt", "optimized.txt", "program.s"};
+
+// 当前和峰值常驻内存 (KB)
+void readMemory(long& rssKb, long& peakKb) {
+    rssKb = peakKb = 0;
+    ifstream f("/proc/self/status");
+    string line;
+    while (getline(f, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) rssKb = atol(line.c_str() + 6);
+        else if (line.compare(0, 6, "VmHWM:") == 0) peakKb = atol(line.c_str() + 6);
+    }
+}
+
+// 把峰值清零为当前值 (Linux 4.0 起写 5 到 clear_refs)，失败时峰值就是进程启动以来的最大值
+void resetPeakMemory() {
+    ofstream f("/proc/self/clear_refs");
+    if (f.is_open()) f << "5";
+}
+
+// 依次执行各阶段，直到 emits 中最后一个要输出的阶段；要输出的阶段把结果写到 outDir 下 (空表示当前目录)。
+// 每个阶段的耗时 (不含写输出)、结束时的常驻内存和阶段内的峰值写到 stderr
+bool runPipeline(const string& inPath, const bool emits[ST_COUNT], const string& outDir, string& err) {
+    int last = ST_READ;
+    for (int s = 0; s < ST_COUNT; s++) {
+        if (emits[s]) last = s;
+    }
+    Bytecode bc;
+    OutBuffer text;
+    cerr << "stage            ms     rss_kb    peak_kb" << endl;
+    for (int s = 0; s <= last; s++) {
+        resetPeakMemory();
+        auto start = chrono::steady_clock::now();
+        bool ok = true;
+        switch (s) {
+        case ST_READ:
+            ok = loadSource(inPath, err);
+            break;
+        case ST_LEX:
+            allTokens.clear();
+            do allTokens.push_back(getNextTokenFromFile()); while (allTokens.back().kind != TK_EOF);
+            break;
+        case ST_PARSE:
+            setTokenSlice(allTokens.data(), allTokens.data() + allTokens.size(), allTokens.back().offset);
+            initParser();
+            if (useTableParser) parseProgramByTable();
+            else parseProgram();
+            ok = checkEndOfInput(err);
+            astRoot = astStack.back();
+            break;
+        case ST_COMPILE:
+            ok = BytecodeCompiler().compile(astRoot, bc, err);
+            break;
+        case ST_OPTIMIZE:
+            if (useOptimizer) optimizeBytecode(bc);
+            break;
+        case ST_ASM:
+            text.data.clear();
+            AsmGenerator().generate(bc, text);
+            break;
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        long rss, peak;
+        readMemory(rss, peak);
+        char row[96];
+        snprintf(row, sizeof(row), "%-10s %10.3f %10ld %10ld", stageNames[s], ms, rss, peak);
+        cerr << row << endl;
+
+        // 分析出错时 (<程序> 之后有多余单词) 仍像默认模式一样写出语法分析的结果
+        if (emits[s] && (ok || s == ST_PARSE)) {
+            string path = outDir.empty() ? emitFiles[s] : (std::filesystem::path(outDir) / emitFiles[s]).string();
+            string writeErr;
+            bool written = true;
+            if (s == ST_COMPILE || s == ST_OPTIMIZE) {
+                ofstream out(path, ios::binary);
+                dumpBytecode(bc, out);
+                written = (bool)out;
+                if (!written) writeErr = "Write failed: " + path;
+            } else {
+                // 汇编阶段已经把结果生成在 text 里
+                if (s == ST_LEX) {
+                    text.data.clear();
+                    for (const Token& tk : allTokens) {
+                        if (tk.kind != TK_EOF) text << tokenNames[tk.kind] << " " << tokenText(tk) << endl;
+                    }
+                } else if (s == ST_PARSE) {
+                    text.data.clear();
+                    emitAst(astRoot, text);
+                }
+                written = writeText(path, text.data, writeErr);
+            }
+            if (!written && ok) {
+                err = writeErr;
+                ok = false;
+            }
+        }
+        if (s == ST_PARSE) {
+            // 语法树里已经有各个单词的副本，单词数组不再需要
+            sliceNext = nullptr;
+            vector<Token>().swap(allTokens);
+        }
+        if (!ok) return false;
+    }
+    return true;
+}
+
+#ifdef PARSER_PROFILE
+// --profile <前缀>：程序退出时 (各线程的数据都已合并) 写出 <前缀>.json 和 <前缀>.folded
+string profilePrefix;
+
+string profileKindName(uint8_t kind) {
+    return kind < NT_COUNT ? tagNames[kind] : "<未结束>";
+}
+
+// JSON：总单词数、各预读深度的命中/未命中次数、预读窗口最大占用，以及按不含子成分时间从多到少排列的各语法成分；
+// 折叠栈：每行 "<程序>;<主函数>;...;<因子> 纳秒数"，可直接交给 flamegraph.pl
+void writeParserProfile() {
+    ProfileTotals& t = profileTotals;
+    lock_guard<mutex> guard(t.lock);
+    ofstream json(profilePrefix + ".json");
+    json << "{\n  \"tokens\": " << t.totalTokens << ",\n  \"lookahead_high_water\": " << t.windowHighWater
+         << ",\n  \"peek\": [";
+    for (size_t k = 1; k <= LOOKAHEAD_SLOTS; k++) {
+        json << (k > 1 ? ", " : "") << "{\"depth\": " << k << ", \"hits\": " << t.peekHits[k] << ", \"misses\": " << t.peekMisses[k] << "}";
+    }
+    json << "],\n  \"nonterminals\": [";
+    vector<size_t> order;
+    for (size_t k = 0; k < NT_COUNT; k++) {
+        if (t.calls[k]) order.push_back(k);
+    }
+    sort(order.begin(), order.end(), [&](size_t x, size_t y) { return t.exclusiveNs[x] > t.exclusiveNs[y]; });
+    for (size_t i = 0; i < order.size(); i++) {
+        size_t k = order[i];
+        json << (i ? "," : "") << "\n    {\"name\": \"" << tagNames[k] << "\", \"calls\": " << t.calls[k]
+             << ", \"inclusive_ns\": " << t.inclusiveNs[k] << ", \"exclusive_ns\": " << t.exclusiveNs[k]
+             << ", \"tokens\": " << t.tokens[k] << ", \"own_tokens\": " << t.ownTokens[k] << "}";
+    }
+    json << "\n  ]\n}\n";
+
+    ofstream folded(profilePrefix + ".folded");
+    for (const auto& entry : t.folded) {
+        for (size_t i = 0; i < entry.first.size(); i++) folded << (i ? ";" : "") << profileKindName(entry.first[i]);
+        folded << " " << entry.second << "\n";
+    }
+    if (!json || !folded) cerr << "Error: cannot write " << profilePrefix << ".json/.folded" << endl;
+}
+#endif
+
+// 调试输出：逐个列出单词及其 行:列 (只有这里和报错时才会建立行首表)
+bool dumpTokens(const string& inPath, string& err) {
+    if (!readWholeFile(inPath, srcBuf, err)) return false;
+    srcPos = 0;
+    lineStartsReady = false;
+    resetSymbols();
+    for (Token tk = getNextTokenFromFile(); tk.kind != TK_EOF; tk = getNextTokenFromFile()) {
+        SourcePos pos = resolvePos(tk.offset);
+        cout << pos.line << ":" << pos.column << " " << tokenNames[tk.kind] << " " << tokenText(tk) << "\n";
+    }
+    return true;
+}
+
+// 服务模式下分析一个请求：输入已在 srcBuf 中，输出留在 outFile。只做默认的语法分析输出，
+// --ll 对服务同样有效；<程序> 之后有多余单词、或表驱动分析器无法继续时只回答出错原因，服务照常进行
+bool serveRequest(string& err) {
+    resetParser();
+    outFile.data.clear();
+    initParser();
+    if (useTableParser) parseProgramByTable();
+    else parseProgram();
+    astRoot = astStack.back();
+    emitAst(astRoot, outFile);
+    return checkEndOfInput(err);
+}
+
+// 被其他程序 (如 基准测试.cpp) 用 #include 嵌入时定义 NO_MAIN，去掉这里的 main
+#ifndef NO_MAIN
+int main(int argc, char* argv[]) {
+    // 用法: 实验三                       处理 testfile.txt -> output.txt
+    //       实验三 -b <目录|列表文件> [-o 输出目录] [-j 线程数]
+    //       实验三 --tokens [文件]          按 "行:列 类别码 单词值" 列出单词 (调试用)
+    //       实验三 --table                  列出由文法生成的 LL 分析表 (调试用)
+    //       实验三 --run [文件]             编译成字节码并运行，程序的输入输出就是标准输入输出
+    //       实验三 --bytecode [文件]        列出编译出的字节码 (调试用)
+    //       实验三 --asm [文件]             输出 x86-64 汇编，再用 gcc prog.s -o prog 生成可执行文件
+    //       实验三 --ir [文件]              列出每个函数优化前后的 SSA 中间表示 (调试用)
+    //       --run / --bytecode / --asm 加 -O0，不做中间表示上的优化
+    //       以上分析模式都可加 --ll，改用表驱动分析器 (只对合法的输入保证输出与默认分析器相同，无法继续分析时报错)；
+    //       加 --lex-thread，词法分析在单独的线程里进行；
+    //       加 --parallel <线程数>，各个函数定义分给几个线程同时分析 (1 到 4096)
+    //       实验三 --cache <缓存文件>           按函数缓存分析结果，下次只重新分析改动过的函数
+    //       实验三 --pipeline [文件] [--emit 阶段,...] [-o 输出目录]
+    //                                     在一个进程里依次做词法分析、语法分析、编译、优化、生成汇编，阶段之间在内存中交接，
+    //                                     --emit 可选 tokens,ast,bytecode,optimized,asm (默认 ast)，各阶段的耗时和内存写到 stderr
+    //       默认模式和 -b 都可加 --cache-dir <目录>，按输入内容缓存输出，内容没变的文件不再分析
+    //       实验三 --serve <套接字> [-j 线程数]   常驻服务，经 Unix 域套接字接收请求 (可加 --ll)
+    //       实验三 --client <套接字> [文件]       把文件交给服务进程分析，输出写到标准输出
+    //       用 -DPARSER_PROFILE 编译时还可加 --profile <前缀>，退出时写出各语法成分的剖析结果 (<前缀>.json、<前缀>.folded)
+    string batchInput, outDir, dumpInput, runInput, bytecodeInput, asmInput, irInput;
+    string serveSocket, clientSocket, clientInput = "testfile.txt";
+    string pipelineInput, emitList = "ast";
+    unsigned threadCount = 0;
+    // 可省略的文件名参数：下一个参数不是选项时取作文件名，否则先用 testfile.txt，
+    // 后面再出现的第一个非选项参数才是它的文件名 (如 --run -O0 f.txt)
+    string* pendingFile = nullptr;
+    auto optionalFile = [&](int& i, string& target) {
+        if (i + 1 < argc && argv[i + 1][0] != '-') {
+            target = argv[++i];
+        } else {
+            target = "testfile.txt";
+            pendingFile = &target;
+        }
+    };
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-b" && i + 1 < argc) batchInput = argv[++i];
+        else if (arg == "-o" && i + 1 < argc) outDir = argv[++i];
+        else if (arg == "-j" && i + 1 < argc && parseThreadCount(argv[i + 1], threadCount)) i++;
+        else if (arg == "--tokens") optionalFile(i, dumpInput);
+        else if (arg == "--run") optionalFile(i, runInput);
+        else if (arg == "--bytecode") optionalFile(i, bytecodeInput);
+        else if (arg == "--asm") optionalFile(i, asmInput);
+        else if (arg == "--ir") optionalFile(i, irInput);
+        else if (arg == "--pipeline") optionalFile(i, pipelineInput);
+        else if (arg == "--emit" && i + 1 < argc) emitList = argv[++i];
+        else if (arg == "-O0") useOptimizer = false;
+#ifdef PARSER_PROFILE
+        else if (arg == "--profile" && i + 1 < argc) profilePrefix = argv[++i];
+#endif
+        else if (arg == "--ll") useTableParser = true;
+        else if (arg == "--lex-thread") useLexerThread = true;
+        else if (arg == "--cache" && i + 1 < argc) cachePath = argv[++i];
+        else if (arg == "--cache-dir" && i + 1 < argc) cacheDir = argv[++i];
+        else if (arg == "--serve" && i + 1 < argc) serveSocket = argv[++i];
+        else if (arg == "--client" && i + 1 < argc) {
+            clientSocket = argv[++i];
+            optionalFile(i, clientInput);
+        }
+        else if (arg == "--parallel" && i + 1 < argc && parseThreadCount(argv[i + 1], parallelThreads)) i++;
+        else if (arg == "--table") {
+            dumpParseTable(cout);
+            return 0;
+        }
+        else if (arg[0] != '-' && pendingFile) {
+            *pendingFile = arg;
+            pendingFile = nullptr;
+        }
+        else {
+            cerr << "Usage: " << argv[0] << " [--ll] [--lex-thread] [--parallel threads] [--cache file] [--cache-dir dir] [-b <dir|list>] [-o outdir] [-j threads] | --tokens [file] | --table | --run [file] | --bytecode [file] | --asm [file] | --ir [file] [-O0] | --pipeline [file] [--emit tokens,ast,bytecode,optimized,asm] [-o outdir] | --serve <socket> [-j threads] | --client <socket> [file]" << endl;
+            return 1;
+        }
+    }
+#ifdef PARSER_PROFILE
+    // 退出时主线程的剖析数据先于 atexit 登记的函数合并
+    if (!profilePrefix.empty()) atexit(writeParserProfile);
+#endif
+    if (!cacheDir.empty()) {
+        error_code ec;
+        std::filesystem::create_directories(cacheDir, ec);
+        if (ec) {
+            cerr << "Error: Cannot create " << cacheDir << endl;
+            return 1;
+        }
+    }
+    if (!serveSocket.empty()) {
+        return runServer(serveSocket, threadCount);
+    }
+    if (!clientSocket.empty()) {
+        return runClient(clientSocket, clientInput);
+    }
+    if (!batchInput.empty()) {
+        if (!cachePath.empty()) {
+            cerr << "Error: --cache only works on a single file" << endl;
+            return 1;
+        }
+        return runBatch(batchInput, outDir, threadCount, ".out");
+    }
+
+    string err;
+    if (!dumpInput.empty()) {
+        if (!dumpTokens(dumpInput, err)) {
+            cerr << "Error: " << err << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (!irInput.empty()) {
+        Bytecode bc;
+        useOptimizer = false;
+        if (!compileFile(irInput, bc, err)) {
+            cerr << "Error: " << err << endl;
+            return 1;
+        }
+        dumpIrPasses(bc, cout);
+        return 0;
+    }
+    if (!pipelineInput.empty()) {
+        bool emits[ST_COUNT] = {};
+        for (size_t pos = 0; pos <= emitList.size();) {
+            size_t comma = min(emitList.find(',', pos), emitList.size());
+            string name = emitList.substr(pos, comma - pos);
+            int s = 1;
+            while (s < ST_COUNT && name != emitNames[s]) s++;
+            if (s == ST_COUNT) {
+                cerr << "Error: Unknown stage for --emit: " << name << endl;
+                return 1;
+            }
+            emits[s] = true;
+            pos = comma + 1;
+        }
+        if (!runPipeline(pipelineInput, emits, outDir, err)) {
+            cerr << "Error: " << err << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (!asmInput.empty()) {
+        Bytecode bc;
+        if (!compileFile(asmInput, bc, err)) {
+            cerr << "Error: " << err << endl;
+            return 1;
+        }
+        OutBuffer asmText;
+        AsmGenerator().generate(bc, asmText);
+        cout << asmText.data;
+        return 0;
+    }
+    if (!runInput.empty() || !bytecodeInput.empty()) {
+        Bytecode bc;
+        bool ok = compileFile(runInput.empty() ? bytecodeInput : runInput, bc, err);
+        if (ok && runInput.empty()) dumpBytecode(bc, cout);
+        else if (ok) ok = runBytecode(bc, err);
+        if (!ok) {
+            cerr << "Error: " << err << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!processFile("testfile.txt", "output.txt", err)) {
+        cerr << "Error: " << err << endl;
+        return 1;
+    }
+    return 0;
+}
+#endif
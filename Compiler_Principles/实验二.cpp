@@ -3,59 +3,115 @@
 #include <string>
 #include <vector>
 #include <cctype>
+#include <cstdint>
+#include <cstring>
 #include <map>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <filesystem>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
+// 单词类别码 (顺序与 tokenNames 对应)
+enum TokenKind : uint8_t {
+    IDENFR, INTCON, CHARCON, STRCON,
+    CONSTTK, INTTK, CHARTK, VOIDTK, MAINTK, IFTK, ELSETK, DOTK, WHILETK,
+    FORTK, SCANFTK, PRINTFTK, RETURNTK,
+    PLUS, MINU, MULT, DIV, LSS, LEQ, GRE, GEQ, EQL, NEQ, ASSIGN,
+    SEMICN, COMMA, LPARENT, RPARENT, LBRACK, RBRACK, LBRACE, RBRACE,
+    TK_NONE
+};
+
+const char* const tokenNames[] = {
+    "IDENFR", "INTCON", "CHARCON", "STRCON",
+    "CONSTTK", "INTTK", "CHARTK", "VOIDTK", "MAINTK", "IFTK", "ELSETK", "DOTK", "WHILETK",
+    "FORTK", "SCANFTK", "PRINTFTK", "RETURNTK",
+    "PLUS", "MINU", "MULT", "DIV", "LSS", "LEQ", "GRE", "GEQ", "EQL", "NEQ", "ASSIGN",
+    "SEMICN", "COMMA", "LPARENT", "RPARENT", "LBRACK", "RBRACK", "LBRACE", "RBRACE",
+    ""
+};
+
 // 关键字映射表
-map<string, string> keywords = {
-    {"const", "CONSTTK"}, {"int", "INTTK"}, {"char", "CHARTK"},
-    {"void", "VOIDTK"}, {"main", "MAINTK"}, {"if", "IFTK"},
-    {"else", "ELSETK"}, {"do", "DOTK"}, {"while", "WHILETK"},
-    {"for", "FORTK"}, {"scanf", "SCANFTK"}, {"printf", "PRINTFTK"},
-    {"return", "RETURNTK"}
+map<string, TokenKind> keywords = {
+    {"const", CONSTTK}, {"int", INTTK}, {"char", CHARTK},
+    {"void", VOIDTK}, {"main", MAINTK}, {"if", IFTK},
+    {"else", ELSETK}, {"do", DOTK}, {"while", WHILETK},
+    {"for", FORTK}, {"scanf", SCANFTK}, {"printf", PRINTFTK},
+    {"return", RETURNTK}
 };
 
 // 判断是否为单字符符号的辅助函数 (用于快速查表)
-string getSingleCharToken(char c) {
+TokenKind getSingleCharToken(char c) {
     switch (c) {
-        case '+': return "PLUS";
-        case '-': return "MINU";
-        case '*': return "MULT";
-        case '/': return "DIV";
-        case ';': return "SEMICN";
-        case ',': return "COMMA";
-        case '(': return "LPARENT";
-        case ')': return "RPARENT";
-        case '[': return "LBRACK";
-        case ']': return "RBRACK";
-        case '{': return "LBRACE";
-        case '}': return "RBRACE";
-        default: return "";
+        case '+': return PLUS;
+        case '-': return MINU;
+        case '*': return MULT;
+        case '/': return DIV;
+        case ';': return SEMICN;
+        case ',': return COMMA;
+        case '(': return LPARENT;
+        case ')': return RPARENT;
+        case '[': return LBRACK;
+        case ']': return RBRACK;
+        case '{': return LBRACE;
+        case '}': return RBRACE;
+        default: return TK_NONE;
     }
 }
 
-// 全局变量用于处理文件流
-ifstream inFile;
-ofstream outFile;
+// ==========================================
+// 标识符驻留表、输出缓冲 (与实验三共用，见 驻留表与输出缓冲.h)
+// ==========================================
 
-// 获取下一个非空白字符
-char getNextChar() {
-    char c;
-    if (inFile.get(c)) {
-        return c;
-    }
-    return EOF;
+#include "驻留表与输出缓冲.h"
+
+// 驻留 text 中 [begin, end) 这一段名字。连续存放的文本直接取指针；
+// 其他文本 (如间隙缓冲区) 先复制到线程内反复使用的临时串里
+thread_local string nameScratch;
+
+uint32_t internName(const string& text, size_t begin, size_t end) {
+    return symbols.intern(text.data() + begin, end - begin);
 }
 
-// 回退一个字符 (当多读了一个字符用于判断时)
-void ungetChar(char c) {
-    inFile.unget();
+template <class Text>
+uint32_t internName(const Text& text, size_t begin, size_t end) {
+    nameScratch.clear();
+    for (size_t i = begin; i < end; i++) nameScratch += text[i];
+    return symbols.intern(nameScratch.data(), nameScratch.size());
 }
 
-void analyze() {
-    char ch;
-    while ((ch = getNextChar()) != EOF) {
+// 单词在源文本中的位置：[offset, offset + length) 覆盖整个单词，字符串/字符常量包括两侧引号。
+// 标识符另外带上驻留编号 sym
+struct LexToken {
+    uint32_t offset;
+    uint32_t length;
+    TokenKind kind;
+    uint32_t sym;
+};
+
+// 从 pos 开始识别下一个单词，跳过空白和无法识别的字符。
+// 找到时填写 tk 并返回 true，读到文本末尾仍没有单词时返回 false。
+// Text 只需提供 size() 和 operator[]，这样整文件分析和增量分析共用同一套规则
+template <class Text>
+bool scanToken(const Text& text, size_t pos, LexToken& tk) {
+    size_t n = text.size();
+    while (pos < n) {
+        unsigned char ch = text[pos];
+        size_t start = pos++;
+
         // 1. 跳过空白字符
         if (isspace(ch)) {
             continue;
@@ -63,120 +119,621 @@ void analyze() {
 
         // 2. 识别 标识符 (IDENFR) 或 关键字 (Keyword)
         if (isalpha(ch) || ch == '_') {
-            string token = "";
-            token += ch;
             // 继续读取直到不是字母、数字或下划线
-            while ((ch = getNextChar()) != EOF && (isalnum(ch) || ch == '_')) {
-                token += ch;
-            }
-            if (ch != EOF) ungetChar(ch); // 回退多读的字符
-
-            // 查表判断是关键字还是标识符
-            if (keywords.count(token)) {
-                outFile << keywords[token] << " " << token << endl;
-            } else {
-                outFile << "IDENFR" << " " << token << endl;
+            while (pos < n && (isalnum((unsigned char)text[pos]) || text[pos] == '_')) {
+                pos++;
             }
+            // 驻留名字，编号落在关键字范围内的就是关键字
+            if (!symbolsSeeded) resetSymbols();
+            tk.sym = internName(text, start, pos);
+            tk.kind = tk.sym < keywordKinds.size() ? keywordKinds[tk.sym] : IDENFR;
         }
         // 3. 识别 整型常量 (INTCON)
         else if (isdigit(ch)) {
-            string num = "";
-            num += ch;
-            while ((ch = getNextChar()) != EOF && isdigit(ch)) {
-                num += ch;
+            while (pos < n && isdigit((unsigned char)text[pos])) {
+                pos++;
             }
-            if (ch != EOF) ungetChar(ch);
-            outFile << "INTCON" << " " << num << endl;
-        }
-        // 4. 识别 字符串常量 (STRCON)
-        else if (ch == '"') {
-            string str = "";
-            while ((ch = getNextChar()) != EOF && ch != '"') {
-                str += ch;
+            tk.kind = INTCON;
+        }
+        // 4. 识别 字符串常量 (STRCON) 和 字符常量 (CHARCON)，读到配对的引号或文件末尾
+        else if (ch == '"' || ch == '\'') {
+            while (pos < n && text[pos] != (char)ch) {
+                pos++;
             }
-            // 题目要求输出单词值，根据样例，STRCON Hello World 不带引号
-            outFile << "STRCON" << " " << str << endl;
-        }
-        // 5. 识别 字符常量 (CHARCON)
-        else if (ch == '\'') {
-            string charVal = "";
-            while ((ch = getNextChar()) != EOF && ch != '\'') {
-                charVal += ch;
+            if (pos < n) pos++; // 右引号
+            tk.kind = ch == '"' ? STRCON : CHARCON;
+        }
+        // 5. 识别 操作符 (双字符 或 单字符)
+        else if (ch == '<' || ch == '>' || ch == '=' || ch == '!') {
+            bool withEq = pos < n && text[pos] == '=';
+            if (withEq) pos++;
+            if (ch == '<') tk.kind = withEq ? LEQ : LSS;
+            else if (ch == '>') tk.kind = withEq ? GEQ : GRE;
+            else if (ch == '=') tk.kind = withEq ? EQL : ASSIGN;
+            else if (withEq) tk.kind = NEQ;
+            else continue; // 根据文法表，! 单独出现没有定义，这里忽略
+        } else {
+            // 处理单字符符号 (+, -, *, /, ;, ,, (, ), [, ], {, })
+            tk.kind = getSingleCharToken((char)ch);
+            if (tk.kind == TK_NONE) continue; // 未知符号
+        }
+        if (tk.kind != IDENFR) tk.sym = 0;
+        tk.offset = (uint32_t)start;
+        tk.length = (uint32_t)(pos - start);
+        return true;
+    }
+    return false;
+}
+
+// 单词值在文本中的范围 [begin, end)：题目样例中字符串和字符常量输出时不带引号 (STRCON Hello World, CHARCON _)
+template <class Text>
+void valueBounds(const Text& text, const LexToken& tk, size_t& begin, size_t& end) {
+    begin = tk.offset;
+    end = tk.offset + tk.length;
+    if (tk.kind == STRCON || tk.kind == CHARCON) {
+        begin++;
+        // 未闭合的常量一直读到文件末尾，没有右引号
+        if (end - begin > 0 && text[end - 1] == text[tk.offset]) end--;
+    }
+}
+
+template <class Text>
+string tokenValue(const Text& text, const LexToken& tk) {
+    size_t begin, end;
+    valueBounds(text, tk, begin, end);
+    string value;
+    for (size_t i = begin; i < end; i++) value += text[i];
+    return value;
+}
+
+// 全局变量用于处理输入输出
+// 整个输入文件一次读进 srcBuf；批处理模式下每个线程各有一份，处理下一个文件时复用其容量
+thread_local string srcBuf;
+thread_local OutBuffer outFile;
+
+void analyze() {
+    LexToken tk;
+    size_t pos = 0;
+    while (scanToken(srcBuf, pos, tk)) {
+        // 标识符的名字直接取自驻留表，不再临时构造 string
+        if (tk.kind == IDENFR) outFile << tokenNames[tk.kind] << " " << symbols.name(tk.sym) << endl;
+        else outFile << tokenNames[tk.kind] << " " << tokenValue(srcBuf, tk) << endl;
+        pos = tk.offset + tk.length;
+    }
+}
+
+// ==========================================
+// 二进制单词流 (--binary)
+// ==========================================
+
+// 给下游工具用的紧凑格式，整个文件 mmap 进来就能直接按下标访问，不必逐行解析文本：
+//   文件头 | 单词记录 tokenCount 个 | 字符串表的起始位置 stringCount + 1 个 (uint32) | 字符串表的字符
+// 每个单词记录 8 字节：低 8 位类别码、高 24 位单词值在字符串表中的编号，以及单词在源文件中的位置。
+// 字符串表就是驻留表：相同的单词值 (同名的标识符、相同的常量、关键字、运算符) 只存一份
+const char TOKEN_FILE_MAGIC[] = "LAB2TOKS";
+const uint32_t TOKEN_FILE_VERSION = 1;
+const uint32_t MAX_TOKEN_STRINGS = 1u << 24;
+
+struct TokenFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t tokenCount;
+    uint32_t stringCount;
+    uint32_t stringBytes;
+    uint64_t srcSize;
+};
+
+struct TokenRecord {
+    uint32_t kindAndId; // 类别码 | 字符串编号 << 8
+    uint32_t offset;
+
+    TokenKind kind() const { return (TokenKind)(kindAndId & 0xFF); }
+    uint32_t id() const { return kindAndId >> 8; }
+};
+
+// 输出二进制单词流而不是文本 (--binary)：单文件模式写 output.tok，批处理模式写 <输入>.tok
+bool binaryOutput = false;
+
+thread_local vector<TokenRecord> tokenRecords;
+
+// 分析 srcBuf，把二进制单词流生成到 outFile。不同的单词值超过 2^24 个时返回 false
+bool analyzeBinary(string& err) {
+    LexToken tk;
+    size_t pos = 0;
+    tokenRecords.clear();
+    while (scanToken(srcBuf, pos, tk)) {
+        uint32_t id = tk.sym;
+        if (tk.kind != IDENFR) {
+            size_t begin, end;
+            valueBounds(srcBuf, tk, begin, end);
+            id = internName(srcBuf, begin, end);
+        }
+        if (id >= MAX_TOKEN_STRINGS) {
+            err = "Too many distinct token values for the binary format";
+            return false;
+        }
+        tokenRecords.push_back({(uint32_t)tk.kind | id << 8, tk.offset});
+        pos = tk.offset + tk.length;
+    }
+
+    TokenFileHeader h;
+    memcpy(h.magic, TOKEN_FILE_MAGIC, 8);
+    h.version = TOKEN_FILE_VERSION;
+    h.tokenCount = (uint32_t)tokenRecords.size();
+    h.stringCount = (uint32_t)symbols.size();
+    h.stringBytes = 0;
+    h.srcSize = srcBuf.size();
+    vector<uint32_t> starts(symbols.size() + 1);
+    for (uint32_t id = 0; id < symbols.size(); id++) {
+        starts[id] = h.stringBytes;
+        h.stringBytes += (uint32_t)symbols.name(id).size();
+    }
+    starts.back() = h.stringBytes;
+
+    string& out = outFile.data;
+    out.reserve(sizeof(h) + tokenRecords.size() * sizeof(TokenRecord) + starts.size() * 4 + h.stringBytes);
+    out.append((const char*)&h, sizeof(h));
+    out.append((const char*)tokenRecords.data(), tokenRecords.size() * sizeof(TokenRecord));
+    out.append((const char*)starts.data(), starts.size() * 4);
+    for (uint32_t id = 0; id < symbols.size(); id++) out += symbols.name(id);
+    return true;
+}
+
+// 映射到内存的二进制单词流，析构时解除映射
+struct TokenFile {
+    const char* base = nullptr;
+    size_t size = 0;
+    const TokenFileHeader* header = nullptr;
+    const TokenRecord* records = nullptr;
+    const uint32_t* stringStarts = nullptr;
+    const char* chars = nullptr;
+
+    TokenFile() = default;
+    TokenFile(const TokenFile&) = delete;
+    TokenFile& operator=(const TokenFile&) = delete;
+    ~TokenFile() {
+        if (base) munmap((void*)base, size);
+    }
+
+    size_t tokenCount() const { return header->tokenCount; }
+    string_view value(uint32_t id) const {
+        return string_view(chars + stringStarts[id], stringStarts[id + 1] - stringStarts[id]);
+    }
+};
+
+// 映射并核对一个二进制单词流文件 (各部分的长度、字符串编号都在范围内)
+bool openTokenFile(const string& path, TokenFile& file, string& err) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        err = "Cannot open " + path;
+        return false;
+    }
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TokenFileHeader)) {
+        p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    err = "Not a token file: " + path;
+    if (p == MAP_FAILED) return false;
+    file.base = (const char*)p;
+    file.size = (size_t)st.st_size;
+    file.header = (const TokenFileHeader*)file.base;
+    const TokenFileHeader& h = *file.header;
+    if (memcmp(h.magic, TOKEN_FILE_MAGIC, 8) != 0 || h.version != TOKEN_FILE_VERSION) return false;
+    uint64_t need = sizeof(h) + (uint64_t)h.tokenCount * sizeof(TokenRecord) + ((uint64_t)h.stringCount + 1) * 4 + h.stringBytes;
+    if (need != file.size) return false;
+    file.records = (const TokenRecord*)(file.base + sizeof(h));
+    file.stringStarts = (const uint32_t*)(file.records + h.tokenCount);
+    file.chars = (const char*)(file.stringStarts + h.stringCount + 1);
+    for (uint32_t id = 0; id < h.stringCount; id++) {
+        if (file.stringStarts[id] > file.stringStarts[id + 1]) return false;
+    }
+    if (file.stringStarts[h.stringCount] != h.stringBytes) return false;
+    for (size_t i = 0; i < h.tokenCount; i++) {
+        if (file.records[i].id() >= h.stringCount || file.records[i].kind() >= TK_NONE) return false;
+    }
+    err.clear();
+    return true;
+}
+
+// --to-text：把二进制单词流转换回 "类别码 单词值" 文本，与文本模式的输出完全相同
+bool tokenFileToText(const string& path, OutBuffer& out, string& err) {
+    TokenFile file;
+    if (!openTokenFile(path, file, err)) return false;
+    for (size_t i = 0; i < file.tokenCount(); i++) {
+        const TokenRecord& r = file.records[i];
+        out << tokenNames[r.kind()] << " " << file.value(r.id()) << endl;
+    }
+    return true;
+}
+
+// ==========================================
+// 增量词法分析 (供编辑器插件使用)
+// ==========================================
+
+// 分块文本：文本切成若干块，每块约 TEXT_CHUNK 个字符，另有一张各块起点的表。
+// 编辑只改动所在的块 (过大时再拆开)，再重算一遍块起点表，
+// 代价与块大小和块数有关，与编辑位置和上一次编辑的距离无关
+const size_t TEXT_CHUNK = 4096;
+
+class ChunkedText {
+public:
+    void assign(const string& content) {
+        chunks.clear();
+        for (size_t i = 0; i < content.size(); i += TEXT_CHUNK) chunks.push_back(content.substr(i, TEXT_CHUNK));
+        if (chunks.empty()) chunks.emplace_back();
+        updateStarts();
+    }
+
+    size_t size() const { return total; }
+
+    // 逐字符访问 (scanToken 等按位置读文本的代码用)。记住上次访问的块，顺序读取时不必每次查表
+    char operator[](size_t i) const {
+        if (i < cacheBegin || i >= cacheEnd) {
+            cacheChunk = upper_bound(starts.begin(), starts.end(), i) - starts.begin() - 1;
+            cacheBegin = starts[cacheChunk];
+            cacheEnd = cacheBegin + chunks[cacheChunk].size();
+        }
+        return chunks[cacheChunk][i - cacheBegin];
+    }
+
+    // 把 [offset, offset + deleteLen) 替换为 insertText (调用方保证范围有效)
+    void replace(size_t offset, size_t deleteLen, const string& insertText) {
+        size_t first, firstOff, last, lastOff;
+        locate(offset, first, firstOff);
+        locate(offset + deleteLen, last, lastOff);
+        string merged = chunks[first].substr(0, firstOff);
+        merged += insertText;
+        merged.append(chunks[last], lastOff, string::npos);
+        chunks.erase(chunks.begin() + first + 1, chunks.begin() + last + 1);
+        // 过小的块并入下一块，过大的块拆成几块；删空了的块去掉 (至少保留一块)
+        if (merged.size() < TEXT_CHUNK / 4 && first + 1 < chunks.size()) {
+            merged += chunks[first + 1];
+            chunks.erase(chunks.begin() + first + 1);
+        }
+        if (merged.size() > 2 * TEXT_CHUNK) {
+            vector<string> pieces;
+            for (size_t i = 0; i < merged.size(); i += TEXT_CHUNK) pieces.push_back(merged.substr(i, TEXT_CHUNK));
+            chunks[first] = move(pieces[0]);
+            chunks.insert(chunks.begin() + first + 1, make_move_iterator(pieces.begin() + 1), make_move_iterator(pieces.end()));
+        } else if (merged.empty() && chunks.size() > 1) {
+            chunks.erase(chunks.begin() + first);
+        } else {
+            chunks[first] = move(merged);
+        }
+        updateStarts();
+    }
+
+    string str() const {
+        string s;
+        s.reserve(total);
+        for (const string& c : chunks) s += c;
+        return s;
+    }
+
+private:
+    vector<string> chunks;
+    vector<size_t> starts; // 各块在文本中的起点
+    size_t total = 0;
+    mutable size_t cacheChunk = 0, cacheBegin = 0, cacheEnd = 0;
+
+    // 位置 pos 所在的块和块内下标；pos 等于文本长度时落在最后一块的末尾
+    void locate(size_t pos, size_t& chunk, size_t& off) const {
+        chunk = upper_bound(starts.begin(), starts.end(), pos) - starts.begin() - 1;
+        while (chunk + 1 < chunks.size() && pos - starts[chunk] >= chunks[chunk].size()) chunk++;
+        off = pos - starts[chunk];
+    }
+
+    void updateStarts() {
+        starts.resize(chunks.size());
+        total = 0;
+        for (size_t i = 0; i < chunks.size(); i++) {
+            starts[i] = total;
+            total += chunks[i].size();
+        }
+        cacheBegin = cacheEnd = 0;
+    }
+};
+
+// 一次编辑引起的单词变化：新数组中 [first, first + inserted) 是重新分析得到的单词，
+// 它们替换了旧数组中 [first, first + removed) 的单词，其余单词 (位置已平移) 保持不变
+struct TokenChange {
+    size_t first;
+    size_t removed;
+    size_t inserted;
+};
+
+// 增量词法分析器：保留上一次的单词数组，编辑后只从编辑点之前最近的安全位置重新分析，
+// 直到新单词与旧单词重新对齐为止。
+// 单词之间词法分析器没有任何状态，所以只要新单词与某个编辑区之后的旧单词起点相同，
+// 后面的单词必然全部一样，可以直接沿用。
+// 单词按 TOKEN_BLOCK 个左右分块存放，块内记录相对于块起点 base 的位置，
+// 编辑点之后的单词平移时只需改后面各块的 base。
+// 一次编辑的代价 = 重新分析的单词 + 一两个块的复制 + 按块数重算的两张起点表，与编辑位置无关
+const size_t TOKEN_BLOCK = 1024;
+
+class IncrementalLexer {
+public:
+    // 全量分析一遍，建立初始单词数组
+    void reset(const string& content) {
+        text.assign(content);
+        blocks.assign(1, TokenBlock());
+        LexToken tk;
+        size_t pos = 0;
+        while (scanToken(content, pos, tk)) {
+            if (blocks.back().items.size() == TOKEN_BLOCK) {
+                blocks.emplace_back();
+                blocks.back().base = tk.offset;
             }
-            // 题目样例 CHARCON _ 不带引号
-            outFile << "CHARCON" << " " << charVal << endl;
+            tk.offset -= (uint32_t)blocks.back().base;
+            blocks.back().items.push_back(tk);
+            pos = tk.offset + blocks.back().base + tk.length;
         }
-        // 6. 识别 操作符 (双字符 或 单字符)
-        else {
-            if (ch == '<') {
-                char nextCh = getNextChar();
-                if (nextCh == '=') {
-                    outFile << "LEQ" << " <=" << endl;
-                } else {
-                    ungetChar(nextCh);
-                    outFile << "LSS" << " <" << endl;
-                }
-            } else if (ch == '>') {
-                char nextCh = getNextChar();
-                if (nextCh == '=') {
-                    outFile << "GEQ" << " >=" << endl;
-                } else {
-                    ungetChar(nextCh);
-                    outFile << "GRE" << " >" << endl;
-                }
-            } else if (ch == '=') {
-                char nextCh = getNextChar();
-                if (nextCh == '=') {
-                    outFile << "EQL" << " ==" << endl;
-                } else {
-                    ungetChar(nextCh);
-                    outFile << "ASSIGN" << " =" << endl;
-                }
-            } else if (ch == '!') {
-                char nextCh = getNextChar();
-                if (nextCh == '=') {
-                    outFile << "NEQ" << " !=" << endl;
-                } else {
-                    // 根据文法表，! 单独出现没有定义，这里暂且按语法错误或忽略处理
-                    // 但为了程序健壮性，回退并忽略或报错
-                    ungetChar(nextCh);
-                }
-            } else {
-                // 处理单字符符号 (+, -, *, /, ;, ,, (, ), [, ], {, })
-                string code = getSingleCharToken(ch);
-                if (code != "") {
-                    outFile << code << " " << ch << endl;
-                } else {
-                    // 未知符号
-                    // cout << "Unknown character: " << ch << endl;
+        updateBlockFirst();
+    }
+
+    // 把 [offset, offset + deleteLen) 替换为 insertText，返回单词数组的变化范围。
+    // 超出文本的范围截到文本末尾 (编辑器传来的位置有误时不会越界访问)
+    TokenChange applyEdit(size_t offset, size_t deleteLen, const string& insertText) {
+        offset = min(offset, text.size());
+        deleteLen = min(deleteLen, text.size() - offset);
+
+        // 1. 找出第一个可能受影响的单词：单词识别时最多会看到其末尾之后的一个字符，
+        //    所以末尾位置 >= offset 的单词都要重新分析
+        size_t lo = 0, hi = count;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            LexToken tk = token(mid);
+            if (tk.offset + tk.length < offset) lo = mid + 1;
+            else hi = mid;
+        }
+        size_t first = lo;
+        size_t restart = 0;
+        if (first > 0) {
+            LexToken prev = token(first - 1);
+            restart = prev.offset + prev.length;
+        }
+
+        // 2. 修改文本。旧单词数组暂时不动，编辑区之后的旧单词在新文本中的位置是原位置 + delta
+        text.replace(offset, deleteLen, insertText);
+        int64_t delta = (int64_t)insertText.size() - (int64_t)deleteLen;
+
+        // 3. 从 restart 开始重新分析，直到新单词起点与编辑区之后某个旧单词的起点重合
+        size_t editEnd = offset + insertText.size();
+        size_t old = first;
+        bool synced = false;
+        fresh.clear();
+        LexToken tk;
+        size_t pos = restart;
+        while (scanToken(text, pos, tk)) {
+            if (tk.offset >= editEnd) {
+                while (old < count && (int64_t)token(old).offset + delta < (int64_t)tk.offset) old++;
+                if (old < count && (int64_t)token(old).offset + delta == (int64_t)tk.offset) {
+                    synced = true;
+                    break;
                 }
             }
+            fresh.push_back(tk);
+            pos = tk.offset + tk.length;
         }
+        // 扫描到文本末尾都没有对齐时，first 之后的旧单词全部作废
+        if (!synced) old = count;
+
+        // 4. 用新单词替换 [first, old)，之后的单词平移 delta
+        TokenChange change = {first, old - first, fresh.size()};
+        replaceTokens(first, old, delta);
+        return change;
     }
-}
 
-int main() {
-    // 打开输入文件
-    inFile.open("testfile.txt");
-    if (!inFile.is_open()) {
-        cerr << "Error: Cannot open testfile.txt" << endl;
-        return 1;
+    size_t tokenCount() const { return count; }
+    size_t textSize() const { return text.size(); }
+    string content() const { return text.str(); }
+
+    // 第 i 个单词 (offset 为当前文本中的绝对位置)
+    LexToken token(size_t i) const {
+        size_t b = upper_bound(blockFirst.begin(), blockFirst.end(), i) - blockFirst.begin() - 1;
+        LexToken tk = blocks[b].items[i - blockFirst[b]];
+        tk.offset += (uint32_t)blocks[b].base;
+        return tk;
     }
 
-    // 打开输出文件
-    outFile.open("output.txt");
-    if (!outFile.is_open()) {
-        cerr << "Error: Cannot open output.txt" << endl;
-        inFile.close();
-        return 1;
+    string tokenText(size_t i) const { return tokenValue(text, token(i)); }
+
+private:
+    struct TokenBlock {
+        size_t base = 0;         // 块内单词位置的起算点
+        vector<LexToken> items; // offset 为相对 base 的位置
+    };
+
+    ChunkedText text;
+    vector<TokenBlock> blocks;   // 至少一块 (可以是空块)
+    vector<size_t> blockFirst;   // 各块第一个单词的全局下标
+    size_t count = 0;
+    vector<LexToken> fresh;      // 重新分析得到的单词 (绝对位置)，反复使用
+    vector<LexToken> merged;     // 替换单词时拼接的临时数组，反复使用
+
+    // 全局下标 i 所在的块和块内下标；i 等于单词数时落在最后一块的末尾
+    void locate(size_t i, size_t& block, size_t& index) const {
+        block = upper_bound(blockFirst.begin(), blockFirst.end(), i) - blockFirst.begin() - 1;
+        while (block + 1 < blocks.size() && i - blockFirst[block] >= blocks[block].items.size()) block++;
+        index = i - blockFirst[block];
     }
 
-    // 执行词法分析
+    // 旧单词 [first, old) 换成 fresh：first 所在块的前半段 + fresh + old 所在块的后半段 (平移 delta)
+    // 拼成一块 (过大时再拆开)，中间的块整块删去，之后各块的 base 平移 delta
+    void replaceTokens(size_t first, size_t old, int64_t delta) {
+        size_t b1, i1, b2, i2;
+        locate(first, b1, i1);
+        locate(old, b2, i2);
+        merged.clear();
+        for (size_t i = 0; i < i1; i++) merged.push_back(absolute(b1, i, 0));
+        merged.insert(merged.end(), fresh.begin(), fresh.end());
+        for (size_t i = i2; i < blocks[b2].items.size(); i++) merged.push_back(absolute(b2, i, delta));
+        for (size_t b = b2 + 1; b < blocks.size(); b++) blocks[b].base = (size_t)((int64_t)blocks[b].base + delta);
+        size_t base = blocks[b1].base;
+        blocks.erase(blocks.begin() + b1 + 1, blocks.begin() + b2 + 1);
+        // 过小的块并入下一块，反复的小编辑不会把单词数组切得越来越碎
+        if (merged.size() < TOKEN_BLOCK / 4 && b1 + 1 < blocks.size()) {
+            for (size_t i = 0; i < blocks[b1 + 1].items.size(); i++) merged.push_back(absolute(b1 + 1, i, 0));
+            blocks.erase(blocks.begin() + b1 + 1);
+        }
+
+        vector<TokenBlock> pieces;
+        for (size_t i = 0; i < merged.size(); i += TOKEN_BLOCK) {
+            TokenBlock blk;
+            blk.base = merged[i].offset;
+            size_t end = min(merged.size(), i + TOKEN_BLOCK);
+            for (size_t j = i; j < end; j++) {
+                blk.items.push_back(merged[j]);
+                blk.items.back().offset -= (uint32_t)blk.base;
+            }
+            pieces.push_back(move(blk));
+        }
+        if (pieces.empty()) {
+            if (blocks.size() > 1) blocks.erase(blocks.begin() + b1);
+            else blocks[b1] = TokenBlock{base, {}};
+        } else {
+            blocks[b1] = move(pieces[0]);
+            blocks.insert(blocks.begin() + b1 + 1, make_move_iterator(pieces.begin() + 1), make_move_iterator(pieces.end()));
+        }
+        updateBlockFirst();
+    }
+
+    LexToken absolute(size_t block, size_t i, int64_t delta) const {
+        LexToken tk = blocks[block].items[i];
+        tk.offset = (uint32_t)((int64_t)blocks[block].base + tk.offset + delta);
+        return tk;
+    }
+
+    void updateBlockFirst() {
+        blockFirst.resize(blocks.size());
+        count = 0;
+        for (size_t b = 0; b < blocks.size(); b++) {
+            blockFirst[b] = count;
+            count += blocks[b].items.size();
+        }
+    }
+};
+
+// ==========================================
+// 文件处理、结果缓存、批处理与服务模式 (与实验三共用，见 批处理与服务.h)
+// ==========================================
+
+// 分析规则或输出格式改变时改这里，旧的缓存项自然失效
+const char RESULT_CACHE_VERSION[] = "lab2-2";
+const char RESULT_CACHE_MAGIC[] = "LAB2RC02";
+
+#include "批处理与服务.h"
+
+// 处理单个文件：读入 -> 词法分析 -> 写出。失败时返回 false 并在 err 中给出原因
+// 给出 --cache-dir 时先查缓存，命中就直接写出缓存里的输出
+bool processFile(const string& inPath, const string& outPath, string& err) {
+    if (!readWholeFile(inPath, srcBuf, err)) return false;
+    string cacheFile;
+    if (!cacheDir.empty()) {
+        // 两种输出格式的结果分开缓存
+        cacheFile = cacheEntryPath(srcBuf, binaryOutput ? ".lab2tok" : ".lab2");
+        CacheEntry cached;
+        if (openCacheEntry(cacheFile, srcBuf.size(), cached)) return writeText(outPath, cached.output, err);
+    }
+    outFile.data.clear();
+    resetSymbols();
+
+    if (!binaryOutput) analyze();
+    else if (!analyzeBinary(err)) return false;
+    if (!cacheFile.empty()) storeCacheEntry(cacheFile, srcBuf.size(), outFile.data);
+
+    return writeText(outPath, outFile.data, err);
+}
+
+// 服务模式下分析一个请求：输入已在 srcBuf 中，输出留在 outFile
+bool serveRequest(string&) {
+    outFile.data.clear();
+    resetSymbols();
     analyze();
+    return true;
+}
 
-    // 关闭文件
-    inFile.close();
-    outFile.close();
+// 被其他程序 (如 基准测试.cpp) 用 #include 嵌入时定义 NO_MAIN，去掉这里的 main
+#ifndef NO_MAIN
+int main(int argc, char* argv[]) {
+    // 用法: 实验二                       处理 testfile.txt -> output.txt
+    //       实验二 -b <目录|列表文件> [-o 输出目录] [-j 线程数]
+    //       以上两种都可加 --cache-dir <目录>，按输入内容缓存输出，内容没变的文件不再分析；
+    //       加 --binary，输出二进制单词流 (output.tok / <输入>.tok) 而不是文本
+    //       实验二 --to-text [文件]              把二进制单词流 (默认 output.tok) 转换回文本，写到标准输出
+    //       实验二 --serve <套接字> [-j 线程数]   常驻服务，经 Unix 域套接字接收请求
+    //       实验二 --client <套接字> [文件]       把文件交给服务进程分析，输出写到标准输出
+    string batchInput, outDir, serveSocket, clientSocket, clientInput = "testfile.txt", textInput;
+    unsigned threadCount = 0;
+    // 可省略的文件名参数：下一个参数不是选项时取作文件名，否则先用默认文件名，
+    // 后面再出现的第一个非选项参数才是它的文件名 (如 --to-text --binary f.tok)
+    string* pendingFile = nullptr;
+    auto optionalFile = [&](int& i, string& target, const char* fallback) {
+        if (i + 1 < argc && argv[i + 1][0] != '-') {
+            target = argv[++i];
+        } else {
+            target = fallback;
+            pendingFile = &target;
+        }
+    };
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-b" && i + 1 < argc) batchInput = argv[++i];
+        else if (arg == "-o" && i + 1 < argc) outDir = argv[++i];
+        else if (arg == "-j" && i + 1 < argc && parseThreadCount(argv[i + 1], threadCount)) i++;
+        else if (arg == "--cache-dir" && i + 1 < argc) cacheDir = argv[++i];
+        else if (arg == "--binary") binaryOutput = true;
+        else if (arg == "--to-text") optionalFile(i, textInput, "output.tok");
+        else if (arg == "--serve" && i + 1 < argc) serveSocket = argv[++i];
+        else if (arg == "--client" && i + 1 < argc) {
+            clientSocket = argv[++i];
+            optionalFile(i, clientInput, "testfile.txt");
+        }
+        else if (arg[0] != '-' && pendingFile) {
+            *pendingFile = arg;
+            pendingFile = nullptr;
+        }
+        else {
+            cerr << "Usage: " << argv[0] << " [--cache-dir dir] [--binary] [-b <dir|list>] [-o outdir] [-j threads] | --to-text [file] | --serve <socket> [-j threads] | --client <socket> [file]" << endl;
+            return 1;
+        }
+    }
+    if (!textInput.empty()) {
+        OutBuffer text;
+        string err;
+        if (!tokenFileToText(textInput, text, err)) {
+            cerr << "Error: " << err << endl;
+            return 1;
+        }
+        cout.write(text.data.data(), (streamsize)text.data.size());
+        return cout ? 0 : 1;
+    }
+    if (!cacheDir.empty()) {
+        error_code ec;
+        std::filesystem::create_directories(cacheDir, ec);
+        if (ec) {
+            cerr << "Error: Cannot create " << cacheDir << endl;
+            return 1;
+        }
+    }
+    if (!serveSocket.empty()) {
+        return runServer(serveSocket, threadCount);
+    }
+    if (!clientSocket.empty()) {
+        return runClient(clientSocket, clientInput);
+    }
+    if (!batchInput.empty()) {
+        return runBatch(batchInput, outDir, threadCount, binaryOutput ? ".tok" : ".out");
+    }
 
+    // 单文件模式：读入 testfile.txt，执行词法分析，写出 output.txt (或 output.tok)
+    string err;
+    if (!processFile("testfile.txt", binaryOutput ? "output.tok" : "output.txt", err)) {
+        cerr << "Error: " << err << endl;
+        return 1;
+    }
     return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,451 @@
+// 实验二、实验三共用的文件处理、结果缓存、批处理和服务模式
+//
+// 这里的代码直接 #include 进两个实验 (基准测试.cpp 又把两个实验分别放进 lab2、lab3 命名空间里包含)，
+// 所以不加 include guard，也不包含任何头文件：所需的标准库和系统头文件由包含它的实验先包含好。
+// 包含之前，实验要先定义：
+//   srcBuf、outFile              线程内的输入缓冲区和输出缓冲区
+//   RESULT_CACHE_VERSION         结果缓存的版本串，分析规则或输出格式改变时修改，旧的缓存项自然失效
+//   RESULT_CACHE_MAGIC           结果缓存文件的 8 字节魔数
+// 并实现下面两个函数 (可以在包含之后再定义)：
+bool processFile(const string& inPath, const string& outPath, string& err); // 读入 -> 分析 -> 写出
+bool serveRequest(string& err); // 服务模式：分析 srcBuf，输出留在 outFile 中
+
+// 输入文件的上限：单词在输入中的位置和长度都是 32 位的 (实验二的 LexToken、实验三的 Token)，
+// 更大的输入会让位置回绕，单词值取错，所以直接拒绝
+const uint64_t MAX_INPUT_BYTES = (uint64_t)UINT32_MAX;
+
+// 读入整个文件到 buf (复用 buf 已有的容量)；打不开、读不全或超过 MAX_INPUT_BYTES 时返回 false 并在 err 中给出原因
+bool readWholeFile(const string& path, string& buf, string& err) {
+    ifstream in(path, ios::binary);
+    err = "Cannot open " + path;
+    if (!in.is_open()) return false;
+    in.seekg(0, ios::end);
+    streamoff size = in.tellg();
+    if (size < 0) return false;
+    if ((uint64_t)size > MAX_INPUT_BYTES) {
+        err = path + " is too large (inputs must be smaller than 4 GiB)";
+        return false;
+    }
+    in.seekg(0, ios::beg);
+    buf.resize((size_t)size);
+    in.read(&buf[0], size);
+    if (in.gcount() != size) return false;
+    err.clear();
+    return true;
+}
+
+bool writeText(const string& outPath, string_view text, string& err) {
+    ofstream out(outPath, ios::binary);
+    if (!out.is_open()) {
+        err = "Cannot open " + outPath;
+        return false;
+    }
+    out.write(text.data(), (streamsize)text.size());
+    if (!out) {
+        err = "Write failed: " + outPath;
+        return false;
+    }
+    return true;
+}
+
+// ------------------------------------------
+// 结果缓存 (--cache-dir)
+// ------------------------------------------
+
+// 缓存目录里每个输入一个文件，文件名是输入内容连同工具版本的摘要，内容没变的输入算一次摘要、
+// 映射一个文件就能直接得到输出。文件内容：文件头，之后是渲染好的输出文本，只缓存分析成功的文件。
+// 写入时先写临时文件再 rename，几个并行的进程共用一个目录也不会读到写了一半的文件
+string cacheDir;
+
+struct CacheHeader {
+    char magic[8];
+    uint64_t srcSize; // 输入的字节数，命中时再核对一次
+    uint64_t outputSize;
+};
+
+// 输入内容和版本的 64 位摘要：每次取 8 个字节，乘法加移位混合 (比逐字节的 FNV 快得多)
+uint64_t contentKey(string_view src) {
+    uint64_t h = 14695981039346656037ull ^ src.size();
+    auto mix = [&h](uint64_t w) {
+        h = (h ^ w) * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 29;
+    };
+    size_t i = 0;
+    for (; i + 8 <= src.size(); i += 8) {
+        uint64_t w;
+        memcpy(&w, src.data() + i, 8);
+        mix(w);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, src.data() + i, src.size() - i);
+    mix(tail);
+    for (const char* v = RESULT_CACHE_VERSION; *v; v++) mix((unsigned char)*v);
+    return h;
+}
+
+// ext 区分同一个工具的不同输出格式 (如 ".lab2" 和 ".lab2tok")
+string cacheEntryPath(string_view src, const char* ext) {
+    char name[24];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)contentKey(src));
+    return (std::filesystem::path(cacheDir) / (name + string(ext))).string();
+}
+
+// 映射到内存的缓存项，析构时解除映射
+struct CacheEntry {
+    const char* base = nullptr;
+    size_t size = 0;
+    string_view output;
+
+    CacheEntry() = default;
+    CacheEntry(const CacheEntry&) = delete;
+    CacheEntry& operator=(const CacheEntry&) = delete;
+    ~CacheEntry() {
+        if (base) munmap((void*)base, size);
+    }
+};
+
+// 打开并核对缓存项；不存在、格式不对或输入大小不符时返回 false
+bool openCacheEntry(const string& path, size_t srcSize, CacheEntry& entry) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(CacheHeader)) {
+        p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (p == MAP_FAILED) return false;
+    entry.base = (const char*)p;
+    entry.size = (size_t)st.st_size;
+    CacheHeader h;
+    memcpy(&h, p, sizeof(h));
+    if (memcmp(h.magic, RESULT_CACHE_MAGIC, 8) != 0 || h.srcSize != srcSize || h.outputSize != entry.size - sizeof(h)) {
+        return false;
+    }
+    entry.output = string_view(entry.base + sizeof(h), h.outputSize);
+    return true;
+}
+
+// 把 head、body 依次写成文件 path：先写到同一目录下的临时文件，写完再 rename 成正式的名字，
+// 中途崩溃或几个进程同时写都不会留下写了一半的文件
+atomic<unsigned> tempFileCounter(0);
+
+bool replaceFile(const string& path, string_view head, string_view body) {
+    string temp = path + ".tmp." + to_string(getpid()) + "." + to_string(tempFileCounter.fetch_add(1));
+    ofstream out(temp, ios::binary | ios::trunc);
+    out.write(head.data(), (streamsize)head.size());
+    out.write(body.data(), (streamsize)body.size());
+    out.close();
+    if (!out || rename(temp.c_str(), path.c_str()) != 0) {
+        remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// 写入缓存项。失败时只是这次没有缓存，不影响分析结果
+bool storeCacheEntry(const string& path, size_t srcSize, string_view output) {
+    CacheHeader h;
+    memcpy(h.magic, RESULT_CACHE_MAGIC, 8);
+    h.srcSize = srcSize;
+    h.outputSize = output.size();
+    return replaceFile(path, string_view((const char*)&h, sizeof(h)), output);
+}
+
+// ------------------------------------------
+// 批处理 (-b)
+// ------------------------------------------
+
+// 批处理写出的文件的扩展名 (两个实验都算上)。不带 -o 时输出就写在输入目录里，
+// 扫描目录时跳过它们，否则下一次运行会把上一次的输出当成输入
+const char* const BATCH_OUTPUT_EXTENSIONS[] = {".out", ".tok"};
+
+bool isBatchOutput(const std::filesystem::path& path) {
+    string ext = path.extension().string();
+    for (const char* out : BATCH_OUTPUT_EXTENSIONS) {
+        if (ext == out) return true;
+    }
+    return false;
+}
+
+// 收集批处理的输入文件：参数是目录时取其中所有普通文件 (批处理的输出文件除外)，否则当作每行一个路径的列表文件
+bool collectInputs(const string& arg, vector<string>& files) {
+    namespace fs = std::filesystem;
+    error_code ec;
+    if (fs::is_directory(arg, ec)) {
+        for (const auto& entry : fs::directory_iterator(arg, ec)) {
+            if (entry.is_regular_file() && !isBatchOutput(entry.path())) files.push_back(entry.path().string());
+        }
+        sort(files.begin(), files.end());
+        return !ec;
+    }
+    ifstream list(arg);
+    if (!list.is_open()) return false;
+    string line;
+    while (getline(list, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty()) files.push_back(line);
+    }
+    return true;
+}
+
+// 批处理模式：固定数量的工作线程从共享下标里领取文件，各自复用线程内的缓冲区
+// 输出文件为 <输入><ext>；给出 -o 目录时写到 <目录>/<文件名><ext>
+int runBatch(const string& inputArg, const string& outDir, unsigned threadCount, const char* ext) {
+    vector<string> files;
+    if (!collectInputs(inputArg, files)) {
+        cerr << "Error: Cannot read " << inputArg << endl;
+        return 1;
+    }
+    // 先定下每个输入的输出路径：-o 时不同目录下的同名输入 (或列表里重复的路径) 会写到同一个文件，直接报错
+    vector<string> outPaths(files.size());
+    map<string, size_t> writers;
+    for (size_t i = 0; i < files.size(); i++) {
+        outPaths[i] = outDir.empty()
+            ? files[i] + ext
+            : (std::filesystem::path(outDir) / std::filesystem::path(files[i]).filename()).string() + ext;
+        auto it = writers.emplace(outPaths[i], i);
+        if (!it.second) {
+            cerr << "Error: " << files[it.first->second] << " and " << files[i] << " would both write " << outPaths[i] << endl;
+            return 1;
+        }
+    }
+    if (threadCount == 0) threadCount = max(1u, thread::hardware_concurrency());
+    threadCount = (unsigned)min<size_t>(threadCount, max<size_t>(files.size(), 1));
+
+    vector<string> errors(files.size());
+    atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next.fetch_add(1)) < files.size()) {
+            string err;
+            if (!processFile(files[i], outPaths[i], err)) errors[i] = err;
+        }
+    };
+    vector<thread> pool;
+    for (unsigned t = 0; t < threadCount; t++) pool.emplace_back(worker);
+    for (auto& th : pool) th.join();
+
+    // 按输入顺序逐个报告失败的文件
+    size_t failed = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!errors[i].empty()) {
+            cerr << "FAIL " << files[i] << ": " << errors[i] << endl;
+            failed++;
+        }
+    }
+    cerr << files.size() << " files, " << failed << " failed" << endl;
+    return failed ? 1 : 0;
+}
+
+// 解析线程数这类正整数参数 (-j、--parallel)：不是十进制正整数或超出范围时返回 false
+bool parseThreadCount(const char* text, unsigned& value) {
+    char* end;
+    errno = 0;
+    unsigned long v = strtoul(text, &end, 10);
+    if (!isdigit((unsigned char)text[0]) || *end != '\0' || errno == ERANGE || v == 0 || v > 4096) return false;
+    value = (unsigned)v;
+    return true;
+}
+
+// ------------------------------------------
+// 服务模式 (--serve / --client)
+// ------------------------------------------
+
+// 常驻进程经 Unix 域套接字接收请求，省去每个小文件都要付出的进程启动和初始化。
+// 请求和应答都是一帧：1 字节类型 + 4 字节长度 (本机字节序) + 内容。
+// 请求 'S' 的内容是源程序文本，'P' 是服务进程能读到的源文件路径；
+// 应答 'O' 的内容是分析输出，'E' 是出错原因。一个连接上可以依次发多个请求
+const char REQ_SOURCE = 'S', REQ_PATH = 'P', RESP_OUTPUT = 'O', RESP_ERROR = 'E';
+// 请求帧内容的上限：长度字段来自对方，不加限制的话任何本机客户端都能让服务进程每个请求分配 4 GB。
+// 应答不受这个限制 (语法分析的输出大约是输入的 8 倍)，只受长度字段的 32 位限制
+const uint32_t MAX_FRAME_BYTES = 256u << 20;
+const uint64_t MAX_REPLY_BYTES = UINT32_MAX;
+
+bool readFull(int fd, char* p, size_t n) {
+    while (n > 0) {
+        ssize_t got = read(fd, p, n);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        n -= (size_t)got;
+    }
+    return true;
+}
+
+// 对方已经关闭连接时不产生 SIGPIPE，只返回 false
+bool writeFull(int fd, const char* p, size_t n) {
+    while (n > 0) {
+        ssize_t put = send(fd, p, n, MSG_NOSIGNAL);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) return false;
+        p += put;
+        n -= (size_t)put;
+    }
+    return true;
+}
+
+// 读一帧，内容超过 maxLength 时返回 false (服务进程读请求时用 MAX_FRAME_BYTES，客户端读应答时不限)
+bool readFrame(int fd, char& type, string& payload, uint32_t maxLength) {
+    char head[5];
+    if (!readFull(fd, head, sizeof(head))) return false;
+    uint32_t length;
+    memcpy(&length, head + 1, sizeof(length));
+    type = head[0];
+    if (length > maxLength) return false;
+    payload.resize(length);
+    return readFull(fd, &payload[0], length);
+}
+
+// 写一帧；内容的长度放不进 32 位长度字段时什么也不写，返回 false
+bool writeFrame(int fd, char type, string_view payload) {
+    if (payload.size() > MAX_REPLY_BYTES) return false;
+    char head[5];
+    uint32_t length = (uint32_t)payload.size();
+    head[0] = type;
+    memcpy(head + 1, &length, sizeof(length));
+    return writeFull(fd, head, sizeof(head)) && writeFull(fd, payload.data(), payload.size());
+}
+
+// 填写 Unix 域套接字地址，路径太长时返回 false
+bool makeSocketAddr(const string& path, sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) return false;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+// 逐个处理一个连接上的请求，直到对方关闭连接。
+// 请求之间复用本线程的 srcBuf、outFile 等缓冲区，不再重新分配。
+// 一个请求出了异常 (如内存不足) 只对这个请求回答 'E'，不能让整个服务进程退出；
+// 分析器的状态在下一个请求开始时会重置
+thread_local string requestPath;
+
+void serveConnection(int fd) {
+    char type;
+    while (readFrame(fd, type, srcBuf, MAX_FRAME_BYTES)) {
+        string err;
+        if (type == REQ_PATH) {
+            requestPath.swap(srcBuf);
+            readWholeFile(requestPath, srcBuf, err);
+        } else if (type != REQ_SOURCE) {
+            err = string("Unknown request type ") + type;
+        }
+        if (err.empty()) {
+            try {
+                serveRequest(err);
+            } catch (const exception& e) {
+                err = string("Request failed: ") + e.what();
+            }
+        }
+        if (err.empty() && outFile.data.size() > MAX_REPLY_BYTES) {
+            err = "Output of " + to_string(outFile.data.size()) + " bytes is too large to send";
+        }
+        bool sent = err.empty() ? writeFrame(fd, RESP_OUTPUT, outFile.data) : writeFrame(fd, RESP_ERROR, err);
+        if (!sent) break;
+    }
+    close(fd);
+}
+
+// 等待工作线程领取的连接
+mutex serverLock;
+condition_variable serverReady;
+deque<int> serverQueue;
+
+// 服务模式：监听 socketPath，threadCount 个工作线程从队列里领取连接。
+// 连接在关闭之前一直占用一个工作线程，所以连接数超过线程数时后来的连接要排队
+int runServer(const string& socketPath, unsigned threadCount) {
+    sockaddr_un addr;
+    if (!makeSocketAddr(socketPath, addr)) {
+        cerr << "Error: Socket path too long: " << socketPath << endl;
+        return 1;
+    }
+    // 路径上已经有东西时，只删除上次没有正常退出时留下的套接字文件 (连不上的套接字)；
+    // 普通文件或者还有服务进程在监听的套接字都不动，报错退出
+    struct stat st;
+    if (lstat(socketPath.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            cerr << "Error: " << socketPath << " exists and is not a socket" << endl;
+            return 1;
+        }
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool live = probe >= 0 && connect(probe, (sockaddr*)&addr, sizeof(addr)) == 0;
+        if (probe >= 0) close(probe);
+        if (live) {
+            cerr << "Error: Another server is already listening on " << socketPath << endl;
+            return 1;
+        }
+        unlink(socketPath.c_str());
+    }
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0 || ::bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, SOMAXCONN) != 0) {
+        cerr << "Error: Cannot listen on " << socketPath << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    if (threadCount == 0) threadCount = max(1u, thread::hardware_concurrency());
+    vector<thread> pool;
+    for (unsigned t = 0; t < threadCount; t++) {
+        pool.emplace_back([]() {
+            for (;;) {
+                unique_lock<mutex> lock(serverLock);
+                serverReady.wait(lock, []() { return !serverQueue.empty(); });
+                int fd = serverQueue.front();
+                serverQueue.pop_front();
+                lock.unlock();
+                serveConnection(fd);
+            }
+        });
+    }
+    for (;;) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            cerr << "Error: accept failed: " << strerror(errno) << endl;
+            break;
+        }
+        {
+            lock_guard<mutex> guard(serverLock);
+            serverQueue.push_back(fd);
+        }
+        serverReady.notify_one();
+    }
+    close(listenFd);
+    unlink(socketPath.c_str());
+    for (auto& th : pool) th.detach();
+    return 1;
+}
+
+// 客户端：把 inPath 的内容发给服务进程，分析输出写到标准输出
+int runClient(const string& socketPath, const string& inPath) {
+    string src, err;
+    if (!readWholeFile(inPath, src, err)) {
+        cerr << "Error: " << err << endl;
+        return 1;
+    }
+    if (src.size() > MAX_FRAME_BYTES) {
+        cerr << "Error: " << inPath << " is larger than the server accepts (" << (MAX_FRAME_BYTES >> 20) << " MB)" << endl;
+        return 1;
+    }
+    sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || !makeSocketAddr(socketPath, addr) || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        cerr << "Error: Cannot connect to " << socketPath << endl;
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    char type;
+    string reply;
+    bool ok = writeFrame(fd, REQ_SOURCE, src) && readFrame(fd, type, reply, UINT32_MAX);
+    close(fd);
+    if (!ok) {
+        cerr << "Error: Connection to " << socketPath << " closed" << endl;
+        return 1;
+    }
+    if (type != RESP_OUTPUT) {
+        cerr << "Error: " << reply << endl;
+        return 1;
+    }
+    cout.write(reply.data(), (streamsize)reply.size());
+    return cout ? 0 : 1;
+}
@@ -0,0 +1,543 @@
+// 随机程序生成器：按实验三的文法生成随机的源程序，作为语法分析器的压力测试和性能测试语料
+// 生成的程序语法正确，语义上也能通过实验三的编译 (名字先说明后使用、函数只调用前面定义过的函数、
+// 实参个数与形参相同、只有有返回值的函数出现在表达式里)，但不保证运行时会结束
+// 编译: g++ -O2 -std=c++17 程序生成器.cpp -o progen
+// 用法: progen [--size 64K] [--functions N] [--depth D] [--expr E] [--decls K] [--seed N] [-o 输出文件]
+//   --size       生成到不小于这个大小为止，可以带 K/M/G，默认 64K
+//   --functions  主函数之外的函数定义个数，默认每 32K 一个
+//   --depth      语句的最大嵌套层数，默认 4；每个函数的第一条语句正好嵌套到这么深
+//   --expr       一个表达式里最多有几个因子，默认 8
+//   --decls      说明的密度：全局和每个函数各说明大约这么多个变量 (另有四分之一的常量、数组和字符变量)，默认 8
+// 输出边生成边写 (每攒够 1MB 写一次)，生成几 GB 的程序也只占很少的内存
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+using namespace std;
+
+// ==========================================
+// 1. 参数
+// ==========================================
+
+struct GenOptions {
+    uint64_t size = 64 << 10;
+    uint32_t functions = 0; // 0 表示按 size 决定
+    uint32_t depth = 4;
+    uint32_t expr = 8;
+    uint32_t decls = 8;
+    uint64_t seed = 1;
+};
+
+// 每多少字节安排一个函数 (没有指定 --functions 时)
+const uint64_t BYTES_PER_FUNCTION = 32 << 10;
+// 缩进最多这么多层，更深的语句不再增加缩进 (深层嵌套时缩进不至于占掉大半个文件)
+const uint32_t MAX_INDENT = 16;
+
+// ==========================================
+// 2. 程序生成
+// ==========================================
+
+class ProgramGenerator {
+public:
+    // out 不为空时输出边生成边写进 out，否则整个程序留在 text 里
+    ProgramGenerator(const GenOptions& options, FILE* out = nullptr) : opt(options), file(out), rng(options.seed) {}
+
+    string text;
+    uint64_t written = 0; // 生成结束后是整个程序的字节数
+
+    // 生成整个程序；写文件失败时返回 false
+    bool generate() {
+        opt.expr = max(opt.expr, 1u);
+        opt.decls = max(opt.decls, 1u);
+        uint32_t funcCount = opt.functions ? opt.functions : (uint32_t)max<uint64_t>(1, opt.size / BYTES_PER_FUNCTION);
+
+        // <程序> ::= [<常量说明>] [<变量说明>] {<有返回值函数定义> | <无返回值函数定义>} <主函数>
+        declareConsts("N", "C", false);
+        declareVars("g", "ga", "gc", false);
+        globalCount = scope.size();
+        uint64_t perFunction = opt.size > size() ? (opt.size - size()) / (funcCount + 1) : 0;
+        for (uint32_t f = 0; f < funcCount; f++) {
+            uint64_t end = size() + perFunction;
+            defineFunction(f, end);
+            if (!flush(false)) return false;
+        }
+        defineMain();
+        return flush(true);
+    }
+
+private:
+    // 返回类型
+    enum ValueType { VT_INT, VT_CHAR, VT_VOID };
+    const char* const typeNames[3] = {"int", "char", "void"};
+
+    // 名字的种类
+    enum NameKind { NK_CONST, NK_VAR, NK_ARRAY };
+    struct Name {
+        string text;
+        NameKind kind;
+        uint32_t length; // 数组长度
+    };
+    struct Function {
+        string name;
+        ValueType type;
+        uint32_t params;
+    };
+
+    GenOptions opt;
+    FILE* file;
+    mt19937_64 rng;
+    vector<Name> scope;      // 全局名字在前，当前函数的名字在后
+    size_t globalCount = 0;
+    vector<Function> funcs;  // 已经定义的函数 (当前函数能调用的)
+    vector<uint32_t> valueFuncs; // 其中有返回值的 (能出现在表达式里的)
+    ValueType currentType = VT_VOID;
+    // 当前函数里各种名字的下标，选名字时用
+    vector<uint32_t> readable, assignable, arrays;
+
+    uint32_t pick(uint32_t n) { return (uint32_t)(rng() % n); }
+    bool chance(uint32_t percent) { return pick(100) < percent; }
+
+    void put(const char* s) { text += s; }
+    void put(const string& s) { text += s; }
+    void put(char c) { text += c; }
+    void indent(uint32_t depth) { text.append(min(depth + 1, MAX_INDENT) * 4, ' '); }
+
+    // 文件模式下攒够 1MB (或者结束时) 写出去，written 累计写出的字节数
+    bool flush(bool final) {
+        if (!file) {
+            written = text.size();
+            return true;
+        }
+        if (!final && text.size() < (1 << 20)) return true;
+        bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+        written += text.size();
+        text.clear();
+        return ok;
+    }
+    uint64_t size() const { return file ? written + text.size() : text.size(); }
+
+    void addName(const string& text, NameKind kind, uint32_t length = 0) { scope.push_back({text, kind, length}); }
+
+    // <常量说明>：每行一个 <常量定义>，整数常量 decls/4 个，字符常量一个
+    void declareConsts(const char* intPrefix, const char* charPrefix, bool local) {
+        uint32_t count = max(opt.decls / 4, 1u);
+        for (uint32_t i = 0; i < count; i += 4) {
+            if (local) put("    ");
+            put("const int ");
+            for (uint32_t j = i; j < min(i + 4, count); j++) {
+                string name = intPrefix + to_string(j);
+                put(j > i ? ", " : "");
+                put(name + " = " + integer(true));
+                addName(name, NK_CONST);
+            }
+            put(";\n");
+        }
+        if (local) put("    ");
+        string name = string(charPrefix) + "0";
+        put("const char " + name + " = " + charLiteral() + ";\n");
+        addName(name, NK_CONST);
+    }
+
+    // <变量说明>：int 变量 decls 个 (每行至多 8 个)，int 数组和 char 变量各 decls/4 个
+    void declareVars(const char* varPrefix, const char* arrayPrefix, const char* charPrefix, bool local) {
+        for (uint32_t i = 0; i < opt.decls; i += 8) {
+            if (local) put("    ");
+            put("int ");
+            for (uint32_t j = i; j < min(i + 8, opt.decls); j++) {
+                string name = varPrefix + to_string(j);
+                put(j > i ? ", " : "");
+                put(name);
+                addName(name, NK_VAR);
+            }
+            put(";\n");
+        }
+        uint32_t extra = max(opt.decls / 4, 1u);
+        if (local) put("    ");
+        put("int ");
+        for (uint32_t j = 0; j < extra; j++) {
+            string name = arrayPrefix + to_string(j);
+            uint32_t length = 1 + pick(100);
+            put(j ? ", " : "");
+            put(name + "[" + to_string(length) + "]");
+            addName(name, NK_ARRAY, length);
+        }
+        put(";\n");
+        if (local) put("    ");
+        put("char ");
+        for (uint32_t j = 0; j < extra; j++) {
+            string name = charPrefix + to_string(j);
+            put(j ? ", " : "");
+            put(name);
+            addName(name, NK_VAR);
+        }
+        put(";\n");
+    }
+
+    // 进入函数体前整理当前能用的名字
+    void collectNames() {
+        readable.clear();
+        assignable.clear();
+        arrays.clear();
+        for (uint32_t i = 0; i < scope.size(); i++) {
+            if (scope[i].kind == NK_ARRAY) arrays.push_back(i);
+            else readable.push_back(i);
+            if (scope[i].kind == NK_VAR) assignable.push_back(i);
+        }
+    }
+
+    // <有返回值函数定义> / <无返回值函数定义>，函数体一直生成到总大小达到 end
+    void defineFunction(uint32_t index, uint64_t end) {
+        Function f{"f" + to_string(index), (ValueType)pick(3), pick(4)};
+        put(string(typeNames[f.type]) + " " + f.name + "(");
+        scope.resize(globalCount);
+        for (uint32_t p = 0; p < f.params; p++) {
+            string name = "p" + to_string(p);
+            put(p ? ", " : "");
+            put(string(chance(75) ? "int " : "char ") + name);
+            addName(name, NK_VAR);
+        }
+        put(") {\n");
+        // 自己在函数体里还看不到 (不生成递归调用，运行起来不至于无穷递归)
+        currentType = f.type;
+        body(end);
+        if (f.type != VT_VOID) {
+            indent(0);
+            put("return (");
+            expression();
+            put(");\n");
+        }
+        put("}\n");
+        if (f.type != VT_VOID) valueFuncs.push_back((uint32_t)funcs.size());
+        funcs.push_back(f);
+    }
+
+    // <主函数>：生成到总大小不小于 --size 为止
+    void defineMain() {
+        put("void main() {\n");
+        scope.resize(globalCount);
+        currentType = VT_VOID;
+        body(opt.size);
+        put("}\n");
+    }
+
+    // <复合语句>：局部常量、变量说明，然后是语句列；第一条语句嵌套到 --depth 层
+    void body(uint64_t end) {
+        if (chance(50)) declareConsts("k", "kc", true);
+        declareVars("v", "a", "c", true);
+        collectNames();
+        statement(0, true);
+        while (size() < end) {
+            statement(0, false);
+            if (!flush(false)) return;
+        }
+    }
+
+    // --- 语句 ---
+
+    // 语句按显式栈展开，--depth 再大也不会耗尽生成器自己的调用栈。
+    // 栈里的每项要么是一段要原样输出的文字 (depth < 0)，要么是"在 depth 层生成一条语句"；
+    // chain 为真的那条语句一定是复合语句，且其中恰好有一条子语句继续 chain，直到 --depth 层
+    struct Work {
+        int32_t depth;
+        bool chain;
+        string text;
+    };
+    vector<Work> work;
+
+    void statement(uint32_t depth, bool chain) {
+        work.push_back({(int32_t)depth, chain, ""});
+        while (!work.empty()) {
+            Work w = move(work.back());
+            work.pop_back();
+            if (w.depth < 0) {
+                put(w.text);
+                continue;
+            }
+            uint32_t d = (uint32_t)w.depth;
+            bool nested = d < opt.depth && (w.chain || chance(30));
+            if (nested) compoundStatement(d, w.chain);
+            else simpleStatement(d);
+        }
+    }
+
+    // 把 "在 d 层生成语句" 和文字压栈；要按输出顺序的逆序压
+    void pushText(uint32_t depth, const string& s) {
+        string line(min(depth + 1, MAX_INDENT) * 4, ' ');
+        work.push_back({-1, false, line + s});
+    }
+    void pushStatement(uint32_t depth, bool chain) { work.push_back({(int32_t)depth, chain, ""}); }
+
+    void compoundStatement(uint32_t d, bool chain) {
+        indent(d);
+        switch (pick(6)) {
+        case 0: // if (<条件>) <语句>
+            put("if (");
+            condition();
+            put(")\n");
+            pushStatement(d + 1, chain);
+            break;
+        case 1: { // if (<条件>) <语句> else <语句>
+            put("if (");
+            condition();
+            put(")\n");
+            bool second = chain && chance(50);
+            pushStatement(d + 1, second);
+            pushText(d, "else\n");
+            pushStatement(d + 1, chain && !second);
+            break;
+        }
+        case 2: // while (<条件>) <语句>
+            put("while (");
+            condition();
+            put(")\n");
+            pushStatement(d + 1, chain);
+            break;
+        case 3: { // do <语句> while (<条件>)
+            put("do\n");
+            string cond = "while (" + captured([&]() { condition(); }) + ")\n";
+            pushText(d, cond);
+            pushStatement(d + 1, chain);
+            break;
+        }
+        case 4: { // for (<标识符> = <表达式>; <条件>; <标识符> = <标识符> (+|-) <步长>) <语句>
+            const string& v = scope[assignable[pick((uint32_t)assignable.size())]].text;
+            put("for (" + v + " = ");
+            expression();
+            put("; ");
+            condition();
+            put("; " + v + " = " + v + (chance(70) ? " + " : " - ") + to_string(1 + pick(9)) + ")\n");
+            pushStatement(d + 1, chain);
+            break;
+        }
+        default: { // '{' <语句列> '}'
+            put("{\n");
+            uint32_t count = 1 + pick(4);
+            uint32_t chained = pick(count);
+            pushText(d, "}\n");
+            for (uint32_t i = count; i-- > 0;) pushStatement(d + 1, chain && i == chained);
+            break;
+        }
+        }
+    }
+
+    // 临时把输出改到一个字符串里 (do-while 的条件要在循环体之后输出)
+    template <class F>
+    string captured(F generate) {
+        size_t mark = text.size();
+        generate();
+        string s = text.substr(mark);
+        text.resize(mark);
+        return s;
+    }
+
+    void simpleStatement(uint32_t d) {
+        indent(d);
+        uint32_t r = pick(100);
+        if (r < 35) { // <标识符> = <表达式>;
+            put(scope[assignable[pick((uint32_t)assignable.size())]].text + " = ");
+            expression();
+        } else if (r < 50) { // <标识符> '[' <表达式> ']' = <表达式>;
+            put(scope[arrays[pick((uint32_t)arrays.size())]].text + "[");
+            expression();
+            put("] = ");
+            expression();
+        } else if (r < 62 && !funcs.empty()) { // 函数调用语句;
+            call(funcs[pick((uint32_t)funcs.size())], opt.expr);
+        } else if (r < 80) { // <写语句>;
+            uint32_t form = pick(3);
+            put("printf(");
+            if (form != 2) put(stringLiteral());
+            if (form == 0) put(", ");
+            if (form != 1) expression();
+            put(")");
+        } else if (r < 87) { // <读语句>;
+            put("scanf(");
+            uint32_t count = 1 + pick(3);
+            for (uint32_t i = 0; i < count; i++) {
+                put(i ? ", " : "");
+                put(scope[assignable[pick((uint32_t)assignable.size())]].text);
+            }
+            put(")");
+        } else if (r < 92) { // <返回语句>;
+            put("return");
+            if (currentType != VT_VOID) {
+                put(" (");
+                expression();
+                put(")");
+            }
+        }
+        // 其余是空语句
+        put(";\n");
+    }
+
+    // --- 表达式 ---
+
+    // <条件> ::= <表达式> <关系运算符> <表达式> | <表达式>
+    void condition() {
+        static const char* const relOps[] = {" < ", " <= ", " > ", " >= ", " != ", " == "};
+        expression();
+        if (chance(85)) {
+            put(relOps[pick(6)]);
+            expression();
+        }
+    }
+
+    // 一个至多有 --expr 个因子的表达式
+    void expression() {
+        if (chance(10)) put(chance(50) ? "-" : "+");
+        expr(1 + pick(opt.expr));
+    }
+
+    // <表达式> ::= [+|-] <项> { <加法运算符> <项> }，一共 n 个因子
+    // 子表达式 (括号、下标、实参) 的因子数随机取，平均每层减半，递归深度大约是 log n
+    void expr(uint32_t n) {
+        for (bool first = true; n > 0; first = false) {
+            uint32_t k = 1 + pick(n);
+            if (!first) put(chance(50) ? " + " : " - ");
+            term(k);
+            n -= k;
+        }
+    }
+
+    // <项> ::= <因子> { <乘法运算符> <因子> }
+    void term(uint32_t n) {
+        for (bool first = true; n > 0; first = false) {
+            uint32_t k = 1 + pick(n);
+            if (!first) put(chance(70) ? " * " : " / ");
+            factor(k);
+            n -= k;
+        }
+    }
+
+    // <因子>：n == 1 时是名字或常量，否则是含 n - 1 个因子的括号、下标或函数调用
+    void factor(uint32_t n) {
+        if (n > 1) {
+            uint32_t r = pick(3);
+            if (r == 0 || (r == 2 && valueFuncs.empty())) {
+                put("(");
+                expr(n - 1);
+                put(")");
+            } else if (r == 1) {
+                put(scope[arrays[pick((uint32_t)arrays.size())]].text + "[");
+                expr(n - 1);
+                put("]");
+            } else {
+                call(funcs[valueFuncs[pick((uint32_t)valueFuncs.size())]], n - 1);
+            }
+            return;
+        }
+        uint32_t r = pick(100);
+        if (r < 55) {
+            put(scope[readable[pick((uint32_t)readable.size())]].text);
+        } else if (r < 80) {
+            put(integer(chance(20)));
+        } else if (r < 90) {
+            put(charLiteral());
+        } else {
+            const Name& a = scope[arrays[pick((uint32_t)arrays.size())]];
+            put(a.text + "[" + to_string(pick(a.length)) + "]");
+        }
+    }
+
+    // <有返回值函数调用语句> / <无返回值函数调用语句>，n 个因子分给各个实参
+    void call(const Function& f, uint32_t n) {
+        put(f.name + "(");
+        for (uint32_t p = 0; p < f.params; p++) {
+            uint32_t share = max(1u, n / f.params);
+            put(p ? ", " : "");
+            expr(1 + pick(share));
+        }
+        put(")");
+    }
+
+    // --- 单词 ---
+
+    string integer(bool sign) {
+        string s = sign ? (chance(50) ? "-" : "+") : "";
+        return s + to_string(chance(10) ? 0 : 1 + pick(99999));
+    }
+
+    string charLiteral() {
+        static const char chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_+-*/";
+        return string("'") + chars[pick(sizeof(chars) - 1)] + "'";
+    }
+
+    string stringLiteral() {
+        static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789 =:,.!#";
+        string s = "\"";
+        uint32_t length = 1 + pick(24);
+        for (uint32_t i = 0; i < length; i++) s += chars[pick(sizeof(chars) - 1)];
+        return s + "\"";
+    }
+};
+
+// 解析 "64K", "16M", "2G" 这样的大小。不是 数字[K|M|G] 的形式时返回 0，超出 64 位时返回 UINT64_MAX
+uint64_t parseByteSize(const string& s) {
+    if (s.empty() || s[0] < '0' || s[0] > '9') return 0;
+    char* end = nullptr;
+    uint64_t value = strtoull(s.c_str(), &end, 10);
+    int shift = 0;
+    if (*end) {
+        char unit = (char)toupper((unsigned char)*end);
+        if (unit == 'K') shift = 10;
+        else if (unit == 'M') shift = 20;
+        else if (unit == 'G') shift = 30;
+        if (!shift || end[1]) return 0;
+    }
+    return value > (UINT64_MAX >> shift) ? UINT64_MAX : value << shift;
+}
+
+// 处理一个生成器参数 (argv[i] 及其取值)，不认识时返回 false；基准测试也用它解析同样的参数
+bool parseGenOption(int argc, char* argv[], int& i, GenOptions& opt) {
+    string arg = argv[i];
+    if (i + 1 >= argc) return false;
+    if (arg == "--size") {
+        opt.size = parseByteSize(argv[++i]);
+        if (opt.size == 0) return false;
+    }
+    else if (arg == "--functions") opt.functions = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    else if (arg == "--depth") opt.depth = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    else if (arg == "--expr") opt.expr = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    else if (arg == "--decls") opt.decls = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    else if (arg == "--seed") opt.seed = strtoull(argv[++i], nullptr, 10);
+    else return false;
+    return true;
+}
+
+// ==========================================
+// 3. 主程序
+// ==========================================
+
+// 被其他程序 (如 基准测试.cpp) 用 #include 嵌入时定义 NO_MAIN，去掉这里的 main
+#ifndef NO_MAIN
+int main(int argc, char* argv[]) {
+    GenOptions opt;
+    string outPath;
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "-o" && i + 1 < argc) outPath = argv[++i];
+        else if (!parseGenOption(argc, argv, i, opt)) {
+            fprintf(stderr, "Usage: %s [--size 64K] [--functions N] [--depth D] [--expr E] [--decls K] [--seed N] [-o file]\n", argv[0]);
+            return 1;
+        }
+    }
+    FILE* out = outPath.empty() ? stdout : fopen(outPath.c_str(), "wb");
+    if (!out) {
+        fprintf(stderr, "Error: Cannot open %s\n", outPath.c_str());
+        return 1;
+    }
+    ProgramGenerator gen(opt, out);
+    bool ok = gen.generate();
+    if (out != stdout) ok = fclose(out) == 0 && ok;
+    else ok = fflush(out) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Error: Write failed\n");
+        return 1;
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,121 @@
+// 实验二、实验三共用的标识符驻留表和输出缓冲
+//
+// 和 批处理与服务.h 一样直接 #include 进两个实验，不加 include guard，也不包含任何头文件。
+// 包含之前，实验要先定义单词类别 TokenKind 和关键字表 keywords (名字 -> 类别)。
+
+// ==========================================
+// 标识符驻留表
+// ==========================================
+
+// 同一个名字只保存一份，用 32 位编号代表，之后比较、哈希名字都只是比较整数。
+// 名字的字符放在按块分配的内存池里 (块满了再开新块，已保存的名字地址不变)；
+// 查找用开放定址 (线性探测) 的哈希表，槽里存 编号+1，0 表示空槽
+class SymbolInterner {
+public:
+    uint32_t intern(const char* s, size_t len) {
+        uint32_t hash = hashName(s, len);
+        size_t mask = slots.size() - 1;
+        size_t i = hash & mask;
+        for (; slots[i] != 0; i = (i + 1) & mask) {
+            const Entry& e = entries[slots[i] - 1];
+            if (e.hash == hash && e.len == len && memcmp(e.chars, s, len) == 0) return slots[i] - 1;
+        }
+        uint32_t id = (uint32_t)entries.size();
+        entries.push_back({store(s, len), (uint32_t)len, hash});
+        slots[i] = id + 1;
+        if (entries.size() * 2 > slots.size()) rehash(slots.size() * 2);
+        return id;
+    }
+
+    string_view name(uint32_t id) const { return string_view(entries[id].chars, entries[id].len); }
+    size_t size() const { return entries.size(); }
+
+    // 清空所有名字，但保留已分配的内存块和哈希表，供下一个文件复用
+    void clear() {
+        entries.clear();
+        fill(slots.begin(), slots.end(), 0);
+        blockIndex = 0;
+        blockUsed = 0;
+    }
+
+private:
+    struct Entry {
+        const char* chars;
+        uint32_t len;
+        uint32_t hash;
+    };
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    vector<Entry> entries;
+    vector<uint32_t> slots = vector<uint32_t>(256);
+    vector<unique_ptr<char[]>> blocks;
+    vector<size_t> blockSizes;
+    size_t blockIndex = 0, blockUsed = 0;
+
+    // FNV-1a
+    static uint32_t hashName(const char* s, size_t len) {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+        return h;
+    }
+
+    // 把名字复制进内存池
+    const char* store(const char* s, size_t len) {
+        while (blockIndex < blocks.size() && blockUsed + len > blockSizes[blockIndex]) {
+            blockIndex++;
+            blockUsed = 0;
+        }
+        if (blockIndex == blocks.size()) {
+            size_t size = max(BLOCK_SIZE, len);
+            blocks.emplace_back(new char[size]);
+            blockSizes.push_back(size);
+            blockUsed = 0;
+        }
+        char* dst = blocks[blockIndex].get() + blockUsed;
+        memcpy(dst, s, len);
+        blockUsed += len;
+        return dst;
+    }
+
+    void rehash(size_t newSize) {
+        slots.assign(newSize, 0);
+        size_t mask = newSize - 1;
+        for (uint32_t id = 0; id < entries.size(); id++) {
+            size_t i = entries[id].hash & mask;
+            while (slots[i] != 0) i = (i + 1) & mask;
+            slots[i] = id + 1;
+        }
+    }
+};
+
+// 每个线程一张驻留表。关键字按 keywords 表的顺序占用最前面的编号，
+// 识别标识符时驻留一次就能顺带判断是不是关键字，不必再查 map
+thread_local SymbolInterner symbols;
+thread_local bool symbolsSeeded = false;
+
+// 按编号记下关键字的类别码
+const vector<TokenKind> keywordKinds = [] {
+    vector<TokenKind> kinds;
+    for (const auto& kw : keywords) kinds.push_back(kw.second);
+    return kinds;
+}();
+
+// 清空驻留表并重新登记关键字 (每个文件开始前调用)
+void resetSymbols() {
+    symbols.clear();
+    for (const auto& kw : keywords) {
+        symbols.intern(kw.first.data(), kw.first.size());
+    }
+    symbolsSeeded = true;
+}
+
+// 输出缓冲：用法与 ofstream 相同 (支持 << 和 endl)，但内容先累积在内存里，
+// 分析结束后一次性写盘，避免 endl 每行刷新一次文件
+struct OutBuffer {
+    string data;
+    OutBuffer& operator<<(string_view s) { data += s; return *this; }
+    OutBuffer& operator<<(const char* s) { data += s; return *this; }
+    OutBuffer& operator<<(char c) { data += c; return *this; }
+    OutBuffer& operator<<(ostream& (*)(ostream&)) { data += '\n'; return *this; } // endl
+};
+